@@ -33,11 +33,15 @@
 #pragma warning(pop)
 
 #include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
+#include <iomanip>
 #include <memory>
 #include <numeric>
 #include <set>
 #include <sstream>
+#include <unordered_map>
 #include <vector>
 
 namespace
@@ -50,10 +54,25 @@ constexpr const wchar_t* UNREAL_GEOMETRY_ENCODER_DESCRIPTION = L"Encodes geometr
 constexpr const wchar_t* EO_EMIT_ATTRIBUTES = L"emitAttributes";
 constexpr const wchar_t* EO_EMIT_MATERIALS = L"emitMaterials";
 constexpr const wchar_t* EO_EMIT_REPORTS = L"emitReports";
+constexpr const wchar_t* EO_TRIANGULATE_AND_SHARE_INDICES = L"triangulateAndShareIndices";
+constexpr const wchar_t* EO_AUTO_INSTANCING_MIN_COUNT = L"autoInstancingMinCount";
+constexpr const wchar_t* EO_MIN_INSTANCE_COUNT = L"minInstanceCount";
+constexpr const wchar_t* EO_MAX_MERGED_INSTANCE_VERTEX_COUNT = L"maxMergedInstanceVertexCount";
+constexpr const wchar_t* EO_EMIT_NORMALS = L"emitNormals";
+constexpr const wchar_t* EO_MAX_UV_SETS = L"maxUVSets";
 
 const prtx::DoubleVector EMPTY_UVS;
+const prtx::DoubleVector EMPTY_NORMALS;
 const prtx::IndexVector EMPTY_IDX;
 
+// restricts the data which is serialized and passed to the callbacks
+struct OutputOptions
+{
+	bool emitMaterials = true;
+	bool emitNormals = true;
+	int32_t maxUVSets = -1; // -1 for all uv sets
+};
+
 struct SerializedGeometry
 {
 	prtx::DoubleVector coords;
@@ -398,7 +417,70 @@ void forwardGenericAttributes(IUnrealCallbacks* uc, size_t initialShapeIndex, co
 	});
 }
 
-SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries, const std::vector<prtx::MaterialPtrVector>& materials)
+// affine transformation (column major 4x4 matrix) applied to geometry which is baked into another mesh
+class GeometryTransformation
+{
+public:
+	explicit GeometryTransformation(const double* m) : m(m)
+	{
+		// cofactor matrix of the upper 3x3 block (= det * inverse transpose) to transform normals
+		cof[0] = m[5] * m[10] - m[6] * m[9];
+		cof[1] = m[6] * m[8] - m[4] * m[10];
+		cof[2] = m[4] * m[9] - m[5] * m[8];
+		cof[3] = m[2] * m[9] - m[1] * m[10];
+		cof[4] = m[0] * m[10] - m[2] * m[8];
+		cof[5] = m[1] * m[8] - m[0] * m[9];
+		cof[6] = m[1] * m[6] - m[2] * m[5];
+		cof[7] = m[2] * m[4] - m[0] * m[6];
+		cof[8] = m[0] * m[5] - m[1] * m[4];
+		const double det = m[0] * cof[0] + m[1] * cof[1] + m[2] * cof[2];
+		normalSign = det < 0.0 ? -1.0 : 1.0;
+	}
+
+	// mirroring transformations have to reverse the face winding
+	bool flipsWinding() const
+	{
+		return normalSign < 0.0;
+	}
+
+	void transformPoints(prtx::DoubleVector& coords, size_t begin) const
+	{
+		for (size_t i = begin; i + 2 < coords.size(); i += 3)
+		{
+			const double x = coords[i], y = coords[i + 1], z = coords[i + 2];
+			coords[i] = m[0] * x + m[4] * y + m[8] * z + m[12];
+			coords[i + 1] = m[1] * x + m[5] * y + m[9] * z + m[13];
+			coords[i + 2] = m[2] * x + m[6] * y + m[10] * z + m[14];
+		}
+	}
+
+	void transformNormals(prtx::DoubleVector& normals, size_t begin) const
+	{
+		for (size_t i = begin; i + 2 < normals.size(); i += 3)
+		{
+			const double x = normals[i], y = normals[i + 1], z = normals[i + 2];
+			double n[3] = {cof[0] * x + cof[3] * y + cof[6] * z, cof[1] * x + cof[4] * y + cof[7] * z, cof[2] * x + cof[5] * y + cof[8] * z};
+			const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			const double scale = length > 0.0 ? normalSign / length : 0.0;
+			normals[i] = n[0] * scale;
+			normals[i + 1] = n[1] * scale;
+			normals[i + 2] = n[2] * scale;
+		}
+	}
+
+private:
+	const double* m;
+	double cof[9];
+	double normalSign;
+};
+
+// if sharedIndices is set the meshes are expected to be prepared with INDICES_SAME_FOR_ALL_VERTEX_ATTRIBUTES and the serialized
+// normal and uv indices will be identical to the vertex indices (missing uv sets are padded with zero coordinates)
+// optionally, a transformation per geometry can be passed to bake instances into a merged mesh (nullptr for untransformed geometries)
+// the output options allow to skip normals and uv sets (textures are only considered for the uv sets if materials are emitted)
+SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries, const std::vector<prtx::MaterialPtrVector>& materials,
+									 bool sharedIndices = false, const std::vector<const double*>& transformations = {},
+									 const OutputOptions& outputOptions = {})
 {
 	// PASS 1: scan
 	uint32_t numCounts = 0;
@@ -419,7 +501,7 @@ SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries,
 			numIndices = std::accumulate(vtxCnts.begin(), vtxCnts.end(), numIndices);
 
 			const prtx::MaterialPtr& mat = *matIt;
-			const uint32_t requiredUVSetsByMaterial = scanValidTextures(mat);
+			const uint32_t requiredUVSetsByMaterial = outputOptions.emitMaterials ? scanValidTextures(mat) : 0u;
 			maxNumUVSets = std::max(maxNumUVSets, std::max(mesh->getUVSetsCount(), requiredUVSetsByMaterial));
 
 			for (uint32_t uvSet = 0; uvSet < mesh->getUVSetsCount(); uvSet++) {
@@ -432,25 +514,42 @@ SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries,
 		}
 		++matsIt;
 	}
+	if (outputOptions.maxUVSets >= 0)
+		maxNumUVSets = std::min(maxNumUVSets, static_cast<uint32_t>(outputOptions.maxUVSets));
 	SerializedGeometry sg(numCounts, numIndices, maxNumUVSets);
 
 	// PASS 2: copy
 	uint32_t vertexIndexBase = 0u;
 	uint32_t normalIndexBase = 0u;
 	std::vector<uint32_t> uvIndexBases(maxNumUVSets, 0u);
-	for (const auto& geo : geometries)
+	for (size_t gi = 0; gi < geometries.size(); gi++)
 	{
+		const prtx::GeometryPtr& geo = geometries[gi];
+		const double* transformationMatrix = (gi < transformations.size()) ? transformations[gi] : nullptr;
+		const std::unique_ptr<GeometryTransformation> transformation(
+			(transformationMatrix != nullptr) ? new GeometryTransformation(transformationMatrix) : nullptr);
+		const bool flipWinding = transformation && transformation->flipsWinding();
+		auto corner = [flipWinding](uint32_t vi, uint32_t cnt) { return flipWinding ? cnt - 1 - vi : vi; };
+
 		const prtx::MeshPtrVector& meshes = geo->getMeshes();
 		for (const auto& mesh : meshes)
 		{
 			// append points
 			const prtx::DoubleVector& verts = mesh->getVertexCoords();
+			const size_t coordsBegin = sg.coords.size();
 			sg.coords.insert(sg.coords.end(), verts.begin(), verts.end());
 
 			// append normals
-			const prtx::DoubleVector& norms = mesh->getVertexNormalsCoords();
+			const prtx::DoubleVector& norms = outputOptions.emitNormals ? mesh->getVertexNormalsCoords() : EMPTY_NORMALS;
+			const size_t normalsBegin = sg.normals.size();
 			sg.normals.insert(sg.normals.end(), norms.begin(), norms.end());
 
+			if (transformation)
+			{
+				transformation->transformPoints(sg.coords, coordsBegin);
+				transformation->transformNormals(sg.normals, normalsBegin);
+			}
+
 			// append uv sets (uv coords, counts, indices) with special cases:
 			// - if mesh has no uv sets but maxNumUVSets is > 0, insert "0" uv face counts to keep in sync
 			// - if a uv set is empty for all meshes, leave it empty
@@ -471,6 +570,30 @@ SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries,
 				const prtx::DoubleVector& uvs = (uvSet < numUVSets) ? mesh->getUVCoords(uvSet) : EMPTY_UVS;
 				const auto& src = uvs.empty() ? uvs0 : uvs;
 				auto& tgt = sg.uvs[uvSet];
+
+				if (sharedIndices)
+				{
+					// keep the uv indices in sync with the vertex indices
+					const size_t numVertices = verts.size() / 3;
+					if (src.size() == numVertices * 2)
+						tgt.insert(tgt.end(), src.begin(), src.end());
+					else
+						tgt.resize(tgt.size() + numVertices * 2, 0.0);
+
+					auto& tgtCnts = sg.uvCounts[uvSet];
+					for (uint32_t fi = 0, faceCount = mesh->getFaceCount(); fi < faceCount; ++fi)
+					{
+						const uint32_t vtxCnt = mesh->getFaceVertexCount(fi);
+						const uint32_t* vtxIdx = mesh->getFaceVertexIndices(fi);
+						tgtCnts.push_back(vtxCnt);
+						for (uint32_t vi = 0; vi < vtxCnt; vi++)
+							sg.uvIndices[uvSet].push_back(uvIndexBases[uvSet] + vtxIdx[corner(vi, vtxCnt)]);
+					}
+
+					uvIndexBases[uvSet] += static_cast<uint32_t>(numVertices);
+					continue;
+				}
+
 				tgt.insert(tgt.end(), src.begin(), src.end());
 
 				// append uv face counts
@@ -490,7 +613,7 @@ SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries,
 					if (DBG)
 						log_debug("      fi %1%: faceUVCnt = %2%, faceVtxCnt = %3%") % fi % faceUVCnt % mesh->getFaceVertexCount(fi);
 					for (uint32_t vi = 0; vi < faceUVCnt; vi++)
-						sg.uvIndices[uvSet].push_back(uvIndexBases[uvSet] + faceUVIdx[vi]);
+						sg.uvIndices[uvSet].push_back(uvIndexBases[uvSet] + faceUVIdx[corner(vi, faceUVCnt)]);
 				}
 
 				uvIndexBases[uvSet] += static_cast<uint32_t>(src.size()) / 2;
@@ -506,9 +629,14 @@ SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries,
 				const size_t nrmCnt = mesh->getFaceVertexNormalCount(fi);
 				for (uint32_t vi = 0; vi < vtxCnt; vi++)
 				{
-					sg.vertexIndices.push_back(vertexIndexBase + vtxIdx[vi]);
-					if (nrmCnt > vi && nrmIdx != nullptr)
-						sg.normalIndices.push_back(normalIndexBase + nrmIdx[vi]);
+					const uint32_t ci = corner(vi, vtxCnt);
+					sg.vertexIndices.push_back(vertexIndexBase + vtxIdx[ci]);
+					if (!outputOptions.emitNormals)
+						continue;
+					if (sharedIndices)
+						sg.normalIndices.push_back(vertexIndexBase + vtxIdx[ci]);
+					else if (nrmCnt > ci && nrmIdx != nullptr)
+						sg.normalIndices.push_back(normalIndexBase + nrmIdx[ci]);
 				}
 			}
 
@@ -521,7 +649,7 @@ SerializedGeometry serializeGeometry(const prtx::GeometryPtrVector& geometries,
 }
 
 void encodeMesh(IUnrealCallbacks* cb, const SerializedGeometry& sg, wchar_t const* name, wchar_t const* meshId, int32_t prototypeIndex, const std::wstring& uri,
-				prtx::GeometryPtrVector geometries, std::vector<prtx::MaterialPtrVector> materials)
+				prtx::GeometryPtrVector geometries, std::vector<prtx::MaterialPtrVector> materials, bool emitMaterials = true)
 {
 	auto puvs = toPtrVec(sg.uvs);
 	auto puvCounts = toPtrVec(sg.uvCounts);
@@ -541,8 +669,11 @@ void encodeMesh(IUnrealCallbacks* cb, const SerializedGeometry& sg, wchar_t cons
 			const prtx::MeshPtr& m = meshes.at(mi);
 			const prtx::MaterialPtr& mat = matIt->at(mi);
 
-			convertMaterialToAttributeMap(amb, *(mat.get()), mat->getKeys());
-			matAttrMaps.v.push_back(amb->createAttributeMapAndReset());
+			if (emitMaterials)
+			{
+				convertMaterialToAttributeMap(amb, *(mat.get()), mat->getKeys());
+				matAttrMaps.v.push_back(amb->createAttributeMapAndReset());
+			}
 			faceRanges.push_back(m->getFaceCount());
 		}
 
@@ -559,6 +690,378 @@ void encodeMesh(IUnrealCallbacks* cb, const SerializedGeometry& sg, wchar_t cons
 				faceRanges.data(), faceRanges.size(), matAttrMaps.v.empty() ? nullptr : matAttrMaps.v.data());
 }
 
+// auto instancing of repeated (non inserted) geometry
+constexpr double AUTO_INSTANCING_POSITION_TOLERANCE = 1e-4; // 0.1mm
+constexpr double AUTO_INSTANCING_NORMAL_TOLERANCE = 1e-3;
+constexpr double AUTO_INSTANCING_UV_TOLERANCE = 1e-5;
+constexpr double AUTO_INSTANCING_MIN_LENGTH = 1e-6;
+
+using Vector3 = std::array<double, 3>;
+
+Vector3 sub(const Vector3& a, const Vector3& b)
+{
+	return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+double dot(const Vector3& a, const Vector3& b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+Vector3 cross(const Vector3& a, const Vector3& b)
+{
+	return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+}
+
+bool normalize(Vector3& v)
+{
+	const double length = std::sqrt(dot(v, v));
+	if (length < AUTO_INSTANCING_MIN_LENGTH)
+		return false;
+	v = {v[0] / length, v[1] / length, v[2] / length};
+	return true;
+}
+
+Vector3 coordAt(const prtx::DoubleVector& coords, uint32_t index)
+{
+	return {coords[3 * index], coords[3 * index + 1], coords[3 * index + 2]};
+}
+
+void hashCombine(size_t& seed, size_t value)
+{
+	seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+}
+
+// independent 64 bit FNV-1a hash, combined with hashCombine to get 128 bit mesh ids for auto instances
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+void fnvCombine(uint64_t& hash, uint64_t value)
+{
+	for (int byte = 0; byte < 8; byte++)
+	{
+		hash ^= (value >> (8 * byte)) & 0xff;
+		hash *= FNV_PRIME;
+	}
+}
+
+// orthonormal right-handed frame derived from the geometry itself (first non-degenerate face)
+struct LocalFrame
+{
+	Vector3 origin;
+	std::array<Vector3, 3> axes;
+
+	// column major local to world transformation (same layout as prtx instance transformations)
+	std::array<double, 16> toTransformation() const
+	{
+		return {axes[0][0], axes[0][1], axes[0][2], 0.0, axes[1][0], axes[1][1], axes[1][2], 0.0,
+				axes[2][0], axes[2][1], axes[2][2], 0.0, origin[0],  origin[1],  origin[2],  1.0};
+	}
+
+	Vector3 toLocal(const Vector3& v) const
+	{
+		return {dot(v, axes[0]), dot(v, axes[1]), dot(v, axes[2])};
+	}
+};
+
+bool computeLocalFrame(const SerializedGeometry& sg, LocalFrame& frame)
+{
+	size_t indexBase = 0;
+	for (const uint32_t vtxCnt : sg.faceVertexCounts)
+	{
+		if (vtxCnt >= 3)
+		{
+			const Vector3 p0 = coordAt(sg.coords, sg.vertexIndices[indexBase]);
+			Vector3 e0 = sub(coordAt(sg.coords, sg.vertexIndices[indexBase + 1]), p0);
+
+			// newell's method for the face normal
+			Vector3 n = {0.0, 0.0, 0.0};
+			for (uint32_t vi = 0; vi < vtxCnt; vi++)
+			{
+				const Vector3 a = coordAt(sg.coords, sg.vertexIndices[indexBase + vi]);
+				const Vector3 b = coordAt(sg.coords, sg.vertexIndices[indexBase + (vi + 1) % vtxCnt]);
+				n[0] += (a[1] - b[1]) * (a[2] + b[2]);
+				n[1] += (a[2] - b[2]) * (a[0] + b[0]);
+				n[2] += (a[0] - b[0]) * (a[1] + b[1]);
+			}
+
+			if (normalize(e0) && normalize(n))
+			{
+				const double d = dot(n, e0);
+				Vector3 e1 = {n[0] - d * e0[0], n[1] - d * e0[1], n[2] - d * e0[2]};
+				if (normalize(e1))
+				{
+					frame.origin = p0;
+					frame.axes = {e0, e1, cross(e0, e1)};
+					return true;
+				}
+			}
+		}
+		indexBase += vtxCnt;
+	}
+	return false;
+}
+
+// transforms the coordinates and normals of the serialized geometry into the given local frame
+void transformToLocal(SerializedGeometry& sg, const LocalFrame& frame)
+{
+	for (size_t ci = 0; ci + 2 < sg.coords.size(); ci += 3)
+	{
+		const Vector3 local = frame.toLocal(sub({sg.coords[ci], sg.coords[ci + 1], sg.coords[ci + 2]}, frame.origin));
+		std::copy(local.begin(), local.end(), sg.coords.begin() + ci);
+	}
+	for (size_t ni = 0; ni + 2 < sg.normals.size(); ni += 3)
+	{
+		const Vector3 local = frame.toLocal({sg.normals[ni], sg.normals[ni + 1], sg.normals[ni + 2]});
+		std::copy(local.begin(), local.end(), sg.normals.begin() + ni);
+	}
+}
+
+// quantized representation of a serialized geometry in local space, used to verify hash matches
+std::vector<int64_t> createGeometryKey(const SerializedGeometry& sg)
+{
+	std::vector<int64_t> key;
+	key.reserve(sg.coords.size() + sg.normals.size() + sg.faceVertexCounts.size() + 2 * sg.vertexIndices.size() + 8);
+
+	auto appendQuantized = [&key](const prtx::DoubleVector& values, double tolerance) {
+		key.push_back(static_cast<int64_t>(values.size()));
+		for (const double v : values)
+			key.push_back(std::llround(v / tolerance));
+	};
+	auto appendIndices = [&key](const std::vector<uint32_t>& indices) {
+		key.push_back(static_cast<int64_t>(indices.size()));
+		key.insert(key.end(), indices.begin(), indices.end());
+	};
+
+	appendQuantized(sg.coords, AUTO_INSTANCING_POSITION_TOLERANCE);
+	appendQuantized(sg.normals, AUTO_INSTANCING_NORMAL_TOLERANCE);
+	appendIndices(sg.faceVertexCounts);
+	appendIndices(sg.vertexIndices);
+	appendIndices(sg.normalIndices);
+	for (size_t uvSet = 0; uvSet < sg.uvs.size(); uvSet++)
+	{
+		appendQuantized(sg.uvs[uvSet], AUTO_INSTANCING_UV_TOLERANCE);
+		appendIndices(sg.uvCounts[uvSet]);
+		appendIndices(sg.uvIndices[uvSet]);
+	}
+	return key;
+}
+
+size_t hashMaterial(const prtx::Material& mat)
+{
+	size_t seed = 0;
+	for (const auto& key : mat.getKeys())
+	{
+		hashCombine(seed, std::hash<std::wstring>()(key));
+		switch (mat.getType(key))
+		{
+		case prt::Attributable::PT_BOOL:
+			hashCombine(seed, std::hash<bool>()(mat.getBool(key) == prtx::PRTX_TRUE));
+			break;
+		case prt::Attributable::PT_FLOAT:
+			hashCombine(seed, std::hash<double>()(mat.getFloat(key)));
+			break;
+		case prt::Attributable::PT_INT:
+			hashCombine(seed, std::hash<int32_t>()(mat.getInt(key)));
+			break;
+		case prt::Attributable::PT_STRING:
+			hashCombine(seed, std::hash<std::wstring>()(mat.getString(key)));
+			break;
+		case prt::Attributable::PT_BOOL_ARRAY:
+			for (const uint8_t v : mat.getBoolArray(key))
+				hashCombine(seed, std::hash<bool>()(v == prtx::PRTX_TRUE));
+			break;
+		case prt::Attributable::PT_INT_ARRAY:
+			for (const int32_t v : mat.getIntArray(key))
+				hashCombine(seed, std::hash<int32_t>()(v));
+			break;
+		case prt::Attributable::PT_FLOAT_ARRAY:
+			for (const double v : mat.getFloatArray(key))
+				hashCombine(seed, std::hash<double>()(v));
+			break;
+		case prt::Attributable::PT_STRING_ARRAY:
+			for (const auto& v : mat.getStringArray(key))
+				hashCombine(seed, std::hash<std::wstring>()(v));
+			break;
+		case prtx::Material::PT_TEXTURE:
+			hashCombine(seed, std::hash<std::wstring>()(uriToPath(mat.getTexture(key))));
+			break;
+		case prtx::Material::PT_TEXTURE_ARRAY:
+			for (const auto& t : mat.getTextureArray(key))
+				hashCombine(seed, std::hash<std::wstring>()(uriToPath(t)));
+			break;
+		default:
+			hashCombine(seed, std::hash<int>()(static_cast<int>(mat.getType(key))));
+			break;
+		}
+	}
+	return seed;
+}
+
+bool texturesEqual(const prtx::TexturePtrVector& a, const prtx::TexturePtrVector& b)
+{
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+					  [](const prtx::TexturePtr& ta, const prtx::TexturePtr& tb) { return uriToPath(ta) == uriToPath(tb); });
+}
+
+// full comparison of the attributes which are hashed by hashMaterial, so that hash collisions do not merge different materials
+bool materialsEqual(const prtx::Material& a, const prtx::Material& b)
+{
+	if (&a == &b)
+		return true;
+
+	const prtx::WStringVector& keys = a.getKeys();
+	if (keys != b.getKeys())
+		return false;
+
+	for (const auto& key : keys)
+	{
+		if (a.getType(key) != b.getType(key))
+			return false;
+
+		bool equal = true;
+		switch (a.getType(key))
+		{
+		case prt::Attributable::PT_BOOL:
+			equal = (a.getBool(key) == prtx::PRTX_TRUE) == (b.getBool(key) == prtx::PRTX_TRUE);
+			break;
+		case prt::Attributable::PT_FLOAT:
+			equal = a.getFloat(key) == b.getFloat(key);
+			break;
+		case prt::Attributable::PT_INT:
+			equal = a.getInt(key) == b.getInt(key);
+			break;
+		case prt::Attributable::PT_STRING:
+			equal = a.getString(key) == b.getString(key);
+			break;
+		case prt::Attributable::PT_BOOL_ARRAY:
+			equal = a.getBoolArray(key) == b.getBoolArray(key);
+			break;
+		case prt::Attributable::PT_INT_ARRAY:
+			equal = a.getIntArray(key) == b.getIntArray(key);
+			break;
+		case prt::Attributable::PT_FLOAT_ARRAY:
+			equal = a.getFloatArray(key) == b.getFloatArray(key);
+			break;
+		case prt::Attributable::PT_STRING_ARRAY:
+			equal = a.getStringArray(key) == b.getStringArray(key);
+			break;
+		case prtx::Material::PT_TEXTURE:
+			equal = uriToPath(a.getTexture(key)) == uriToPath(b.getTexture(key));
+			break;
+		case prtx::Material::PT_TEXTURE_ARRAY:
+			equal = texturesEqual(a.getTextureArray(key), b.getTextureArray(key));
+			break;
+		default:
+			break;
+		}
+		if (!equal)
+			return false;
+	}
+	return true;
+}
+
+bool materialsEqual(const prtx::MaterialPtrVector& a, const prtx::MaterialPtrVector& b)
+{
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+					  [](const prtx::MaterialPtr& ma, const prtx::MaterialPtr& mb) { return materialsEqual(*ma, *mb); });
+}
+
+struct AutoInstanceGroup
+{
+	size_t hash;
+	uint64_t secondaryHash;
+	std::vector<int64_t> key;
+	SerializedGeometry localGeometry;
+	const prtx::EncodePreparator::FinalizedInstance* representative;
+	std::vector<const prtx::EncodePreparator::FinalizedInstance*> members;
+	std::vector<std::array<double, 16>> transformations;
+};
+
+// groups instances with identical geometry (under local space normalization) and identical materials
+std::vector<AutoInstanceGroup> groupRepeatedGeometry(const std::vector<const prtx::EncodePreparator::FinalizedInstance*>& candidates, bool sharedIndices,
+													 const OutputOptions& outputOptions)
+{
+	std::vector<AutoInstanceGroup> groups;
+	std::unordered_map<size_t, std::vector<size_t>> groupsByHash;
+	std::unordered_map<const prtx::Material*, size_t> materialHashes;
+
+	for (const auto* inst : candidates)
+	{
+		SerializedGeometry sg = serializeGeometry({inst->getGeometry()}, {inst->getMaterials()}, sharedIndices, {}, outputOptions);
+
+		LocalFrame frame;
+		if (sg.coords.empty() || !computeLocalFrame(sg, frame))
+			continue;
+
+		transformToLocal(sg, frame);
+		std::vector<int64_t> key = createGeometryKey(sg);
+
+		size_t hash = 0;
+		uint64_t secondaryHash = FNV_OFFSET_BASIS;
+		for (const int64_t k : key)
+		{
+			hashCombine(hash, std::hash<int64_t>()(k));
+			fnvCombine(secondaryHash, static_cast<uint64_t>(k));
+		}
+		for (const auto& mat : inst->getMaterials())
+		{
+			auto it = materialHashes.find(mat.get());
+			if (it == materialHashes.end())
+				it = materialHashes.emplace(mat.get(), hashMaterial(*mat)).first;
+			hashCombine(hash, it->second);
+			fnvCombine(secondaryHash, it->second);
+		}
+
+		auto& bucket = groupsByHash[hash];
+		auto groupIt = std::find_if(bucket.begin(), bucket.end(), [&groups, &key, inst](size_t gi) {
+			return groups[gi].key == key && materialsEqual(groups[gi].representative->getMaterials(), inst->getMaterials());
+		});
+		if (groupIt == bucket.end())
+		{
+			bucket.push_back(groups.size());
+			groups.push_back({hash, secondaryHash, std::move(key), std::move(sg), inst, {}, {}});
+			groupIt = std::prev(bucket.end());
+		}
+
+		AutoInstanceGroup& group = groups[*groupIt];
+		group.members.push_back(inst);
+		group.transformations.push_back(frame.toTransformation());
+	}
+
+	return groups;
+}
+
+size_t getVertexCount(const prtx::GeometryPtr& geometry)
+{
+	size_t vertexCount = 0;
+	for (const auto& mesh : geometry->getMeshes())
+		vertexCount += mesh->getVertexCoords().size() / 3;
+	return vertexCount;
+}
+
+// prototypes which are used rarely or whose instances have only few vertices in total are cheaper to bake into the merged mesh
+// than to build a separate mesh and instanced component for them
+struct InstancingThreshold
+{
+	size_t minInstanceCount;
+	size_t maxMergedVertexCount;
+
+	bool shouldMerge(size_t instanceCount, size_t vertexCount) const
+	{
+		return instanceCount < minInstanceCount || instanceCount * vertexCount <= maxMergedVertexCount;
+	}
+};
+
+// the mesh id is used as mesh cache key across generate calls, so it is derived from two independent 64 bit hashes of the full key
+std::wstring createAutoInstanceMeshId(const AutoInstanceGroup& group)
+{
+	std::wostringstream meshId;
+	meshId << L"autoInstance/" << std::hex << std::setfill(L'0') << std::setw(16) << static_cast<uint64_t>(group.hash) << std::setw(16)
+		   << group.secondaryHash << L"_" << std::dec << group.key.size();
+	return meshId.str();
+}
+
 const prtx::PRTUtils::AttributeMapPtr convertReportToAttributeMap(const prtx::ReportsPtr& r) {
 	prtx::PRTUtils::AttributeMapBuilderPtr amb(prt::AttributeMapBuilder::create());
 
@@ -605,7 +1108,8 @@ void UnrealGeometryEncoder::encode(prtx::GenerateContext& context, size_t initia
 	}
 
 	const bool emitAttrs = getOptions()->getBool(EO_EMIT_ATTRIBUTES);
-	if (emitAttrs) {
+	const bool emitReports = getOptions()->getBool(EO_EMIT_REPORTS);
+	if (emitAttrs && emitReports) {
 		prtx::ReportsAccumulatorPtr reportsAccumulator{prtx::SummarizingReportsAccumulator::create()};
 		prtx::ReportingStrategyPtr reportsCollector{prtx::AllShapesReportingStrategy::create(context, initialShapeIndex, reportsAccumulator)};
 
@@ -619,12 +1123,50 @@ void UnrealGeometryEncoder::encode(prtx::GenerateContext& context, size_t initia
 
 void UnrealGeometryEncoder::convertGeometry(const prtx::EncodePreparator::InstanceVector& instances, IUnrealCallbacks* cb)
 {
+	const bool sharedIndices = getOptions()->getBool(EO_TRIANGULATE_AND_SHARE_INDICES);
+	const int32_t autoInstancingMinCount = getOptions()->getInt(EO_AUTO_INSTANCING_MIN_COUNT);
+	const InstancingThreshold instancingThreshold = {static_cast<size_t>(std::max(getOptions()->getInt(EO_MIN_INSTANCE_COUNT), 1)),
+													 static_cast<size_t>(std::max(getOptions()->getInt(EO_MAX_MERGED_INSTANCE_VERTEX_COUNT), 0))};
+	const OutputOptions outputOptions = {getOptions()->getBool(EO_EMIT_MATERIALS), getOptions()->getBool(EO_EMIT_NORMALS),
+										 getOptions()->getInt(EO_MAX_UV_SETS)};
+
+	// count the instances of every prototype to decide which prototypes are baked into the merged mesh
+	std::unordered_map<int32_t, size_t> prototypeInstanceCounts;
+	for (const auto& inst : instances)
+	{
+		if (inst.getPrototypeIndex() != prtx::EncodePreparator::FinalizedInstance::NO_PROTOTYPE_INDEX)
+			prototypeInstanceCounts[inst.getPrototypeIndex()]++;
+	}
+
+	std::unordered_map<int32_t, bool> mergedPrototypes;
+	auto isMergedPrototype = [&](const prtx::EncodePreparator::FinalizedInstance& inst) {
+		auto it = mergedPrototypes.find(inst.getPrototypeIndex());
+		if (it == mergedPrototypes.end())
+		{
+			const bool merge = instancingThreshold.shouldMerge(prototypeInstanceCounts[inst.getPrototypeIndex()], getVertexCount(inst.getGeometry()));
+			it = mergedPrototypes.emplace(inst.getPrototypeIndex(), merge).first;
+		}
+		return it->second;
+	};
+
 	prtx::GeometryPtrVector geometries;
 	std::vector<prtx::MaterialPtrVector> materials;
+	std::vector<const double*> transformations;
+	std::vector<const prtx::EncodePreparator::FinalizedInstance*> autoInstancingCandidates;
+	int32_t maxPrototypeIndex = prtx::EncodePreparator::FinalizedInstance::NO_PROTOTYPE_INDEX;
 	prtx::PRTUtils::AttributeMapBuilderPtr instanceMatAmb(prt::AttributeMapBuilder::create());
 	for (const auto& inst : instances)
 	{
-		if (inst.getPrototypeIndex() != prtx::EncodePreparator::FinalizedInstance::NO_PROTOTYPE_INDEX)
+		maxPrototypeIndex = std::max(maxPrototypeIndex, inst.getPrototypeIndex());
+
+		if (inst.getPrototypeIndex() != prtx::EncodePreparator::FinalizedInstance::NO_PROTOTYPE_INDEX && isMergedPrototype(inst))
+		{
+			// bake the instance (including its materials) into the merged mesh
+			geometries.push_back(inst.getGeometry());
+			materials.push_back(inst.getMaterials());
+			transformations.push_back(inst.getTransformation().data());
+		}
+		else if (inst.getPrototypeIndex() != prtx::EncodePreparator::FinalizedInstance::NO_PROTOTYPE_INDEX)
 		{
 			const prtx::MaterialPtrVector& instMaterials = inst.getMaterials();
 			const prtx::GeometryPtr& instGeom = inst.getGeometry();
@@ -636,13 +1178,14 @@ void UnrealGeometryEncoder::convertGeometry(const prtx::EncodePreparator::Instan
 			if (serializedPrototypes.find(identifier.meshId) == serializedPrototypes.end())
 			{
 				const std::wstring uri = instGeom->getURI()->wstring();
-				const SerializedGeometry sg = serializeGeometry({instGeom}, {instMaterials});
-				encodeMesh(cb, sg, identifier.name.c_str(), identifier.meshId.c_str(), inst.getPrototypeIndex(), uri, {instGeom}, {instMaterials});
+				const SerializedGeometry sg = serializeGeometry({instGeom}, {instMaterials}, sharedIndices, {}, outputOptions);
+				encodeMesh(cb, sg, identifier.name.c_str(), identifier.meshId.c_str(), inst.getPrototypeIndex(), uri, {instGeom}, {instMaterials},
+						   outputOptions.emitMaterials);
 				serializedPrototypes.insert(identifier.meshId);
 			}
 
 			const prtx::MeshPtrVector& meshes = instGeom->getMeshes();
-			for (size_t mi = 0; mi < meshes.size(); mi++)
+			for (size_t mi = 0; outputOptions.emitMaterials && mi < meshes.size(); mi++)
 			{
 				const prtx::MaterialPtr& mat = instMaterials[mi];
 
@@ -653,17 +1196,60 @@ void UnrealGeometryEncoder::convertGeometry(const prtx::EncodePreparator::Instan
 			cb->addInstance(inst.getPrototypeIndex(), identifier.meshId.c_str(), inst.getTransformation().data(), instMaterialsAttributeMap.v.data(),
 							instMaterialsAttributeMap.v.size());
 		}
+		else if (autoInstancingMinCount > 0)
+		{
+			autoInstancingCandidates.push_back(&inst);
+		}
 		else
 		{
 			geometries.push_back(inst.getGeometry());
 			materials.push_back(inst.getMaterials());
+			transformations.push_back(nullptr);
+		}
+	}
+
+	if (!autoInstancingCandidates.empty())
+	{
+		// emit repeated geometry as prototypes in local space plus the transformations of all occurrences
+		int32_t nextPrototypeIndex = maxPrototypeIndex + 1;
+		std::set<const prtx::EncodePreparator::FinalizedInstance*> autoInstanced;
+		for (const AutoInstanceGroup& group : groupRepeatedGeometry(autoInstancingCandidates, sharedIndices, outputOptions))
+		{
+			if (group.members.size() < static_cast<size_t>(autoInstancingMinCount) ||
+				instancingThreshold.shouldMerge(group.members.size(), group.localGeometry.coords.size() / 3))
+				continue;
+
+			const int32_t prototypeIndex = nextPrototypeIndex++;
+			const std::wstring meshId = createAutoInstanceMeshId(group);
+			const InstanceIdentifier identifier = createInstanceIdentifier(*group.representative);
+			encodeMesh(cb, group.localGeometry, identifier.name.c_str(), meshId.c_str(), prototypeIndex, L"", {group.representative->getGeometry()},
+					   {group.representative->getMaterials()}, outputOptions.emitMaterials);
+
+			for (const auto& transformation : group.transformations)
+				cb->addInstance(prototypeIndex, meshId.c_str(), transformation.data(), nullptr, 0);
+
+			autoInstanced.insert(group.members.begin(), group.members.end());
+		}
+
+		if (DBG)
+			log_debug(L"auto instanced %1% of %2% shapes") % autoInstanced.size() % autoInstancingCandidates.size();
+
+		for (const auto* inst : autoInstancingCandidates)
+		{
+			if (autoInstanced.count(inst) == 0)
+			{
+				geometries.push_back(inst->getGeometry());
+				materials.push_back(inst->getMaterials());
+				transformations.push_back(nullptr);
+			}
 		}
 	}
 
 	if (geometries.size() > 0)
 	{
-		const SerializedGeometry sg = serializeGeometry(geometries, materials);
-		encodeMesh(cb, sg, L"", L"", prtx::EncodePreparator::FinalizedInstance::NO_PROTOTYPE_INDEX, L"", geometries, materials);
+		const SerializedGeometry sg = serializeGeometry(geometries, materials, sharedIndices, transformations, outputOptions);
+		encodeMesh(cb, sg, L"", L"", prtx::EncodePreparator::FinalizedInstance::NO_PROTOTYPE_INDEX, L"", geometries, materials,
+				   outputOptions.emitMaterials);
 	}
 
 	if (DBG)
@@ -674,17 +1260,27 @@ void UnrealGeometryEncoder::finish(prtx::GenerateContext& /*context*/)
 {
 	IUnrealCallbacks* cb = static_cast<IUnrealCallbacks*>(getCallbacks());
 
+	// Optionally let PRT triangulate and weld the meshes so that a single index buffer is shared by all vertex attributes
+	const bool sharedIndices = getOptions()->getBool(EO_TRIANGULATE_AND_SHARE_INDICES);
+	const auto indexSharing = sharedIndices ? prtx::EncodePreparator::PreparationFlags::INDICES_SAME_FOR_ALL_VERTEX_ATTRIBUTES
+											: prtx::EncodePreparator::PreparationFlags::INDICES_SEPARATE_FOR_ALL_VERTEX_ATTRIBUTES;
+
+	// Skip preparing vertex attributes which are not emitted anyway
+	const bool emitNormals = getOptions()->getBool(EO_EMIT_NORMALS);
+	const bool emitUVs = getOptions()->getInt(EO_MAX_UV_SETS) != 0;
+	const auto normalProcessor = emitNormals ? prtx::VertexNormalProcessor::SET_MISSING_TO_FACE_NORMALS : prtx::VertexNormalProcessor::PASS;
+
 	const prtx::EncodePreparator::PreparationFlags PREP_FLAGS =
 		prtx::EncodePreparator::PreparationFlags()
 			.instancing(true)
 			.meshMerging(prtx::MeshMerging::ALL_OF_SAME_MATERIAL_AND_TYPE)
-			.triangulate(false)
+			.triangulate(sharedIndices)
 			.processHoles(prtx::HoleProcessor::TRIANGULATE_FACES_WITH_HOLES)
 			.mergeVertices(true)
-			.cleanupVertexNormals(true)
-			.cleanupUVs(true)
-			.processVertexNormals(prtx::VertexNormalProcessor::SET_MISSING_TO_FACE_NORMALS)
-			.indexSharing(prtx::EncodePreparator::PreparationFlags::INDICES_SEPARATE_FOR_ALL_VERTEX_ATTRIBUTES);
+			.cleanupVertexNormals(emitNormals)
+			.cleanupUVs(emitUVs)
+			.processVertexNormals(normalProcessor)
+			.indexSharing(indexSharing);
 	
 	prtx::EncodePreparator::InstanceVector instances;
 	mEncPrep->fetchFinalizedInstances(instances, PREP_FLAGS);
@@ -706,6 +1302,13 @@ UnrealGeometryEncoderFactory* UnrealGeometryEncoderFactory::createInstance()
 	prtx::PRTUtils::AttributeMapBuilderPtr amb(prt::AttributeMapBuilder::create());
 	amb->setBool(EO_EMIT_ATTRIBUTES, true);
 	amb->setBool(EO_EMIT_MATERIALS, true);
+	amb->setBool(EO_EMIT_REPORTS, true);
+	amb->setBool(EO_EMIT_NORMALS, true);
+	amb->setInt(EO_MAX_UV_SETS, -1);
+	amb->setBool(EO_TRIANGULATE_AND_SHARE_INDICES, false);
+	amb->setInt(EO_AUTO_INSTANCING_MIN_COUNT, 0);
+	amb->setInt(EO_MIN_INSTANCE_COUNT, 1);
+	amb->setInt(EO_MAX_MERGED_INSTANCE_VERTEX_COUNT, 0);
 	encoderInfoBuilder.setDefaultOptions(amb->createAttributeMap());
 
 	return new UnrealGeometryEncoderFactory(encoderInfoBuilder.create());
@@ -43,6 +43,12 @@ public:
 	 * @param faceRanges ranges for materials and reports
 	 * @param materials contains faceRangesSize-1 attribute maps (all materials must have an identical set of keys and
 	 * types)
+	 *
+	 * If the encoder option "triangulateAndShareIndices" is set, all faces are triangles and normalIndices as well as
+	 * all non-empty uvIndices are identical to vertexIndices (one vertex per unique position/normal/uv tuple).
+	 *
+	 * The encoder options "emitNormals", "emitMaterials" and "maxUVSets" restrict the emitted data: without normals nrm and
+	 * normalIndices are empty, without materials the materials array is nullptr and at most maxUVSets uv sets are passed.
 	 */
 	// clang-format off
 	virtual void addMesh(const wchar_t* name, const wchar_t* meshId,
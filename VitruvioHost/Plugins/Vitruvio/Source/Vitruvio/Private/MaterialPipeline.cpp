@@ -0,0 +1,270 @@
+/* Copyright 2024 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MaterialPipeline.h"
+
+#include "MaterialConversion.h"
+#include "TextureCache.h"
+
+#include "Components/MeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/Package.h"
+
+TAutoConsoleVariable<float> CVarMaterialFrameBudget(TEXT("Esri.Vitruvio.MaterialFrameBudget"), 2.0f,
+	TEXT("The time in ms per frame which can be spent on creating generated materials. At least one material is created per frame (0 for no budget)."));
+
+namespace
+{
+bool AreTexturesLoaded(const TMap<FString, TSharedFuture<Vitruvio::FTextureData>>& Textures)
+{
+	for (const auto& [Key, Texture] : Textures)
+	{
+		if (!Texture.IsReady())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+} // namespace
+
+UMaterialInstanceDynamic* FMaterialPipeline::GameThread_RequestMaterial(UObject* Outer, const FString& Name, UMaterialInterface* OpaqueParent,
+																		UMaterialInterface* MaskedParent, UMaterialInterface* TranslucentParent,
+																		const Vitruvio::FMaterialAttributeContainer& MaterialAttributes,
+																		FTextureCache& TextureCache, bool& bOutCacheable)
+{
+	check(IsInGameThread());
+
+	bOutCacheable = true;
+
+	TMap<FString, TSharedFuture<Vitruvio::FTextureData>> Textures =
+		Vitruvio::GameThread_LoadTexturesAsync(Outer, MaterialAttributes, TextureCache, PendingTextures);
+
+	if (AreTexturesLoaded(Textures) && ConsumeFrameBudget())
+	{
+		return CreateMaterial(Outer, Name, OpaqueParent, MaskedParent, TranslucentParent, MaterialAttributes, Textures, TextureCache,
+							  bOutCacheable);
+	}
+
+	UMaterialInstanceDynamic* Placeholder = Vitruvio::GameThread_CreatePlaceholderMaterialInstance(Name, OpaqueParent, MaskedParent, TranslucentParent,
+																								   MaterialAttributes);
+	PlaceholderSlots.Add(FObjectKey(Placeholder));
+	PendingMaterials.Add({MaterialAttributes, Name, Outer, OpaqueParent, MaskedParent, TranslucentParent, Placeholder, MoveTemp(Textures)});
+	return Placeholder;
+}
+
+void FMaterialPipeline::GameThread_Tick(TMap<Vitruvio::FMaterialAttributeContainer, TWeakObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
+										FTextureCache& TextureCache, const TSet<TObjectPtr<UStaticMesh>>& Meshes)
+{
+	check(IsInGameThread());
+
+	if (PendingMaterials.IsEmpty())
+	{
+		return;
+	}
+
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_MaterialPipeline_Tick);
+
+	TMap<UMaterialInterface*, UMaterialInterface*> Replacements;
+	for (int32 PendingIndex = 0; PendingIndex < PendingMaterials.Num();)
+	{
+		FPendingMaterial& Pending = PendingMaterials[PendingIndex];
+		if (!AreTexturesLoaded(Pending.Textures))
+		{
+			++PendingIndex;
+			continue;
+		}
+
+		if (!ConsumeFrameBudget())
+		{
+			break;
+		}
+
+		UObject* Outer = Pending.Outer.IsValid() ? Pending.Outer.Get() : GetTransientPackage();
+		bool bTexturesRead;
+		UMaterialInstanceDynamic* Material = CreateMaterial(Outer, Pending.Name, Pending.OpaqueParent, Pending.MaskedParent,
+															Pending.TranslucentParent, Pending.MaterialAttributes, Pending.Textures, TextureCache,
+															bTexturesRead);
+
+		if (TWeakObjectPtr<UMaterialInstanceDynamic>* CachedMaterial = MaterialCache.Find(Pending.MaterialAttributes);
+			CachedMaterial && CachedMaterial->Get() == Pending.Placeholder)
+		{
+			// A material instance with missing textures would otherwise be reused by every later request with the same attributes
+			if (bTexturesRead)
+			{
+				*CachedMaterial = Material;
+			}
+			else
+			{
+				MaterialCache.Remove(Pending.MaterialAttributes);
+			}
+		}
+
+		Replacements.Add(Pending.Placeholder, Material);
+
+		PendingMaterials.RemoveAt(PendingIndex);
+	}
+
+	if (!Replacements.IsEmpty())
+	{
+		ReplacePlaceholders(Replacements, Meshes);
+	}
+}
+
+void FMaterialPipeline::GameThread_TrackComponent(UMeshComponent* Component)
+{
+	check(IsInGameThread());
+
+	if (!Component || PlaceholderSlots.IsEmpty())
+	{
+		return;
+	}
+
+	for (int32 MaterialIndex = 0; MaterialIndex < Component->GetNumMaterials(); ++MaterialIndex)
+	{
+		if (TArray<FMaterialSlot>* Slots = PlaceholderSlots.Find(FObjectKey(Component->GetMaterial(MaterialIndex))))
+		{
+			Slots->Add({Component, MaterialIndex});
+		}
+	}
+}
+
+void FMaterialPipeline::ReplacePlaceholders(const TMap<UMaterialInterface*, UMaterialInterface*>& Replacements,
+											const TSet<TObjectPtr<UStaticMesh>>& Meshes)
+{
+	for (UStaticMesh* StaticMesh : Meshes)
+	{
+		if (!StaticMesh)
+		{
+			continue;
+		}
+
+		for (FStaticMaterial& StaticMaterial : StaticMesh->GetStaticMaterials())
+		{
+			if (UMaterialInterface* const* Replacement = Replacements.Find(StaticMaterial.MaterialInterface))
+			{
+				StaticMaterial.MaterialInterface = *Replacement;
+			}
+		}
+	}
+
+	// Only the components which have been tracked while using a placeholder need to update their materials or render state
+	for (const auto& [Placeholder, Material] : Replacements)
+	{
+		TArray<FMaterialSlot> Slots;
+		if (!PlaceholderSlots.RemoveAndCopyValue(FObjectKey(Placeholder), Slots))
+		{
+			continue;
+		}
+
+		for (const FMaterialSlot& Slot : Slots)
+		{
+			UMeshComponent* Component = Slot.Component.Get();
+			if (!Component)
+			{
+				continue;
+			}
+
+			if (Component->OverrideMaterials.IsValidIndex(Slot.MaterialIndex) && Component->OverrideMaterials[Slot.MaterialIndex] == Placeholder)
+			{
+				Component->SetMaterial(Slot.MaterialIndex, Material);
+			}
+			else if (Component->GetMaterial(Slot.MaterialIndex) == Material && Component->IsRegistered())
+			{
+				Component->MarkRenderStateDirty();
+			}
+		}
+	}
+
+	OnPlaceholdersReplaced.Broadcast(Replacements);
+}
+
+void FMaterialPipeline::AddReferencedObjects(FReferenceCollector& Collector)
+{
+	for (FPendingMaterial& Pending : PendingMaterials)
+	{
+		Collector.AddReferencedObject(Pending.OpaqueParent);
+		Collector.AddReferencedObject(Pending.MaskedParent);
+		Collector.AddReferencedObject(Pending.TranslucentParent);
+		Collector.AddReferencedObject(Pending.Placeholder);
+	}
+}
+
+bool FMaterialPipeline::ConsumeFrameBudget()
+{
+	// The first material of every frame is always created, so that pending materials make progress with any budget
+	if (BudgetFrameCounter != GFrameCounter)
+	{
+		BudgetFrameCounter = GFrameCounter;
+
+		const float Budget = CVarMaterialFrameBudget.GetValueOnGameThread();
+		BudgetEndTime = Budget > 0.0f ? FPlatformTime::Seconds() + Budget / 1000.0 : TNumericLimits<double>::Max();
+		return true;
+	}
+
+	return FPlatformTime::Seconds() < BudgetEndTime;
+}
+
+UMaterialInstanceDynamic* FMaterialPipeline::CreateMaterial(UObject* Outer, const FString& Name, UMaterialInterface* OpaqueParent,
+															 UMaterialInterface* MaskedParent, UMaterialInterface* TranslucentParent,
+															 const Vitruvio::FMaterialAttributeContainer& MaterialAttributes,
+															 const TMap<FString, TSharedFuture<Vitruvio::FTextureData>>& Textures,
+															 FTextureCache& TextureCache, bool& bOutTexturesRead)
+{
+	bOutTexturesRead = true;
+
+	TMap<FString, Vitruvio::FTextureData> LoadedTextures;
+	for (const auto& [Key, Texture] : Textures)
+	{
+		Vitruvio::FTextureData TextureData = Texture.Get();
+		const FString& TexturePath = MaterialAttributes.GetTextureProperties()[Key];
+
+		if (!TexturePath.IsEmpty() && !TextureData.Texture)
+		{
+			bOutTexturesRead = false;
+		}
+
+		if (PendingTextures.Remove(TexturePath) > 0 && TextureData.Texture)
+		{
+			// Loaded textures are rooted until they are added to the cache by the first material instance which uses them
+			TextureData.Texture->RemoveFromRoot();
+			TextureData = TextureCache.Add(TexturePath, TextureData);
+		}
+		else if (TextureData.Texture)
+		{
+			// The texture has already been added to the cache, which might have replaced it with a texture of identical content
+			TextureCache.FindByContentHash(TextureData.ContentHash, TextureData);
+		}
+
+		LoadedTextures.Add(Key, TextureData);
+	}
+
+	UMaterialInstanceDynamic* Material = Vitruvio::GameThread_CreateMaterialInstance(Outer, Name, OpaqueParent, MaskedParent, TranslucentParent,
+																					  MaterialAttributes, LoadedTextures);
+
+	for (const auto& [Key, TextureData] : LoadedTextures)
+	{
+		if (TextureData.Texture)
+		{
+			TextureCache.AddMaterialReference(TextureData.ContentHash, Material);
+		}
+	}
+
+	// Trimmed only once the textures of the material have been referenced, so that newly added textures are not evicted right away
+	TextureCache.TrimToBudget();
+
+	return Material;
+}
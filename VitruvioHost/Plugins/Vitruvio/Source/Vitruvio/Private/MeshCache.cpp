@@ -15,28 +15,205 @@
 
 #include "MeshCache.h"
 
+#include "HAL/IConsoleManager.h"
+#include "VitruvioModule.h"
+
+TAutoConsoleVariable<int32> CVarMeshCacheBudget(TEXT("Esri.Vitruvio.MeshCacheBudget"), 1024,
+	TEXT("The memory budget in MB of the instance mesh cache. Unused meshes are evicted if the budget is exceeded (0 for no budget)."));
+
+namespace
+{
+FAutoConsoleCommand MeshCacheStatsCommand(TEXT("Esri.Vitruvio.MeshCacheStats"), TEXT("Prints the statistics of the instance mesh cache."),
+										  FConsoleCommandDelegate::CreateLambda([]() {
+											  const FMeshCacheStats Stats = VitruvioModule::Get().GetMeshCache().GetStats();
+											  UE_LOG(LogUnrealPrt, Display,
+													 TEXT("Mesh cache: %d entries, %.2f MB, %lld hits, %lld misses, %lld evictions"),
+													 Stats.NumEntries, Stats.SizeBytes / (1024.0 * 1024.0), Stats.Hits, Stats.Misses,
+													 Stats.Evictions);
+										  }));
+
+// Meshes of results which have not been built yet are only referenced by the results, built meshes only by the components using them
+bool IsEvictable(const TSharedPtr<FVitruvioMesh>& Mesh)
+{
+	return Mesh.GetSharedReferenceCount() == 1 && !Mesh->IsInUse();
+}
+} // namespace
+
+FMeshCache::FShard& FMeshCache::GetShard(const FString& Id)
+{
+	return Shards[GetTypeHash(Id) % NumShards];
+}
+
 TSharedPtr<FVitruvioMesh> FMeshCache::Get(const FString& Id)
 {
-	FScopeLock Lock(&MeshCacheCriticalSection);
-	const auto Result = Cache.Find(Id);
+	FShard& Shard = GetShard(Id);
+	FReadScopeLock Lock(Shard.Lock);
 
-	return Result ? *Result : TSharedPtr<FVitruvioMesh>{};
+	FEntry* Result = Shard.Entries.Find(Id);
+	if (!Result)
+	{
+		++Misses;
+		return {};
+	}
+
+	++Hits;
+	// Entries are only moved while holding the write lock, so updating the access time atomically is sufficient under the read lock
+	FPlatformAtomics::InterlockedExchange(&Result->LastAccess, ++AccessCounter);
+	return Result->Mesh;
 }
 
 TSharedPtr<FVitruvioMesh> FMeshCache::InsertOrGet(const FString& Id, const TSharedPtr<FVitruvioMesh>& Mesh)
 {
-	FScopeLock Lock(&MeshCacheCriticalSection);
-	const auto Result = Cache.Find(Id);
-	if (Result)
+	// Estimate the size before taking the lock since it locks the mesh
+	const int64 MeshSize = Mesh ? static_cast<int64>(Mesh->GetAllocatedSize()) : 0;
+	{
+		FShard& Shard = GetShard(Id);
+		FWriteScopeLock Lock(Shard.Lock);
+
+		if (FEntry* Result = Shard.Entries.Find(Id))
+		{
+			Result->LastAccess = ++AccessCounter;
+			return Result->Mesh;
+		}
+
+		FEntry& Entry = Shard.Entries.Add(Id);
+		Entry.Mesh = Mesh;
+		Entry.SizeBytes = MeshSize;
+		Entry.LastAccess = ++AccessCounter;
+		SizeBytes += MeshSize;
+	}
+
+	// The size changes once the mesh has been built, which is only known on the game thread
+	if (Mesh && !Mesh->GetStaticMesh())
 	{
-		return *Result;
+		FScopeLock Lock(&UnbuiltLock);
+		UnbuiltIds.Add(Id);
 	}
-	Cache.Add(Id, Mesh);
+
 	return Mesh;
 }
 
+void FMeshCache::GameThread_Tick()
+{
+	check(IsInGameThread());
+
+	TArray<FString> BuiltIds;
+	{
+		FScopeLock Lock(&UnbuiltLock);
+		for (int32 Index = UnbuiltIds.Num() - 1; Index >= 0; --Index)
+		{
+			FShard& Shard = GetShard(UnbuiltIds[Index]);
+			FReadScopeLock ShardLock(Shard.Lock);
+
+			const FEntry* Entry = Shard.Entries.Find(UnbuiltIds[Index]);
+			if (!Entry || Entry->Mesh->GetStaticMesh())
+			{
+				if (Entry)
+				{
+					BuiltIds.Add(UnbuiltIds[Index]);
+				}
+				UnbuiltIds.RemoveAtSwap(Index);
+			}
+		}
+	}
+
+	for (const FString& Id : BuiltIds)
+	{
+		FShard& Shard = GetShard(Id);
+		FWriteScopeLock Lock(Shard.Lock);
+
+		if (FEntry* Entry = Shard.Entries.Find(Id))
+		{
+			const int64 MeshSize = static_cast<int64>(Entry->Mesh->GetAllocatedSize());
+			SizeBytes += MeshSize - Entry->SizeBytes;
+			Entry->SizeBytes = MeshSize;
+		}
+	}
+
+	const int64 BudgetBytes = static_cast<int64>(CVarMeshCacheBudget.GetValueOnGameThread()) * 1024 * 1024;
+	if (BudgetBytes > 0 && SizeBytes > BudgetBytes)
+	{
+		Trim(BudgetBytes);
+	}
+}
+
+void FMeshCache::Trim(int64 BudgetBytes)
+{
+	// Whether a mesh is in use is only known on the game thread since it depends on the components it has been assigned to
+	check(IsInGameThread());
+
+	struct FEvictionCandidate
+	{
+		int32 ShardIndex;
+		FString Id;
+		int64 LastAccess;
+	};
+
+	TArray<FEvictionCandidate> Candidates;
+	for (int32 ShardIndex = 0; ShardIndex < NumShards; ++ShardIndex)
+	{
+		FReadScopeLock Lock(Shards[ShardIndex].Lock);
+		for (const auto& [Id, Entry] : Shards[ShardIndex].Entries)
+		{
+			if (IsEvictable(Entry.Mesh))
+			{
+				Candidates.Add({ShardIndex, Id, Entry.LastAccess});
+			}
+		}
+	}
+
+	Candidates.Sort([](const FEvictionCandidate& A, const FEvictionCandidate& B) { return A.LastAccess < B.LastAccess; });
+
+	// Evicted meshes are destroyed after the locks have been released
+	TArray<TSharedPtr<FVitruvioMesh>> EvictedMeshes;
+	for (const FEvictionCandidate& Candidate : Candidates)
+	{
+		if (SizeBytes <= BudgetBytes)
+		{
+			break;
+		}
+
+		FShard& Shard = Shards[Candidate.ShardIndex];
+		FWriteScopeLock Lock(Shard.Lock);
+
+		// The entry might have been requested again in the meantime
+		const FEntry* Entry = Shard.Entries.Find(Candidate.Id);
+		if (!Entry || Entry->LastAccess != Candidate.LastAccess || !IsEvictable(Entry->Mesh))
+		{
+			continue;
+		}
+
+		SizeBytes -= Entry->SizeBytes;
+		EvictedMeshes.Add(Entry->Mesh);
+		Shard.Entries.Remove(Candidate.Id);
+		++Evictions;
+	}
+}
+
+FMeshCacheStats FMeshCache::GetStats() const
+{
+	FMeshCacheStats Stats;
+	for (const FShard& Shard : Shards)
+	{
+		FReadScopeLock Lock(Shard.Lock);
+		Stats.NumEntries += Shard.Entries.Num();
+	}
+	Stats.SizeBytes = SizeBytes;
+	Stats.Hits = Hits;
+	Stats.Misses = Misses;
+	Stats.Evictions = Evictions;
+	return Stats;
+}
+
 void FMeshCache::Empty()
 {
-	FScopeLock Lock(&MeshCacheCriticalSection);
-	Cache.Empty();
+	for (FShard& Shard : Shards)
+	{
+		FWriteScopeLock Lock(Shard.Lock);
+		for (const auto& [Id, Entry] : Shard.Entries)
+		{
+			SizeBytes -= Entry.SizeBytes;
+		}
+		Shard.Entries.Empty();
+	}
 }
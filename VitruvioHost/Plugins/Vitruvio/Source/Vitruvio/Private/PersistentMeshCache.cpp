@@ -0,0 +1,238 @@
+/* Copyright 2024 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PersistentMeshCache.h"
+
+#include "VitruvioModule.h"
+
+#include "Async/Async.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Hash/xxhash.h"
+#include "Misc/EngineVersion.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Guid.h"
+#include "Misc/Paths.h"
+#include "Serialization/CustomVersion.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+#include <atomic>
+
+TAutoConsoleVariable<bool> CVarPersistentMeshCache(TEXT("Esri.Vitruvio.PersistentMeshCache"), true,
+	TEXT("Whether converted instance meshes are cached on disk (in Saved/Vitruvio/MeshCache) and reused across sessions."));
+
+TAutoConsoleVariable<int32> CVarPersistentMeshCacheBudget(TEXT("Esri.Vitruvio.PersistentMeshCacheBudget"), 2048,
+	TEXT("The disk budget in MB of the persistent mesh cache. The least recently used entries are deleted if the budget is exceeded (0 for no budget)."));
+
+namespace
+{
+// Increment whenever the conversion of inserted assets changes, so that outdated cache entries are not used anymore
+constexpr uint32 ConverterVersion = 2;
+constexpr uint32 CacheFileMagic = 0x56434D31;
+
+// Rule packages are extracted to a different folder every session, so uris into the rule package are stored relative to it
+const FString RpkUriToken = TEXT("{rpk}");
+
+// Only one background task at a time trims the cache, further requests in the meantime are skipped
+std::atomic<bool> bTrimming = false;
+
+FString GetCacheDirectory()
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Vitruvio"), TEXT("MeshCache"));
+}
+
+FString GetCacheFilePath(const FString& Key)
+{
+	const FString FileName = FString::Printf(TEXT("%016llx.vmesh"), FXxHash64::HashBuffer(*Key, Key.Len() * sizeof(TCHAR)).Hash);
+	return FPaths::Combine(GetCacheDirectory(), FileName.Left(2), FileName);
+}
+
+void ReplaceInTextureUris(TArray<Vitruvio::FMaterialAttributeContainer>& Materials, const FString& From, const FString& To)
+{
+	for (Vitruvio::FMaterialAttributeContainer& Material : Materials)
+	{
+		Vitruvio::FMaterialAttributes Attributes = Material.CopyAttributes();
+		for (auto& [Key, TextureUri] : Attributes.TextureProperties)
+		{
+			TextureUri.ReplaceInline(*From, *To, ESearchCase::CaseSensitive);
+		}
+		Material = Vitruvio::FMaterialAttributeContainer(MoveTemp(Attributes), Material.Name);
+	}
+}
+
+} // namespace
+
+bool FPersistentMeshCache::IsEnabled()
+{
+	return CVarPersistentMeshCache.GetValueOnAnyThread();
+}
+
+bool FPersistentMeshCache::MakeKey(const VitruvioModule& Module, const FString& AssetUri, const FString& Identifier, const FString& Variant,
+								   FString& OutKey, FString& OutRpkUri)
+{
+	FString ContentHash;
+	if (AssetUri.IsEmpty() || !Module.FindRulePackageContentHash(AssetUri, OutRpkUri, ContentHash))
+	{
+		return false;
+	}
+
+	const FString AssetPath = AssetUri.Mid(OutRpkUri.Len());
+	const FString RelativeIdentifier = Identifier.Replace(*OutRpkUri, *RpkUriToken, ESearchCase::CaseSensitive);
+
+	OutKey = FString::Printf(TEXT("%u|%s|%s|%s|%s|%s"), ConverterVersion, *FEngineVersion::Current().ToString(), *ContentHash, *AssetPath,
+							 *RelativeIdentifier, *Variant);
+	return true;
+}
+
+bool FPersistentMeshCache::Load(const FString& Key, const FString& RpkUri, FMeshDescription& OutMeshDescription,
+								TArray<Vitruvio::FMaterialAttributeContainer>& OutMaterials)
+{
+	TArray<uint8> FileData;
+	if (!FFileHelper::LoadFileToArray(FileData, *GetCacheFilePath(Key), FILEREAD_Silent))
+	{
+		return false;
+	}
+
+	FMemoryReader FileReader(FileData);
+
+	uint32 Magic = 0;
+	FileReader << Magic;
+	if (Magic != CacheFileMagic)
+	{
+		return false;
+	}
+
+	// The file name is only a hash of the key, so the full key is compared to rule out collisions
+	FString StoredKey;
+	uint64 PayloadHash = 0;
+	TArray<uint8> Payload;
+	FileReader << StoredKey << PayloadHash << Payload;
+	if (FileReader.IsError() || StoredKey != Key || FXxHash64::HashBuffer(Payload.GetData(), Payload.Num()).Hash != PayloadHash)
+	{
+		return false;
+	}
+
+	// The engine version is part of the key, so the payload has been written with the current custom versions
+	FMemoryReader PayloadReader(Payload);
+	PayloadReader.SetCustomVersions(FCurrentCustomVersions::GetAll());
+	PayloadReader << OutMeshDescription << OutMaterials;
+	if (PayloadReader.IsError())
+	{
+		return false;
+	}
+
+	ReplaceInTextureUris(OutMaterials, RpkUriToken, RpkUri);
+
+	// The time stamp of an entry records its last use, so that Trim deletes the least recently used entries first
+	IFileManager::Get().SetTimeStamp(*GetCacheFilePath(Key), FDateTime::UtcNow());
+	return true;
+}
+
+void FPersistentMeshCache::Store(const FString& Key, const FString& RpkUri, FMeshDescription& MeshDescription,
+								 const TArray<Vitruvio::FMaterialAttributeContainer>& Materials)
+{
+	TArray<Vitruvio::FMaterialAttributeContainer> RelativeMaterials = Materials;
+	ReplaceInTextureUris(RelativeMaterials, RpkUri, RpkUriToken);
+
+	TArray<uint8> Payload;
+	FMemoryWriter PayloadWriter(Payload);
+	PayloadWriter << MeshDescription << RelativeMaterials;
+
+	TArray<uint8> FileData;
+	FMemoryWriter FileWriter(FileData);
+	uint32 Magic = CacheFileMagic;
+	FString StoredKey = Key;
+	uint64 PayloadHash = FXxHash64::HashBuffer(Payload.GetData(), Payload.Num()).Hash;
+	FileWriter << Magic << StoredKey << PayloadHash << Payload;
+
+	// Write to a temporary file first, so that concurrent sessions never read partially written entries
+	const FString CacheFilePath = GetCacheFilePath(Key);
+	const FString TempFilePath = CacheFilePath + TEXT(".") + FGuid::NewGuid().ToString() + TEXT(".tmp");
+	if (FFileHelper::SaveArrayToFile(FileData, *TempFilePath) && !IFileManager::Get().Move(*CacheFilePath, *TempFilePath, true, true, false, true))
+	{
+		IFileManager::Get().Delete(*TempFilePath, false, false, true);
+	}
+}
+
+void FPersistentMeshCache::StoreAsync(TArray<FPendingEntry>&& Entries)
+{
+	if (Entries.IsEmpty())
+	{
+		return;
+	}
+
+	Async(EAsyncExecution::ThreadPool, [Entries = MoveTemp(Entries)]() mutable {
+		for (FPendingEntry& Entry : Entries)
+		{
+			Store(Entry.Key, Entry.RpkUri, Entry.MeshDescription, Entry.Materials);
+		}
+
+		const int64 BudgetBytes = static_cast<int64>(CVarPersistentMeshCacheBudget.GetValueOnAnyThread()) * 1024 * 1024;
+		if (BudgetBytes > 0)
+		{
+			Trim(BudgetBytes);
+		}
+	});
+}
+
+void FPersistentMeshCache::Trim(int64 BudgetBytes)
+{
+	if (bTrimming.exchange(true))
+	{
+		return;
+	}
+
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_PersistentMeshCache_Trim);
+
+	struct FCacheFile
+	{
+		FString Path;
+		int64 Size;
+		FDateTime TimeStamp;
+	};
+
+	TArray<FCacheFile> CacheFiles;
+	int64 SizeBytes = 0;
+	auto VisitCacheFile = [&CacheFiles, &SizeBytes](const TCHAR* Path, const FFileStatData& StatData) {
+		if (!StatData.bIsDirectory && FPaths::GetExtension(Path) == TEXT("vmesh"))
+		{
+			CacheFiles.Add({Path, StatData.FileSize, StatData.ModificationTime});
+			SizeBytes += StatData.FileSize;
+		}
+		return true;
+	};
+	IFileManager::Get().IterateDirectoryStatRecursively(*GetCacheDirectory(), VisitCacheFile);
+
+	if (SizeBytes > BudgetBytes)
+	{
+		CacheFiles.Sort([](const FCacheFile& A, const FCacheFile& B) { return A.TimeStamp < B.TimeStamp; });
+		for (const FCacheFile& CacheFile : CacheFiles)
+		{
+			if (SizeBytes <= BudgetBytes)
+			{
+				break;
+			}
+
+			// Entries which are used by a concurrent session can not be deleted and are kept
+			if (IFileManager::Get().Delete(*CacheFile.Path, false, false, true))
+			{
+				SizeBytes -= CacheFile.Size;
+			}
+		}
+	}
+
+	bTrimming = false;
+}
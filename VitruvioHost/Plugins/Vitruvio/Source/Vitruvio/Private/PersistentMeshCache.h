@@ -0,0 +1,85 @@
+/* Copyright 2024 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "MeshDescription.h"
+#include "VitruvioTypes.h"
+
+class VitruvioModule;
+
+/**
+ * Local on-disk cache of converted instance meshes. Inserted assets are static files inside rule packages, so their converted mesh
+ * descriptions can be reused across sessions. Entries are keyed by the content hash of the rule package, the path of the asset inside
+ * the rule package and the version of the conversion (see Esri.Vitruvio.PersistentMeshCache). If the cache exceeds its disk budget
+ * (see Esri.Vitruvio.PersistentMeshCacheBudget), the least recently used entries are deleted.
+ */
+class FPersistentMeshCache
+{
+public:
+	/** A converted mesh which has not been written to the cache yet. */
+	struct FPendingEntry
+	{
+		FString Key;
+		FString RpkUri;
+		FMeshDescription MeshDescription;
+		TArray<Vitruvio::FMaterialAttributeContainer> Materials;
+	};
+
+	static bool IsEnabled();
+
+	/**
+	 * \brief Creates the cache key of an inserted asset. Thread safe.
+	 *
+	 * \param Module the module which has loaded the rule package of the asset.
+	 * \param AssetUri the uri of the inserted asset.
+	 * \param Identifier the identifier of the mesh passed by the encoder.
+	 * \param Variant distinguishes conversions of the same asset with different options (eg. restricted encoder output profiles or fast
+	 * tangents).
+	 * \param OutKey the key of the asset.
+	 * \param OutRpkUri the part of the asset uri which identifies its rule package in this session.
+	 * \return false if the asset is not part of a loaded rule package and can therefore not be cached.
+	 */
+	static bool MakeKey(const VitruvioModule& Module, const FString& AssetUri, const FString& Identifier, const FString& Variant,
+						FString& OutKey, FString& OutRpkUri);
+
+	/**
+	 * \brief Loads a converted mesh from the cache. Thread safe.
+	 *
+	 * \return false if there is no valid cache entry for the key.
+	 */
+	static bool Load(const FString& Key, const FString& RpkUri, FMeshDescription& OutMeshDescription,
+					 TArray<Vitruvio::FMaterialAttributeContainer>& OutMaterials);
+
+	/**
+	 * \brief Stores a converted mesh in the cache. Thread safe.
+	 */
+	static void Store(const FString& Key, const FString& RpkUri, FMeshDescription& MeshDescription,
+					  const TArray<Vitruvio::FMaterialAttributeContainer>& Materials);
+
+	/**
+	 * \brief Stores the given converted meshes in the cache on a background thread, so that serializing and writing them does not delay
+	 * the conversion.
+	 */
+	static void StoreAsync(TArray<FPendingEntry>&& Entries);
+
+	/**
+	 * \brief Deletes the least recently used entries until the cache fits into the given budget. Thread safe, concurrent calls return
+	 * immediately.
+	 *
+	 * \param BudgetBytes the maximum size of all cache files in bytes.
+	 */
+	static void Trim(int64 BudgetBytes);
+};
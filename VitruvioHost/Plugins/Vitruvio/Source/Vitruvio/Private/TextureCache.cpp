@@ -0,0 +1,203 @@
+/* Copyright 2024 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TextureCache.h"
+
+#include "Engine/Texture2D.h"
+#include "HAL/IConsoleManager.h"
+#include "VitruvioModule.h"
+
+TAutoConsoleVariable<int32> CVarTextureCacheBudget(TEXT("Esri.Vitruvio.TextureCacheBudget"), 512,
+	TEXT("The memory budget in MB of the texture cache. Textures which are not used by any material are evicted if the budget is exceeded (0 for no budget)."));
+
+namespace
+{
+FAutoConsoleCommand TextureCacheStatsCommand(TEXT("Esri.Vitruvio.TextureCacheStats"), TEXT("Prints the statistics of the texture cache."),
+											 FConsoleCommandDelegate::CreateLambda([]() {
+												 const FTextureCacheStats Stats = VitruvioModule::Get().GetTextureCache().GetStats();
+												 UE_LOG(LogUnrealPrt, Display,
+														TEXT("Texture cache: %d uris, %d textures, %.2f MB, %lld hits, %lld misses, %lld evictions, "
+															 "%lld deduplications"),
+														Stats.NumUris, Stats.NumTextures, Stats.SizeBytes / (1024.0 * 1024.0), Stats.Hits, Stats.Misses,
+														Stats.Evictions, Stats.Deduplications);
+											 }));
+} // namespace
+
+const Vitruvio::FTextureData* FTextureCache::Find(const FString& Uri)
+{
+	check(IsInGameThread());
+
+	const uint64* ContentHash = UriContentHashes.Find(Uri);
+	FEntry* Entry = ContentHash ? Entries.Find(*ContentHash) : nullptr;
+	if (!Entry)
+	{
+		++Misses;
+		return nullptr;
+	}
+
+	++Hits;
+	Entry->LastAccess = ++AccessCounter;
+	return &Entry->TextureData;
+}
+
+Vitruvio::FTextureData FTextureCache::Add(const FString& Uri, const Vitruvio::FTextureData& TextureData)
+{
+	check(IsInGameThread());
+
+	Remove(Uri);
+	{
+		FWriteScopeLock Lock(EntriesLock);
+
+		FEntry* Entry = Entries.Find(TextureData.ContentHash);
+		if (Entry)
+		{
+			// The content is identical, so the cached texture is as valid as the newly decoded one
+			Entry->TextureData.Generation = FMath::Max(Entry->TextureData.Generation, TextureData.Generation);
+			if (!Entry->Uris.IsEmpty())
+			{
+				++Deduplications;
+			}
+		}
+		else
+		{
+			Entry = &Entries.Add(TextureData.ContentHash);
+			Entry->TextureData = TextureData;
+			Entry->SizeBytes = TextureData.Texture ? TextureData.Texture->CalcTextureMemorySizeEnum(TMC_AllMips) : 0;
+			SizeBytes += Entry->SizeBytes;
+		}
+
+		Entry->Uris.Add(Uri);
+		Entry->LastAccess = ++AccessCounter;
+		UriContentHashes.Add(Uri, TextureData.ContentHash);
+	}
+
+	return Entries[TextureData.ContentHash].TextureData;
+}
+
+void FTextureCache::Remove(const FString& Uri)
+{
+	check(IsInGameThread());
+
+	uint64 ContentHash;
+	if (!UriContentHashes.RemoveAndCopyValue(Uri, ContentHash))
+	{
+		return;
+	}
+
+	// The texture stays cached without uris until it is evicted, since other uris might still decode to the same content
+	FWriteScopeLock Lock(EntriesLock);
+	if (FEntry* Entry = Entries.Find(ContentHash))
+	{
+		Entry->Uris.Remove(Uri);
+	}
+}
+
+bool FTextureCache::FindByContentHash(uint64 ContentHash, Vitruvio::FTextureData& OutTextureData) const
+{
+	FReadScopeLock Lock(EntriesLock);
+
+	const FEntry* Entry = Entries.Find(ContentHash);
+	if (!Entry)
+	{
+		return false;
+	}
+
+	OutTextureData = Entry->TextureData;
+	return true;
+}
+
+void FTextureCache::AddMaterialReference(uint64 ContentHash, UMaterialInstanceDynamic* Material)
+{
+	check(IsInGameThread());
+
+	if (FEntry* Entry = Entries.Find(ContentHash))
+	{
+		Entry->Materials.RemoveAllSwap([](const TWeakObjectPtr<UMaterialInstanceDynamic>& Reference) { return !Reference.IsValid(); });
+		Entry->Materials.AddUnique(Material);
+	}
+}
+
+void FTextureCache::Trim(int64 BudgetBytes)
+{
+	check(IsInGameThread());
+
+	TArray<TPair<int64, uint64>> Candidates;
+	for (auto& [ContentHash, Entry] : Entries)
+	{
+		Entry.Materials.RemoveAllSwap([](const TWeakObjectPtr<UMaterialInstanceDynamic>& Reference) { return !Reference.IsValid(); });
+		if (Entry.Materials.IsEmpty())
+		{
+			Candidates.Emplace(Entry.LastAccess, ContentHash);
+		}
+	}
+
+	Candidates.Sort([](const TPair<int64, uint64>& A, const TPair<int64, uint64>& B) { return A.Key < B.Key; });
+
+	for (const TPair<int64, uint64>& Candidate : Candidates)
+	{
+		if (SizeBytes <= BudgetBytes)
+		{
+			break;
+		}
+
+		RemoveEntry(Candidate.Value);
+		++Evictions;
+	}
+}
+
+void FTextureCache::TrimToBudget()
+{
+	const int64 BudgetBytes = static_cast<int64>(CVarTextureCacheBudget.GetValueOnGameThread()) * 1024 * 1024;
+	if (BudgetBytes > 0 && SizeBytes > BudgetBytes)
+	{
+		Trim(BudgetBytes);
+	}
+}
+
+void FTextureCache::RemoveEntry(uint64 ContentHash)
+{
+	FWriteScopeLock Lock(EntriesLock);
+
+	FEntry Entry;
+	if (Entries.RemoveAndCopyValue(ContentHash, Entry))
+	{
+		for (const FString& Uri : Entry.Uris)
+		{
+			UriContentHashes.Remove(Uri);
+		}
+		SizeBytes -= Entry.SizeBytes;
+	}
+}
+
+FTextureCacheStats FTextureCache::GetStats() const
+{
+	FTextureCacheStats Stats;
+	Stats.NumUris = UriContentHashes.Num();
+	Stats.NumTextures = Entries.Num();
+	Stats.SizeBytes = SizeBytes;
+	Stats.Hits = Hits;
+	Stats.Misses = Misses;
+	Stats.Evictions = Evictions;
+	Stats.Deduplications = Deduplications;
+	return Stats;
+}
+
+void FTextureCache::AddReferencedObjects(FReferenceCollector& Collector)
+{
+	for (auto& [ContentHash, Entry] : Entries)
+	{
+		Collector.AddReferencedObject(Entry.TextureData.Texture);
+	}
+}
@@ -25,12 +25,22 @@
 #include "StaticMeshAttributes.h"
 #include "StaticMeshDescription.h"
 #include "StaticMeshOperations.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "PersistentMeshCache.h"
 #include "Util/AsyncHelpers.h"
 #include "VitruvioModule.h"
 #include "prtx/Mesh.h"
 
 DEFINE_LOG_CATEGORY(LogUnrealCallbacks);
 
+TAutoConsoleVariable<bool> CVarFastTangents(TEXT("Esri.Vitruvio.FastTangents"), false,
+	TEXT("Compute tangents of normal mapped meshes from their uvs instead of using MikkTSpace. Faster but less accurate, intended for previews."));
+
+TAutoConsoleVariable<bool> CVarCollapseColorVariants(TEXT("Esri.Vitruvio.CollapseColorVariants"), false,
+	TEXT("Merge the materials of generated models which only differ by their diffuse color into one material and store the colors in the vertex colors. ")
+	TEXT("Requires parent materials which multiply the diffuse color with the vertex color."));
+
 namespace
 {
 
@@ -103,137 +113,617 @@ TMap<FString, double> CreateAvailableUVSetMaterialParameterMap(uint32_t const* c
 	return AvailableUvSetAttributeMap;
 }
 
+// Flat lookup table from PRT uv sets to Unreal uv channels (INDEX_NONE for uv sets which are not supported)
+TArray<int32, TInlineAllocator<16>> CreateUVSetRemapTable(size_t UVSets)
+{
+	TArray<int32, TInlineAllocator<16>> UnrealUVSets;
+	UnrealUVSets.Init(INDEX_NONE, static_cast<int32>(UVSets));
+	for (size_t PrtUVSet = 0; PrtUVSet < UVSets; ++PrtUVSet)
+	{
+		if (const Vitruvio::EUnrealUvSetType* UnrealUVSetPtr = PRTToUnrealUVSetMap.Find(static_cast<Vitruvio::EPrtUvSetType>(PrtUVSet)))
+		{
+			UnrealUVSets[PrtUVSet] = static_cast<int32>(*UnrealUVSetPtr);
+		}
+	}
+	return UnrealUVSets;
+}
+
 FModelDescription ConvertMesh(const double* vtx, size_t vtxSize, const double* nrm, size_t nrmSize, const uint32_t* faceVertexCounts, size_t faceVertexCountsSize, const uint32_t* vertexIndices, size_t vertexIndicesSize, const uint32_t* normalIndices, size_t normalIndicesSize,
-	double const* const* uvs, uint32_t const* const* uvCounts, uint32_t const* const* uvIndices, size_t uvSets, const uint32_t* faceRanges, size_t faceRangesSize, const prt::AttributeMap** materials, const FVector3f& VertexOffset = FVector3f::ZeroVector)
+	double const* const* uvs, uint32_t const* const* uvCounts, uint32_t const* const* uvIndices, size_t uvSets, const uint32_t* faceRanges, size_t faceRangesSize, const TArray<Vitruvio::FMaterialAttributeContainer>& Materials, const FVector3f& VertexOffset = FVector3f::ZeroVector,
+	bool bCollapseColorVariants = false)
 {
 	FModelDescription ModelDescription;
-    FStaticMeshAttributes Attributes(ModelDescription.MeshDescription);
-    Attributes.Register();
+	FMeshDescription& MeshDescription = ModelDescription.MeshDescription;
+	FStaticMeshAttributes Attributes(MeshDescription);
+	Attributes.Register();
 
-    const auto VertexUVs = Attributes.GetVertexInstanceUVs();
-    VertexUVs.SetNumChannels(8);
-    		
-	// Convert vertices and vertex instances
-	const auto VertexPositions = Attributes.GetVertexPositions();
-	for (size_t VertexIndex = 0; VertexIndex < vtxSize; VertexIndex += 3)
+	const auto VertexUVs = Attributes.GetVertexInstanceUVs();
+	VertexUVs.SetNumChannels(8);
+
+	const TArray<int32, TInlineAllocator<16>> UnrealUVSets = CreateUVSetRemapTable(uvSets);
+	const TMap<FString, double> AvailableUvSetAttributeMap = CreateAvailableUVSetMaterialParameterMap(uvCounts, uvSets);
+
+	const int32 NumVertices = static_cast<int32>(vtxSize / 3);
+	MeshDescription.ReserveNewVertices(NumVertices);
+	MeshDescription.ReserveNewVertexInstances(static_cast<int32>(vertexIndicesSize));
+	MeshDescription.ReserveNewPolygons(static_cast<int32>(faceVertexCountsSize));
+	MeshDescription.ReserveNewPolygonGroups(static_cast<int32>(faceRangesSize));
+
+	// Convert vertices, the mesh description is empty so the vertex ids are equal to the vertex indices
+	for (int32 VertexIndex = 0; VertexIndex < NumVertices; ++VertexIndex)
 	{
-		const FVertexID VertexID = ModelDescription.MeshDescription.CreateVertex();
-		VertexPositions[VertexID] = FVector3f(vtx[VertexIndex], vtx[VertexIndex + 2], vtx[VertexIndex + 1]) * PRT_TO_UE_SCALE - VertexOffset;
+		MeshDescription.CreateVertex();
 	}
-	
-	size_t BaseVertexIndex = 0;
-	TArray<size_t> BaseUVIndex;
-	BaseUVIndex.Init(0, uvSets);
 
+	const TArrayView<FVector3f> VertexPositions = Attributes.GetVertexPositions().GetRawArray();
+	for (int32 VertexIndex = 0; VertexIndex < NumVertices; ++VertexIndex)
+	{
+		const double* Position = vtx + VertexIndex * 3;
+		VertexPositions[VertexIndex] = FVector3f(Position[0], Position[2], Position[1]) * PRT_TO_UE_SCALE - VertexOffset;
+	}
+
+	// Create vertex instances and polygons. Vertex instances are created in the order of the face vertices, so the vertex instance ids are
+	// equal to the face vertex indices and the attributes can be filled in bulk afterwards.
+	TArray<size_t> ConvertedFaces;
+	ConvertedFaces.Reserve(faceVertexCountsSize);
+
+	TArray<FVertexInstanceID, TInlineAllocator<8>> PolygonVertexInstances;
+	TArray<FVector4f> VertexInstanceColors;
+	size_t BaseVertexIndex = 0;
 	size_t PolygonGroupStartIndex = 0;
-	
+
 	for (size_t PolygonGroupIndex = 0; PolygonGroupIndex < faceRangesSize; ++PolygonGroupIndex)
 	{
 		const size_t PolygonFaceCount = faceRanges[PolygonGroupIndex];
 
-		Vitruvio::FMaterialAttributeContainer MaterialContainer(materials[PolygonGroupIndex]);
-		TMap<FString, double> AvailableUvSetAttributeMap = CreateAvailableUVSetMaterialParameterMap(uvCounts, uvSets);
-		for (auto& AvailableUvSetAttribute : AvailableUvSetAttributeMap)
+		Vitruvio::FMaterialAttributes MaterialAttributes = Materials[PolygonGroupIndex].CopyAttributes();
+		for (const auto& AvailableUvSetAttribute : AvailableUvSetAttributeMap)
+		{
+			MaterialAttributes.ScalarProperties.Add(AvailableUvSetAttribute);
+		}
+		Vitruvio::FMaterialAttributeContainer MaterialContainer(MoveTemp(MaterialAttributes), Materials[PolygonGroupIndex].Name);
+
+		// Color variants share one polygon group, their colors are stored in the vertex colors instead
+		FLinearColor VariantColor = FLinearColor::White;
+		if (bCollapseColorVariants)
 		{
-			MaterialContainer.ScalarProperties.Add(AvailableUvSetAttribute);
+			MaterialContainer = Vitruvio::SplitColorVariant(MaterialContainer, VariantColor);
 		}
 
 		FPolygonGroupID PolygonGroupId;
-		if (ModelDescription.MaterialToPolygonMap.Contains(MaterialContainer))
+		if (const FPolygonGroupID* ExistingPolygonGroupId = ModelDescription.MaterialToPolygonMap.Find(MaterialContainer))
 		{
-			PolygonGroupId = ModelDescription.MaterialToPolygonMap[MaterialContainer];
+			PolygonGroupId = *ExistingPolygonGroupId;
 		}
 		else
 		{
 			ModelDescription.Materials.Add(MaterialContainer);
-			PolygonGroupId = ModelDescription.MeshDescription.CreatePolygonGroup();
+			PolygonGroupId = MeshDescription.CreatePolygonGroup();
 			ModelDescription.MaterialToPolygonMap.Add(MaterialContainer, PolygonGroupId);
 		}
 
-		// Create Geometry
-		const auto Normals = Attributes.GetVertexInstanceNormals();
 		int PolygonFaces = 0;
 		for (size_t FaceIndex = 0; FaceIndex < PolygonFaceCount; ++FaceIndex)
 		{
 			check(PolygonGroupStartIndex + FaceIndex < faceVertexCountsSize);
 
 			const size_t FaceVertexCount = faceVertexCounts[PolygonGroupStartIndex + FaceIndex];
-			TArray<FVertexInstanceID> PolygonVertexInstances;
+			if (FaceVertexCount < 3)
+			{
+				continue;
+			}
+
+			check(BaseVertexIndex + FaceVertexCount <= vertexIndicesSize);
+
+			PolygonVertexInstances.Reset();
+			for (size_t FaceVertexIndex = 0; FaceVertexIndex < FaceVertexCount; ++FaceVertexIndex)
+			{
+				const uint32_t VertexIndex = vertexIndices[BaseVertexIndex + FaceVertexIndex];
+				PolygonVertexInstances.Add(MeshDescription.CreateVertexInstance(FVertexID(VertexIndex)));
+				if (bCollapseColorVariants)
+				{
+					VertexInstanceColors.Add(FVector4f(VariantColor));
+				}
+			}
+
+			MeshDescription.CreatePolygon(PolygonGroupId, PolygonVertexInstances);
+			ConvertedFaces.Add(PolygonGroupStartIndex + FaceIndex);
+			PolygonFaces++;
+			BaseVertexIndex += FaceVertexCount;
+		}
+
+		PolygonGroupStartIndex += PolygonFaces;
+	}
+
+	const size_t NumVertexInstances = BaseVertexIndex;
 
-			if (FaceVertexCount >= 3)
+	if (bCollapseColorVariants)
+	{
+		const TArrayView<FVector4f> Colors = Attributes.GetVertexInstanceColors().GetRawArray();
+		check(VertexInstanceColors.Num() == NumVertexInstances);
+		FMemory::Memcpy(Colors.GetData(), VertexInstanceColors.GetData(), NumVertexInstances * sizeof(FVector4f));
+	}
+
+	// Normals are omitted by the encoder for collision only output
+	if (normalIndicesSize > 0)
+	{
+		check(NumVertexInstances <= normalIndicesSize);
+
+		const TArrayView<FVector3f> Normals = Attributes.GetVertexInstanceNormals().GetRawArray();
+		for (size_t InstanceIndex = 0; InstanceIndex < NumVertexInstances; ++InstanceIndex)
+		{
+			const uint32_t NormalIndex = normalIndices[InstanceIndex] * 3;
+			check(NormalIndex + 2 < nrmSize);
+			Normals[InstanceIndex] = FVector3f(nrm[NormalIndex], nrm[NormalIndex + 2], nrm[NormalIndex + 1]);
+		}
+	}
+
+	for (size_t PrtUVSet = 0; PrtUVSet < uvSets; ++PrtUVSet)
+	{
+		const int32 UnrealUVSet = UnrealUVSets[PrtUVSet];
+		const uint32_t* FaceUVCounts = uvCounts[PrtUVSet];
+		if (UnrealUVSet == INDEX_NONE || FaceUVCounts == nullptr)
+		{
+			continue;
+		}
+
+		const TArrayView<FVector2f> UVs = VertexUVs.GetRawArray(UnrealUVSet);
+		const double* SetUVs = uvs[PrtUVSet];
+		const uint32_t* SetUVIndices = uvIndices[PrtUVSet];
+
+		size_t BaseUVIndex = 0;
+		size_t BaseInstanceIndex = 0;
+		for (const size_t FaceIndex : ConvertedFaces)
+		{
+			const size_t FaceVertexCount = faceVertexCounts[FaceIndex];
+			const uint32_t FaceUVCount = FaceUVCounts[FaceIndex];
+			if (FaceUVCount > 0)
 			{
+				check(FaceUVCount == FaceVertexCount);
 				for (size_t FaceVertexIndex = 0; FaceVertexIndex < FaceVertexCount; ++FaceVertexIndex)
 				{
-					check(BaseVertexIndex + FaceVertexIndex < vertexIndicesSize);
-					check(BaseVertexIndex + FaceVertexIndex < normalIndicesSize);
-
-					const uint32_t VertexIndex = vertexIndices[BaseVertexIndex + FaceVertexIndex];
-					const uint32_t NormalIndex = normalIndices[BaseVertexIndex + FaceVertexIndex] * 3;
-					FVertexInstanceID InstanceId = ModelDescription.MeshDescription.CreateVertexInstance(FVertexID(VertexIndex + ModelDescription.VertexIndexOffset));
-					PolygonVertexInstances.Add(InstanceId);
-
-					check(NormalIndex + 2 < nrmSize);
-					Normals[InstanceId] = FVector3f(nrm[NormalIndex], nrm[NormalIndex + 2], nrm[NormalIndex + 1]);
-
-					for (size_t PrtUVSet = 0; PrtUVSet < uvSets; ++PrtUVSet)
-					{
-						const Vitruvio::EUnrealUvSetType* UnrealUVSetPtr = PRTToUnrealUVSetMap.Find(static_cast<Vitruvio::EPrtUvSetType>(PrtUVSet));
-
-						bool bIsValidUnrealUvSet = (UnrealUVSetPtr != nullptr);
-						bool bFaceHasUvs = uvCounts[PrtUVSet] != nullptr && uvCounts[PrtUVSet][PolygonGroupStartIndex + FaceIndex] > 0;
-
-						if (bIsValidUnrealUvSet && bFaceHasUvs)
-						{
-							check(uvCounts[PrtUVSet][PolygonGroupStartIndex + FaceIndex] == FaceVertexCount);
-							const uint32_t UVIndex = uvIndices[PrtUVSet][BaseUVIndex[PrtUVSet] + FaceVertexIndex] * 2;
-							FVector2f UVCoords = FVector2f(uvs[PrtUVSet][UVIndex], -uvs[PrtUVSet][UVIndex + 1]);
-							VertexUVs.Set(InstanceId, static_cast<int32>(*UnrealUVSetPtr), UVCoords);
-						}
-					}
+					const uint32_t UVIndex = SetUVIndices[BaseUVIndex + FaceVertexIndex] * 2;
+					UVs[BaseInstanceIndex + FaceVertexIndex] = FVector2f(SetUVs[UVIndex], -SetUVs[UVIndex + 1]);
 				}
+			}
+
+			BaseUVIndex += FaceUVCount;
+			BaseInstanceIndex += FaceVertexCount;
+		}
+	}
+
+	ModelDescription.VertexIndexOffset += NumVertices;
+
+	return ModelDescription;
+}
+
+// Returns true if the mesh was encoded with "triangulateAndShareIndices", i.e. it only consists of triangles and all vertex attributes share
+// the vertex indices
+bool HasSharedTriangleIndices(size_t vtxSize, size_t nrmSize, const uint32_t* faceVertexCounts, size_t faceVertexCountsSize, const uint32_t* vertexIndices,
+	size_t vertexIndicesSize, const uint32_t* normalIndices, size_t normalIndicesSize, size_t const* uvsSizes, uint32_t const* const* uvIndices,
+	size_t const* uvIndicesSizes, size_t uvSets)
+{
+	const bool bHasNormals = nrmSize > 0 || normalIndicesSize > 0;
+	if ((bHasNormals && (nrmSize != vtxSize || normalIndicesSize != vertexIndicesSize)) || vertexIndicesSize != faceVertexCountsSize * 3)
+	{
+		return false;
+	}
+
+	for (size_t FaceIndex = 0; FaceIndex < faceVertexCountsSize; ++FaceIndex)
+	{
+		if (faceVertexCounts[FaceIndex] != 3)
+		{
+			return false;
+		}
+	}
+
+	if (bHasNormals && FMemory::Memcmp(vertexIndices, normalIndices, vertexIndicesSize * sizeof(uint32_t)) != 0)
+	{
+		return false;
+	}
+
+	for (size_t PrtUVSet = 0; PrtUVSet < uvSets; ++PrtUVSet)
+	{
+		if (uvsSizes[PrtUVSet] == 0)
+		{
+			continue;
+		}
 
-				ModelDescription.MeshDescription.CreatePolygon(PolygonGroupId, PolygonVertexInstances);
-				PolygonFaces++;
-				BaseVertexIndex += FaceVertexCount;
-				for (size_t PrtUVSet = 0; PrtUVSet < uvSets; ++PrtUVSet)
+		if (uvsSizes[PrtUVSet] / 2 != vtxSize / 3 || uvIndicesSizes[PrtUVSet] != vertexIndicesSize ||
+			FMemory::Memcmp(vertexIndices, uvIndices[PrtUVSet], vertexIndicesSize * sizeof(uint32_t)) != 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Converts a mesh which has been triangulated and welded by the encoder. Every vertex only needs a single vertex instance which is shared by
+// all adjacent triangles.
+FModelDescription ConvertTriangleMesh(const double* vtx, size_t vtxSize, const double* nrm, size_t nrmSize, const uint32_t* vertexIndices, double const* const* uvs,
+	size_t const* uvsSizes, uint32_t const* const* uvCounts, size_t uvSets, const uint32_t* faceRanges, size_t faceRangesSize,
+	const TArray<Vitruvio::FMaterialAttributeContainer>& Materials, const FVector3f& VertexOffset = FVector3f::ZeroVector,
+	bool bCollapseColorVariants = false)
+{
+	FModelDescription ModelDescription;
+	FMeshDescription& MeshDescription = ModelDescription.MeshDescription;
+	FStaticMeshAttributes Attributes(MeshDescription);
+	Attributes.Register();
+
+	const auto VertexUVs = Attributes.GetVertexInstanceUVs();
+	VertexUVs.SetNumChannels(8);
+
+	const int32 NumVertices = static_cast<int32>(vtxSize / 3);
+	MeshDescription.ReserveNewVertices(NumVertices);
+	MeshDescription.ReserveNewVertexInstances(NumVertices);
+	MeshDescription.ReserveNewPolygonGroups(static_cast<int32>(faceRangesSize));
+
+	// The mesh description is empty, so vertex and vertex instance ids are equal to the vertex indices
+	TArray<FVertexInstanceID> VertexInstances;
+	VertexInstances.SetNumUninitialized(NumVertices);
+	for (int32 VertexIndex = 0; VertexIndex < NumVertices; ++VertexIndex)
+	{
+		VertexInstances[VertexIndex] = MeshDescription.CreateVertexInstance(MeshDescription.CreateVertex());
+	}
+
+	const TArrayView<FVector3f> VertexPositions = Attributes.GetVertexPositions().GetRawArray();
+	for (int32 VertexIndex = 0; VertexIndex < NumVertices; ++VertexIndex)
+	{
+		const double* Position = vtx + VertexIndex * 3;
+		VertexPositions[VertexIndex] = FVector3f(Position[0], Position[2], Position[1]) * PRT_TO_UE_SCALE - VertexOffset;
+	}
+
+	if (nrmSize > 0)
+	{
+		const TArrayView<FVector3f> Normals = Attributes.GetVertexInstanceNormals().GetRawArray();
+		for (int32 VertexIndex = 0; VertexIndex < NumVertices; ++VertexIndex)
+		{
+			const double* Normal = nrm + VertexIndex * 3;
+			Normals[VertexIndex] = FVector3f(Normal[0], Normal[2], Normal[1]);
+		}
+	}
+
+	const TArray<int32, TInlineAllocator<16>> UnrealUVSets = CreateUVSetRemapTable(uvSets);
+	for (size_t PrtUVSet = 0; PrtUVSet < uvSets; ++PrtUVSet)
+	{
+		if (UnrealUVSets[PrtUVSet] == INDEX_NONE || uvsSizes[PrtUVSet] == 0)
+		{
+			continue;
+		}
+
+		const TArrayView<FVector2f> UVs = VertexUVs.GetRawArray(UnrealUVSets[PrtUVSet]);
+		const double* SetUVs = uvs[PrtUVSet];
+		for (int32 VertexIndex = 0; VertexIndex < NumVertices; ++VertexIndex)
+		{
+			UVs[VertexIndex] = FVector2f(SetUVs[VertexIndex * 2], -SetUVs[VertexIndex * 2 + 1]);
+		}
+	}
+
+	const TMap<FString, double> AvailableUvSetAttributeMap = CreateAvailableUVSetMaterialParameterMap(uvCounts, uvSets);
+
+	TArray<Vitruvio::FMaterialAttributeContainer> MaterialContainers;
+	MaterialContainers.Reserve(static_cast<int32>(faceRangesSize));
+	for (size_t PolygonGroupIndex = 0; PolygonGroupIndex < faceRangesSize; ++PolygonGroupIndex)
+	{
+		Vitruvio::FMaterialAttributes MaterialAttributes = Materials[PolygonGroupIndex].CopyAttributes();
+		for (const auto& AvailableUvSetAttribute : AvailableUvSetAttributeMap)
+		{
+			MaterialAttributes.ScalarProperties.Add(AvailableUvSetAttribute);
+		}
+		MaterialContainers.Emplace(MoveTemp(MaterialAttributes), Materials[PolygonGroupIndex].Name);
+	}
+
+	if (bCollapseColorVariants)
+	{
+		// Vertices are shared by the faces of all materials, so color variants are only collapsed if no vertex is used by different colors
+		TArray<Vitruvio::FMaterialAttributeContainer> CollapsedContainers;
+		CollapsedContainers.Reserve(MaterialContainers.Num());
+
+		TArray<FVector4f> VertexColors;
+		TBitArray<> ColoredVertices(false, NumVertices);
+		VertexColors.SetNumUninitialized(NumVertices);
+
+		size_t ColorFaceIndex = 0;
+		for (size_t PolygonGroupIndex = 0; PolygonGroupIndex < faceRangesSize && bCollapseColorVariants; ++PolygonGroupIndex)
+		{
+			FLinearColor VariantColor;
+			CollapsedContainers.Add(Vitruvio::SplitColorVariant(MaterialContainers[PolygonGroupIndex], VariantColor));
+
+			const size_t PolygonFaceCount = faceRanges[PolygonGroupIndex];
+			for (size_t CornerIndex = 0; CornerIndex < PolygonFaceCount * 3; ++CornerIndex)
+			{
+				const uint32_t VertexIndex = vertexIndices[ColorFaceIndex * 3 + CornerIndex];
+				if (ColoredVertices[VertexIndex] && VertexColors[VertexIndex] != FVector4f(VariantColor))
 				{
-					if (uvCounts[PrtUVSet] != nullptr)
-					{
-						BaseUVIndex[PrtUVSet] += uvCounts[PrtUVSet][PolygonGroupStartIndex + FaceIndex];
-					}
+					bCollapseColorVariants = false;
+					break;
 				}
+				ColoredVertices[VertexIndex] = true;
+				VertexColors[VertexIndex] = FVector4f(VariantColor);
 			}
+			ColorFaceIndex += PolygonFaceCount;
 		}
 
-		PolygonGroupStartIndex += PolygonFaces;
+		if (bCollapseColorVariants)
+		{
+			const TArrayView<FVector4f> Colors = Attributes.GetVertexInstanceColors().GetRawArray();
+			for (int32 VertexIndex = 0; VertexIndex < NumVertices; ++VertexIndex)
+			{
+				Colors[VertexIndex] = ColoredVertices[VertexIndex] ? VertexColors[VertexIndex] : FVector4f(1.0f, 1.0f, 1.0f, 1.0f);
+			}
+			MaterialContainers = MoveTemp(CollapsedContainers);
+		}
 	}
 
-	ModelDescription.VertexIndexOffset += vtxSize / 3;
+	size_t FaceIndex = 0;
+	for (size_t PolygonGroupIndex = 0; PolygonGroupIndex < faceRangesSize; ++PolygonGroupIndex)
+	{
+		const Vitruvio::FMaterialAttributeContainer& MaterialContainer = MaterialContainers[PolygonGroupIndex];
+
+		FPolygonGroupID PolygonGroupId;
+		if (const FPolygonGroupID* ExistingPolygonGroupId = ModelDescription.MaterialToPolygonMap.Find(MaterialContainer))
+		{
+			PolygonGroupId = *ExistingPolygonGroupId;
+		}
+		else
+		{
+			ModelDescription.Materials.Add(MaterialContainer);
+			PolygonGroupId = MeshDescription.CreatePolygonGroup();
+			ModelDescription.MaterialToPolygonMap.Add(MaterialContainer, PolygonGroupId);
+		}
+
+		const size_t PolygonFaceCount = faceRanges[PolygonGroupIndex];
+		MeshDescription.ReserveNewTriangles(PolygonFaceCount);
+		MeshDescription.ReserveNewPolygons(PolygonFaceCount);
+		for (size_t GroupFaceIndex = 0; GroupFaceIndex < PolygonFaceCount; ++GroupFaceIndex, ++FaceIndex)
+		{
+			const uint32_t* TriangleIndices = vertexIndices + FaceIndex * 3;
+			const FVertexInstanceID TriangleVertexInstances[3] = {
+				VertexInstances[TriangleIndices[0]], VertexInstances[TriangleIndices[1]], VertexInstances[TriangleIndices[2]]};
+			MeshDescription.CreateTriangle(PolygonGroupId, TriangleVertexInstances);
+		}
+	}
+
+	ModelDescription.VertexIndexOffset += NumVertices;
 
 	return ModelDescription;
 }
 
-TSharedPtr<FVitruvioMesh> CreateVitruvioMesh(const FString& Identifier, FMeshDescription Description, TArray<Vitruvio::FMaterialAttributeContainer> ModelMaterials)
+// Tangents are only needed for normal mapping, so meshes without normal maps get an arbitrary tangent basis around their normals
+void ComputeBasisTangents(FMeshDescription& Description, const TArray<FPolygonGroupID>& PolygonGroups)
+{
+	FStaticMeshAttributes Attributes(Description);
+	const TVertexInstanceAttributesConstRef<FVector3f> Normals = Attributes.GetVertexInstanceNormals();
+	TVertexInstanceAttributesRef<FVector3f> Tangents = Attributes.GetVertexInstanceTangents();
+	TVertexInstanceAttributesRef<float> BinormalSigns = Attributes.GetVertexInstanceBinormalSigns();
+
+	for (const FPolygonGroupID PolygonGroupId : PolygonGroups)
+	{
+		for (const FTriangleID TriangleId : Description.GetPolygonGroupTriangles(PolygonGroupId))
+		{
+			for (const FVertexInstanceID VertexInstanceId : Description.GetTriangleVertexInstances(TriangleId))
+			{
+				FVector3f Tangent;
+				FVector3f Binormal;
+				Normals[VertexInstanceId].FindBestAxisVectors(Tangent, Binormal);
+				Tangents[VertexInstanceId] = Tangent;
+				BinormalSigns[VertexInstanceId] = 1.0f;
+			}
+		}
+	}
+}
+
+// Accumulates the uv aligned triangle tangents per vertex instance, which is considerably cheaper than MikkTSpace
+void ComputeFastTangents(FMeshDescription& Description, const TArray<FPolygonGroupID>& PolygonGroups)
 {
+	FStaticMeshAttributes Attributes(Description);
+	const TVertexAttributesConstRef<FVector3f> Positions = Attributes.GetVertexPositions();
+	const TVertexInstanceAttributesConstRef<FVector2f> UVs = Attributes.GetVertexInstanceUVs();
+	const TVertexInstanceAttributesConstRef<FVector3f> Normals = Attributes.GetVertexInstanceNormals();
+	TVertexInstanceAttributesRef<FVector3f> Tangents = Attributes.GetVertexInstanceTangents();
+	TVertexInstanceAttributesRef<float> BinormalSigns = Attributes.GetVertexInstanceBinormalSigns();
+
+	if (UVs.GetNumChannels() == 0)
+	{
+		ComputeBasisTangents(Description, PolygonGroups);
+		return;
+	}
+
+	const int32 NumVertexInstances = Description.VertexInstances().GetArraySize();
+	TArray<FVector3f> TangentSums;
+	TArray<FVector3f> BinormalSums;
+	TangentSums.SetNumZeroed(NumVertexInstances);
+	BinormalSums.SetNumZeroed(NumVertexInstances);
+	TBitArray<> UsedVertexInstances(false, NumVertexInstances);
+
+	for (const FPolygonGroupID PolygonGroupId : PolygonGroups)
+	{
+		for (const FTriangleID TriangleId : Description.GetPolygonGroupTriangles(PolygonGroupId))
+		{
+			const TArrayView<const FVertexInstanceID> Corners = Description.GetTriangleVertexInstances(TriangleId);
+			for (const FVertexInstanceID Corner : Corners)
+			{
+				UsedVertexInstances[Corner.GetValue()] = true;
+			}
+
+			const FVector3f P0 = Positions[Description.GetVertexInstanceVertex(Corners[0])];
+			const FVector3f Edge1 = Positions[Description.GetVertexInstanceVertex(Corners[1])] - P0;
+			const FVector3f Edge2 = Positions[Description.GetVertexInstanceVertex(Corners[2])] - P0;
+			const FVector2f UV0 = UVs.Get(Corners[0], 0);
+			const FVector2f DeltaUV1 = UVs.Get(Corners[1], 0) - UV0;
+			const FVector2f DeltaUV2 = UVs.Get(Corners[2], 0) - UV0;
+
+			const float Determinant = DeltaUV1.X * DeltaUV2.Y - DeltaUV2.X * DeltaUV1.Y;
+			if (FMath::Abs(Determinant) < UE_SMALL_NUMBER)
+			{
+				continue;
+			}
+
+			const FVector3f Tangent = (Edge1 * DeltaUV2.Y - Edge2 * DeltaUV1.Y) / Determinant;
+			const FVector3f Binormal = (Edge2 * DeltaUV1.X - Edge1 * DeltaUV2.X) / Determinant;
+			for (const FVertexInstanceID Corner : Corners)
+			{
+				TangentSums[Corner.GetValue()] += Tangent;
+				BinormalSums[Corner.GetValue()] += Binormal;
+			}
+		}
+	}
+
+	for (TConstSetBitIterator<> It(UsedVertexInstances); It; ++It)
+	{
+		const FVertexInstanceID VertexInstanceId(It.GetIndex());
+		const FVector3f Normal = Normals[VertexInstanceId];
+
+		// Orthogonalize against the normal and fall back to an arbitrary basis for degenerate uvs
+		FVector3f Tangent = (TangentSums[It.GetIndex()] - Normal * FVector3f::DotProduct(Normal, TangentSums[It.GetIndex()])).GetSafeNormal();
+		if (Tangent.IsZero())
+		{
+			FVector3f Binormal;
+			Normal.FindBestAxisVectors(Tangent, Binormal);
+		}
+
+		Tangents[VertexInstanceId] = Tangent;
+		BinormalSigns[VertexInstanceId] = FVector3f::DotProduct(FVector3f::CrossProduct(Normal, Tangent), BinormalSums[It.GetIndex()]) < 0.0f ? -1.0f : 1.0f;
+	}
+}
+
+void ComputeNormalsAndTangents(FMeshDescription& Description, const TArray<Vitruvio::FMaterialAttributeContainer>& Materials)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_UnrealCallbacks_ComputeNormalsAndTangents);
+
 	bool bHasInvalidNormals;
 	bool bHasInvalidTangents;
 
 	FStaticMeshOperations::HasInvalidVertexInstanceNormalsOrTangents(Description, bHasInvalidNormals, bHasInvalidTangents);
 
-	// If normals are invalid, compute normals and tangents at polygon level then vertex level
+	// Normals provided by the encoder are used as is, otherwise compute normals at polygon level then vertex level
 	if (bHasInvalidNormals)
 	{
+		QUICK_SCOPE_CYCLE_COUNTER(STAT_UnrealCallbacks_ComputeNormals);
+
 		FStaticMeshOperations::ComputeTriangleTangentsAndNormals(Description, THRESH_POINTS_ARE_SAME);
+		FStaticMeshOperations::ComputeTangentsAndNormals(Description, EComputeNTBsFlags::Normals);
+	}
+	else if (!bHasInvalidTangents)
+	{
+		return;
+	}
+
+	// Polygon groups are created in the order of their materials
+	TArray<FPolygonGroupID> NormalMappedPolygonGroups;
+	TArray<FPolygonGroupID> OtherPolygonGroups;
+	int32 MaterialIndex = 0;
+	for (const FPolygonGroupID PolygonGroupId : Description.PolygonGroups().GetElementIDs())
+	{
+		const bool bHasNormalMap = Materials.IsValidIndex(MaterialIndex) && Materials[MaterialIndex].GetTextureProperties().Contains(TEXT("normalMap"));
+		(bHasNormalMap ? NormalMappedPolygonGroups : OtherPolygonGroups).Add(PolygonGroupId);
+		++MaterialIndex;
+	}
+
+	if (!NormalMappedPolygonGroups.IsEmpty())
+	{
+		if (CVarFastTangents.GetValueOnAnyThread())
+		{
+			QUICK_SCOPE_CYCLE_COUNTER(STAT_UnrealCallbacks_ComputeFastTangents);
+			ComputeFastTangents(Description, NormalMappedPolygonGroups);
+		}
+		else
+		{
+			QUICK_SCOPE_CYCLE_COUNTER(STAT_UnrealCallbacks_ComputeMikktTangents);
+
+			// MikkTSpace always processes the whole mesh, so the other polygon groups do not need tangents anymore
+			FStaticMeshOperations::ComputeMikktTangents(Description, true);
+			return;
+		}
+	}
+
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_UnrealCallbacks_ComputeBasisTangents);
+	ComputeBasisTangents(Description, OtherPolygonGroups);
+}
 
-		const EComputeNTBsFlags ComputeFlags = EComputeNTBsFlags::Normals | EComputeNTBsFlags::Tangents | EComputeNTBsFlags::UseMikkTSpace;
-		FStaticMeshOperations::ComputeTangentsAndNormals(Description, ComputeFlags);
+TSharedPtr<FVitruvioMesh> CreateVitruvioMesh(const FString& Identifier, FMeshDescription Description, TArray<Vitruvio::FMaterialAttributeContainer> ModelMaterials,
+	bool bComputeNormals = true, bool bPrepareBuild = true)
+{
+	// Meshes without normals (collision only output) are not shaded, so skip computing normals and tangents
+	if (bComputeNormals)
+	{
+		ComputeNormalsAndTangents(Description, ModelMaterials);
 	}
-	else if (bHasInvalidTangents)
+
+	TSharedPtr<FVitruvioMesh> Mesh = MakeShared<FVitruvioMesh>(Identifier, Description, ModelMaterials);
+
+	// Prepare collision and render data on the generate thread so that Build on the game thread only has to finalize the static mesh
+	if (bPrepareBuild)
 	{
-		FStaticMeshOperations::ComputeMikktTangents(Description, true);
+		Mesh->PrepareBuild();
 	}
 
-	return MakeShared<FVitruvioMesh>(Identifier, Description, ModelMaterials);
+	return Mesh;
+}
+
+TArray<Vitruvio::FMaterialAttributeContainer> ConvertMaterials(const prt::AttributeMap** materials, size_t faceRangesSize)
+{
+	TArray<Vitruvio::FMaterialAttributeContainer> Materials;
+	Materials.Reserve(faceRangesSize);
+	for (size_t MaterialIndex = 0; MaterialIndex < faceRangesSize; ++MaterialIndex)
+	{
+		Materials.Add(materials ? Vitruvio::FMaterialAttributeContainer(materials[MaterialIndex]) : Vitruvio::FMaterialAttributeContainer());
+	}
+	return Materials;
+}
+
+template <typename T>
+TArray<T> CopyBuffer(const T* Data, size_t Size)
+{
+	return Data ? TArray<T>(Data, static_cast<int32>(Size)) : TArray<T>();
+}
+
+template <typename T>
+const T* GetBufferOrNull(const TArray<T>& Buffer)
+{
+	return Buffer.IsEmpty() ? nullptr : Buffer.GetData();
+}
+
+FModelDescription ConvertPrototype(const FPrototypePayload& Payload, bool& bOutSharedTriangleIndices)
+{
+	const size_t UVSets = Payload.UVs.Num();
+
+	TArray<const double*, TInlineAllocator<8>> UVs;
+	TArray<size_t, TInlineAllocator<8>> UVsSizes;
+	TArray<const uint32_t*, TInlineAllocator<8>> UVCounts;
+	TArray<const uint32_t*, TInlineAllocator<8>> UVIndices;
+	TArray<size_t, TInlineAllocator<8>> UVIndicesSizes;
+	for (size_t UVSet = 0; UVSet < UVSets; ++UVSet)
+	{
+		UVs.Add(GetBufferOrNull(Payload.UVs[UVSet]));
+		UVsSizes.Add(Payload.UVs[UVSet].Num());
+		UVCounts.Add(GetBufferOrNull(Payload.UVCounts[UVSet]));
+		UVIndices.Add(GetBufferOrNull(Payload.UVIndices[UVSet]));
+		UVIndicesSizes.Add(Payload.UVIndices[UVSet].Num());
+	}
+
+	bOutSharedTriangleIndices = HasSharedTriangleIndices(Payload.Vertices.Num(), Payload.Normals.Num(), Payload.FaceVertexCounts.GetData(),
+		Payload.FaceVertexCounts.Num(), Payload.VertexIndices.GetData(), Payload.VertexIndices.Num(), GetBufferOrNull(Payload.NormalIndices),
+		Payload.NormalIndices.Num(), UVsSizes.GetData(), UVIndices.GetData(), UVIndicesSizes.GetData(), UVSets);
+
+	if (bOutSharedTriangleIndices)
+	{
+		return ConvertTriangleMesh(Payload.Vertices.GetData(), Payload.Vertices.Num(), GetBufferOrNull(Payload.Normals), Payload.Normals.Num(),
+			Payload.VertexIndices.GetData(), UVs.GetData(), UVsSizes.GetData(), UVCounts.GetData(), UVSets, Payload.FaceRanges.GetData(),
+			Payload.FaceRanges.Num(), Payload.Materials);
+	}
+	return ConvertMesh(Payload.Vertices.GetData(), Payload.Vertices.Num(), GetBufferOrNull(Payload.Normals), Payload.Normals.Num(),
+		Payload.FaceVertexCounts.GetData(), Payload.FaceVertexCounts.Num(), Payload.VertexIndices.GetData(), Payload.VertexIndices.Num(),
+		GetBufferOrNull(Payload.NormalIndices), Payload.NormalIndices.Num(), UVs.GetData(), UVCounts.GetData(), UVIndices.GetData(), UVSets,
+		Payload.FaceRanges.GetData(), Payload.FaceRanges.Num(), Payload.Materials);
+}
+
+// Persistent cache entries outlive the session, so their keys contain every option which changes the converted prototypes
+FString GetPersistentMeshCacheVariant(const Vitruvio::FEncoderOutputOptions& OutputOptions)
+{
+	return FString::Printf(TEXT("Materials=%d,Normals=%d,UVSets=%d,FastTangents=%d"), OutputOptions.bEmitMaterials, OutputOptions.bEmitNormals,
+						   OutputOptions.MaxUVSets, CVarFastTangents.GetValueOnAnyThread());
 }
 
 TMap<FString, FReport> ExtractReports(const prt::AttributeMap* reports)
@@ -299,44 +789,209 @@ void UnrealCallbacks::addMesh(const wchar_t* name, const wchar_t* meshId, int32_
 
                               const uint32_t* faceRanges, size_t faceRangesSize, const prt::AttributeMap** materials)
 {
+	// Drop outputs not requested by the output profile in case the encoder did not already omit them
+	if (!OutputOptions.bEmitNormals)
+	{
+		nrmSize = 0;
+		normalIndicesSize = 0;
+	}
+	if (!OutputOptions.bEmitMaterials)
+	{
+		materials = nullptr;
+	}
+	if (OutputOptions.MaxUVSets >= 0)
+	{
+		uvSets = FMath::Min(uvSets, static_cast<size_t>(OutputOptions.MaxUVSets));
+	}
+
 	if (prototypeId == NoPrototypeIndex)
 	{
-		ModelDescription = ConvertMesh(vtx, vtxSize, nrm, nrmSize, faceVertexCounts, faceVertexCountsSize, vertexIndices, vertexIndicesSize,
-			normalIndices, normalIndicesSize, uvs, uvCounts, uvIndices, uvSets, faceRanges, faceRangesSize, materials, FVector3f(Offset));
+		const bool bSharedTriangleIndices = HasSharedTriangleIndices(vtxSize, nrmSize, faceVertexCounts, faceVertexCountsSize, vertexIndices,
+			vertexIndicesSize, normalIndices, normalIndicesSize, uvsSizes, uvIndices, uvIndicesSizes, uvSets);
+
+		const TArray<Vitruvio::FMaterialAttributeContainer> Materials = ConvertMaterials(materials, faceRangesSize);
+		const bool bCollapseColorVariants = materials && CVarCollapseColorVariants.GetValueOnAnyThread();
+		if (bSharedTriangleIndices)
+		{
+			ModelDescription = ConvertTriangleMesh(vtx, vtxSize, nrm, nrmSize, vertexIndices, uvs, uvsSizes, uvCounts, uvSets, faceRanges, faceRangesSize,
+				Materials, FVector3f(Offset), bCollapseColorVariants);
+		}
+		else
+		{
+			ModelDescription = ConvertMesh(vtx, vtxSize, nrm, nrmSize, faceVertexCounts, faceVertexCountsSize, vertexIndices, vertexIndicesSize,
+				normalIndices, normalIndicesSize, uvs, uvCounts, uvIndices, uvSets, faceRanges, faceRangesSize, Materials, FVector3f(Offset),
+				bCollapseColorVariants);
+		}
 	}
 	else
 	{
 		const FString NameString(name);
 		const FString IdentifierString(meshId);
+		const FString MeshCacheKey = IdentifierString + OutputOptions.GetMeshCacheSuffix();
 
-		if (const TSharedPtr<FVitruvioMesh> Mesh = VitruvioModule::Get().GetMeshCache().Get(IdentifierString))
+		if (const TSharedPtr<FVitruvioMesh> Mesh = VitruvioModule::Get().GetMeshCache().Get(MeshCacheKey))
 		{
 			InstanceMeshes.Add(meshId, Mesh);
 			InstanceNames.Add(meshId, NameString);
 			return;
 		}
-		
-		FModelDescription InstanceModelDescription = ConvertMesh(vtx, vtxSize, nrm, nrmSize, faceVertexCounts, faceVertexCountsSize,
-			vertexIndices, vertexIndicesSize, normalIndices, normalIndicesSize, uvs, uvCounts, uvIndices, uvSets, faceRanges, faceRangesSize, materials);
 
-		if (!InstanceModelDescription.MeshDescription.IsEmpty())
+		if (PendingPrototypeIds.Contains(IdentifierString))
+		{
+			return;
+		}
+
+		// Prototypes are independent of each other, so only copy them here and convert all of them in parallel in finish()
+		FPrototypePayload& Payload = PendingPrototypes.AddDefaulted_GetRef();
+		Payload.MeshId = IdentifierString;
+		Payload.Name = NameString;
+		Payload.Uri = uri ? FString(uri) : FString();
+		Payload.MeshCacheKey = MeshCacheKey;
+		Payload.Vertices = CopyBuffer(vtx, vtxSize);
+		Payload.Normals = CopyBuffer(nrm, nrmSize);
+		Payload.FaceVertexCounts = CopyBuffer(faceVertexCounts, faceVertexCountsSize);
+		Payload.VertexIndices = CopyBuffer(vertexIndices, vertexIndicesSize);
+		Payload.NormalIndices = CopyBuffer(normalIndices, normalIndicesSize);
+		for (size_t UVSet = 0; UVSet < uvSets; ++UVSet)
+		{
+			Payload.UVs.Add(CopyBuffer(uvs[UVSet], uvsSizes[UVSet]));
+			Payload.UVCounts.Add(CopyBuffer(uvCounts[UVSet], uvCountsSizes[UVSet]));
+			Payload.UVIndices.Add(CopyBuffer(uvIndices[UVSet], uvIndicesSizes[UVSet]));
+		}
+		Payload.FaceRanges = CopyBuffer(faceRanges, faceRangesSize);
+		Payload.Materials = ConvertMaterials(materials, faceRangesSize);
+
+		PendingPrototypeIds.Add(IdentifierString);
+	}
+}
+
+void UnrealCallbacks::ConvertPendingPrototypes()
+{
+	if (PendingPrototypes.IsEmpty())
+	{
+		return;
+	}
+
+	VitruvioModule& Module = VitruvioModule::Get();
+	FMeshCache& MeshCache = Module.GetMeshCache();
+	const bool bComputeNormals = OutputOptions.bEmitNormals;
+
+	TArray<TSharedPtr<FVitruvioMesh>> ConvertedMeshes;
+	ConvertedMeshes.SetNum(PendingPrototypes.Num());
+
+	// Inserted assets are static files inside the rule package, so their conversion can be reused across sessions
+	TArray<FString> PersistentKeys;
+	TArray<FString> RpkUris;
+	PersistentKeys.SetNum(PendingPrototypes.Num());
+	RpkUris.SetNum(PendingPrototypes.Num());
+	if (FPersistentMeshCache::IsEnabled())
+	{
+		const FString Variant = GetPersistentMeshCacheVariant(OutputOptions);
+		for (int32 PrototypeIndex = 0; PrototypeIndex < PendingPrototypes.Num(); ++PrototypeIndex)
+		{
+			const FPrototypePayload& Payload = PendingPrototypes[PrototypeIndex];
+			FPersistentMeshCache::MakeKey(Module, Payload.Uri, Payload.MeshId, Variant, PersistentKeys[PrototypeIndex], RpkUris[PrototypeIndex]);
+		}
+	}
+
+	// Writing to the persistent cache is deferred, so the workers only copy the converted meshes which have to be stored
+	TArray<TOptional<FPersistentMeshCache::FPendingEntry>> PendingStores;
+	PendingStores.SetNum(PendingPrototypes.Num());
+
+	ParallelFor(PendingPrototypes.Num(), [this, &MeshCache, &ConvertedMeshes, &PersistentKeys, &RpkUris, &PendingStores, bComputeNormals](int32 PrototypeIndex) {
+		const FPrototypePayload& Payload = PendingPrototypes[PrototypeIndex];
+		const FString& PersistentKey = PersistentKeys[PrototypeIndex];
+
+		FMeshDescription CachedMeshDescription;
+		TArray<Vitruvio::FMaterialAttributeContainer> CachedMaterials;
+		if (!PersistentKey.IsEmpty() && FPersistentMeshCache::Load(PersistentKey, RpkUris[PrototypeIndex], CachedMeshDescription, CachedMaterials))
+		{
+			const TSharedPtr<FVitruvioMesh> Mesh = CreateVitruvioMesh(Payload.MeshId, MoveTemp(CachedMeshDescription), MoveTemp(CachedMaterials), false);
+			ConvertedMeshes[PrototypeIndex] = MeshCache.InsertOrGet(Payload.MeshCacheKey, Mesh);
+			return;
+		}
+
+		bool bSharedTriangleIndices = false;
+		FModelDescription InstanceModelDescription = ConvertPrototype(Payload, bSharedTriangleIndices);
+		if (InstanceModelDescription.MeshDescription.IsEmpty())
+		{
+			return;
+		}
+
+		// Meshes with shared triangle indices have already been triangulated by the encoder
+		if (!bSharedTriangleIndices)
 		{
 			InstanceModelDescription.MeshDescription.TriangulateMesh();
-			
-			TSharedPtr<FVitruvioMesh> Mesh = CreateVitruvioMesh(IdentifierString, InstanceModelDescription.MeshDescription, InstanceModelDescription.Materials);
-			Mesh = VitruvioModule::Get().GetMeshCache().InsertOrGet(IdentifierString, Mesh);
+		}
 
-			InstanceMeshes.Add(meshId, Mesh);
-			InstanceNames.Add(meshId, NameString);
+		if (bComputeNormals)
+		{
+			ComputeNormalsAndTangents(InstanceModelDescription.MeshDescription, InstanceModelDescription.Materials);
+		}
+
+		if (!PersistentKey.IsEmpty())
+		{
+			PendingStores[PrototypeIndex].Emplace(FPersistentMeshCache::FPendingEntry{
+				PersistentKey, RpkUris[PrototypeIndex], InstanceModelDescription.MeshDescription, InstanceModelDescription.Materials});
+		}
+
+		const TSharedPtr<FVitruvioMesh> Mesh = CreateVitruvioMesh(Payload.MeshId, MoveTemp(InstanceModelDescription.MeshDescription),
+																  MoveTemp(InstanceModelDescription.Materials), false);
+
+		// The mesh cache is guarded by its own lock, so the first prototype inserted wins if another generate call converted the same mesh
+		ConvertedMeshes[PrototypeIndex] = MeshCache.InsertOrGet(Payload.MeshCacheKey, Mesh);
+	});
+
+	TArray<FPersistentMeshCache::FPendingEntry> PersistentEntries;
+	for (TOptional<FPersistentMeshCache::FPendingEntry>& PendingStore : PendingStores)
+	{
+		if (PendingStore.IsSet())
+		{
+			PersistentEntries.Add(MoveTemp(PendingStore.GetValue()));
+		}
+	}
+	FPersistentMeshCache::StoreAsync(MoveTemp(PersistentEntries));
+
+	TSet<FString> EmptyPrototypeIds;
+	for (int32 PrototypeIndex = 0; PrototypeIndex < PendingPrototypes.Num(); ++PrototypeIndex)
+	{
+		const FPrototypePayload& Payload = PendingPrototypes[PrototypeIndex];
+		if (ConvertedMeshes[PrototypeIndex])
+		{
+			InstanceMeshes.Add(Payload.MeshId, ConvertedMeshes[PrototypeIndex]);
+			InstanceNames.Add(Payload.MeshId, Payload.Name);
+		}
+		else
+		{
+			EmptyPrototypeIds.Add(Payload.MeshId);
 		}
 	}
+
+	// Instances of empty prototypes would not have been added if the prototype had been converted immediately
+	if (!EmptyPrototypeIds.IsEmpty())
+	{
+		for (auto InstanceIt = Instances.CreateIterator(); InstanceIt; ++InstanceIt)
+		{
+			if (EmptyPrototypeIds.Contains(InstanceIt->Key.MeshId))
+			{
+				InstanceIt.RemoveCurrent();
+			}
+		}
+	}
+
+	PendingPrototypes.Empty();
+	PendingPrototypeIds.Empty();
 }
 
 void UnrealCallbacks::finish()
 {
+	ConvertPendingPrototypes();
+
+	// The generated model is prepared by the caller of generate, since batch generation might still merge its materials
 	if (!ModelDescription.MeshDescription.IsEmpty())
 	{
-		GeneratedModel = CreateVitruvioMesh(TEXT("GeneratedMesh"), ModelDescription.MeshDescription, ModelDescription.Materials);
+		GeneratedModel = CreateVitruvioMesh(TEXT("GeneratedMesh"), ModelDescription.MeshDescription, ModelDescription.Materials, OutputOptions.bEmitNormals,
+											false);
 	}
 }
 
@@ -348,6 +1003,11 @@ void UnrealCallbacks::addReport(const prt::AttributeMap* reports)
 		return;
 	}
 
+	if (!OutputOptions.bEmitReports)
+	{
+		return;
+	}
+
 	Reports = ExtractReports(reports);
 }
 
@@ -373,7 +1033,7 @@ void UnrealCallbacks::addInstance(int32_t prototypeId, const wchar_t* meshId, co
 	const FVector CEScale = FVector(Scale.X, Scale.Z, Scale.Y);
 	const FVector CETranslation = FVector(Translation.X, Translation.Z, Translation.Y) * PRT_TO_UE_SCALE - Offset;
 
-	if (!InstanceMeshes.Contains(meshId))
+	if (!InstanceMeshes.Contains(meshId) && !PendingPrototypeIds.Contains(meshId))
 	{
 		UE_LOG(LogUnrealCallbacks, Warning, TEXT("No mesh found for meshId %s"), meshId);
 		return;
@@ -382,7 +1042,7 @@ void UnrealCallbacks::addInstance(int32_t prototypeId, const wchar_t* meshId, co
 	const FTransform Transform(CERotation.GetNormalized(), CETranslation, CEScale);
 
 	TArray<Vitruvio::FMaterialAttributeContainer> MaterialOverrides;
-	if (instanceMaterials)
+	if (instanceMaterials && OutputOptions.bEmitMaterials)
 	{
 		for (size_t MatIndex = 0; MatIndex < numInstanceMaterials; ++MatIndex)
 		{
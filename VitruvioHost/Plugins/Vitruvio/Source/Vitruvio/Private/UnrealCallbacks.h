@@ -18,6 +18,7 @@
 #include "PRTTypes.h"
 
 #include "Codec/Encoder/IUnrealCallbacks.h"
+#include "EncoderOutputProfile.h"
 #include "Report.h"
 #include "VitruvioTypes.h"
 
@@ -37,22 +38,56 @@ struct FModelDescription
 	TMap<Vitruvio::FMaterialAttributeContainer, FPolygonGroupID> MaterialToPolygonMap;
 };
 
+/**
+ * Owning copy of the prototype geometry passed to addMesh. The buffers passed by PRT are only valid during the callback,
+ * so prototypes are copied and converted in parallel once all of them have been collected.
+ */
+struct FPrototypePayload
+{
+	FString MeshId;
+	FString Name;
+	FString Uri;
+	FString MeshCacheKey;
+
+	TArray<double> Vertices;
+	TArray<double> Normals;
+	TArray<uint32_t> FaceVertexCounts;
+	TArray<uint32_t> VertexIndices;
+	TArray<uint32_t> NormalIndices;
+
+	TArray<TArray<double>> UVs;
+	TArray<TArray<uint32_t>> UVCounts;
+	TArray<TArray<uint32_t>> UVIndices;
+
+	TArray<uint32_t> FaceRanges;
+	TArray<Vitruvio::FMaterialAttributeContainer> Materials;
+};
+
 class UnrealCallbacks final : public IUnrealCallbacks
 {
 	TArray<AttributeMapBuilderUPtr>& AttributeMapBuilders;
 	FVector Offset;
+	Vitruvio::FEncoderOutputOptions OutputOptions;
 	
 	Vitruvio::FInstanceMap Instances;
 	TMap<FString, TSharedPtr<FVitruvioMesh>> InstanceMeshes;
 	TMap<FString, FString> InstanceNames;
+	TArray<FPrototypePayload> PendingPrototypes;
+	TSet<FString> PendingPrototypeIds;
 
 	FModelDescription ModelDescription;
 	TSharedPtr<FVitruvioMesh> GeneratedModel;
 	TMap<FString, FReport> Reports;
+
+	void ConvertPendingPrototypes();
 	
 public:
 	virtual ~UnrealCallbacks() override = default;
-	UnrealCallbacks(TArray<AttributeMapBuilderUPtr>& AttributeMapBuilders, const FVector& Offset = FVector::ZeroVector) : AttributeMapBuilders(AttributeMapBuilders), Offset(Offset) {}
+	UnrealCallbacks(TArray<AttributeMapBuilderUPtr>& AttributeMapBuilders, const FVector& Offset = FVector::ZeroVector,
+					EEncoderOutputProfile OutputProfile = EEncoderOutputProfile::Full)
+		: AttributeMapBuilders(AttributeMapBuilders), Offset(Offset), OutputOptions(Vitruvio::GetEncoderOutputOptions(OutputProfile))
+	{
+	}
 
 	static constexpr int32 NoPrototypeIndex = -1;
 
@@ -0,0 +1,574 @@
+/* Copyright 2024 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MaterialConsolidation.h"
+
+#include "TextureDecoding.h"
+#include "VitruvioMesh.h"
+#include "VitruvioModule.h"
+
+#include "HAL/IConsoleManager.h"
+#include "StaticMeshAttributes.h"
+
+TAutoConsoleVariable<int32> CVarTextureAtlasSize(TEXT("Esri.Vitruvio.TextureAtlasSize"), 4096,
+	TEXT("The maximum width and height of the texture atlases into which the textures of merged materials are packed."));
+
+TAutoConsoleVariable<int32> CVarTextureAtlasMaxInputSize(TEXT("Esri.Vitruvio.TextureAtlasMaxInputSize"), 1024,
+	TEXT("The maximum width and height of textures which are packed into texture atlases. Materials with larger textures are not merged."));
+
+namespace
+{
+// Texels around every packed texture which repeat its border, so that filtering does not sample neighbouring textures
+constexpr int32 AtlasPadding = 4;
+constexpr float UvTolerance = 1e-3f;
+
+struct FTextureSlot
+{
+	const TCHAR* Key;
+	int32 UVChannel;
+	const TCHAR* UVParameter;
+};
+
+// The uv channels from which the parent materials sample the textures (see EUnrealUvSetType). Textures fall back to the uvs of the color
+// map if their own uv set is not available.
+const FTextureSlot TextureSlots[] = {
+	{TEXT("colorMap"),     0, nullptr},
+	{TEXT("dirtMap"),      2, TEXT("HasDirtMapUV")},
+	{TEXT("opacityMap"),   3, TEXT("HasOpacityMapUV")},
+	{TEXT("normalMap"),    4, TEXT("HasNormalMapUV")},
+	{TEXT("emissiveMap"),  5, TEXT("HasEmissiveMapUV")},
+	{TEXT("roughnessMap"), 6, TEXT("HasRoughnessMapUV")},
+	{TEXT("metallicMap"),  7, TEXT("HasMetallicMapUV")}};
+
+int32 GetUVChannel(const Vitruvio::FMaterialAttributeContainer& Material, const FString& TextureKey)
+{
+	for (const FTextureSlot& Slot : TextureSlots)
+	{
+		if (TextureKey != Slot.Key)
+		{
+			continue;
+		}
+
+		if (!Slot.UVParameter)
+		{
+			return Slot.UVChannel;
+		}
+
+		const double* HasUVSet = Material.GetScalarProperties().Find(Slot.UVParameter);
+		return HasUVSet && *HasUVSet != 0.0 ? Slot.UVChannel : 0;
+	}
+
+	return INDEX_NONE;
+}
+
+struct FPackableTexture
+{
+	Vitruvio::FTextureMetadata Metadata;
+	std::unique_ptr<uint8_t[]> Pixels;
+};
+
+using FPackableTexturePtr = TSharedPtr<FPackableTexture>;
+
+FPackableTexturePtr ReadPackableTexture(const FString& Uri, int32 MaxInputSize)
+{
+	Vitruvio::FTextureMetadata Metadata;
+	size_t BufferSize = 0;
+	std::unique_ptr<uint8_t[]> Pixels = VitruvioModule::Get().ReadTexture(Uri, Metadata, BufferSize);
+	if (!Pixels || Metadata.Width == 0 || Metadata.Height == 0)
+	{
+		return nullptr;
+	}
+
+	// Only 8 bit textures are packed, since they can be composed without conversion and cover nearly all textures of CityEngine rules
+	const bool bPackableFormat = Metadata.PixelFormat == Vitruvio::EPRTPixelFormat::GREY8 || Metadata.PixelFormat == Vitruvio::EPRTPixelFormat::RGB8 ||
+								 Metadata.PixelFormat == Vitruvio::EPRTPixelFormat::RGBA8;
+	if (!bPackableFormat || Metadata.BytesPerBand != 1 || Metadata.Width > static_cast<size_t>(MaxInputSize) ||
+		Metadata.Height > static_cast<size_t>(MaxInputSize))
+	{
+		return nullptr;
+	}
+
+	FPackableTexturePtr Texture = MakeShared<FPackableTexture>();
+	Texture->Metadata = Metadata;
+	Texture->Pixels = MoveTemp(Pixels);
+	return Texture;
+}
+
+/** A polygon group whose material can be merged with others. */
+struct FCandidate
+{
+	FPolygonGroupID PolygonGroupId;
+	Vitruvio::FMaterialAttributeContainer Material;
+
+	// The textures which are sampled with each uv channel, by texture key. All textures of a channel have the same size.
+	TMap<int32, TMap<FString, FPackableTexturePtr>> ChannelTextures;
+	TMap<int32, FIntPoint> ChannelSizes;
+
+	// Identifies the textures of a channel, so that members with identical textures share their place in the atlas
+	TMap<int32, FString> ChannelSignatures;
+
+	int32 MaxHeight = 0;
+};
+
+bool AreUVsPackable(const FMeshDescription& Description, TVertexInstanceAttributesConstRef<FVector2f> VertexInstanceUVs,
+					FPolygonGroupID PolygonGroupId, int32 UVChannel)
+{
+	if (UVChannel >= VertexInstanceUVs.GetNumChannels())
+	{
+		return false;
+	}
+
+	// Textures are only packed if they are not repeated, uvs are stored with flipped v (see UnrealCallbacks)
+	for (const FPolygonID PolygonId : Description.GetPolygonGroupPolygonIDs(PolygonGroupId))
+	{
+		for (const FVertexInstanceID VertexInstanceId : Description.GetPolygonVertexInstances(PolygonId))
+		{
+			const FVector2f UV = VertexInstanceUVs.Get(VertexInstanceId, UVChannel);
+			if (UV.X < -UvTolerance || UV.X > 1.0f + UvTolerance || UV.Y < -1.0f - UvTolerance || UV.Y > UvTolerance)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool MakeCandidate(const FMeshDescription& Description, TVertexInstanceAttributesConstRef<FVector2f> VertexInstanceUVs,
+				   FPolygonGroupID PolygonGroupId, const Vitruvio::FMaterialAttributeContainer& Material,
+				   TMap<FString, FPackableTexturePtr>& Textures, int32 MaxInputSize, FCandidate& OutCandidate)
+{
+	OutCandidate.PolygonGroupId = PolygonGroupId;
+	OutCandidate.Material = Material;
+
+	for (const auto& [Key, Uri] : Material.GetTextureProperties())
+	{
+		if (Uri.IsEmpty())
+		{
+			continue;
+		}
+
+		const int32 UVChannel = GetUVChannel(Material, Key);
+		if (UVChannel == INDEX_NONE)
+		{
+			return false;
+		}
+
+		FPackableTexturePtr* Texture = Textures.Find(Uri);
+		if (!Texture)
+		{
+			Texture = &Textures.Add(Uri, ReadPackableTexture(Uri, MaxInputSize));
+		}
+		if (!*Texture)
+		{
+			return false;
+		}
+
+		const FIntPoint Size(static_cast<int32>((*Texture)->Metadata.Width), static_cast<int32>((*Texture)->Metadata.Height));
+		if (const FIntPoint* ChannelSize = OutCandidate.ChannelSizes.Find(UVChannel); ChannelSize && *ChannelSize != Size)
+		{
+			return false;
+		}
+
+		OutCandidate.ChannelTextures.FindOrAdd(UVChannel).Add(Key, *Texture);
+		OutCandidate.ChannelSizes.Add(UVChannel, Size);
+		OutCandidate.ChannelSignatures.FindOrAdd(UVChannel) += Key + TEXT("=") + Uri + TEXT(";");
+		OutCandidate.MaxHeight = FMath::Max(OutCandidate.MaxHeight, Size.Y);
+	}
+
+	if (OutCandidate.ChannelTextures.IsEmpty())
+	{
+		return false;
+	}
+
+	for (const auto& [UVChannel, ChannelTextures] : OutCandidate.ChannelTextures)
+	{
+		if (!AreUVsPackable(Description, VertexInstanceUVs, PolygonGroupId, UVChannel))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Materials which are identical except for their textures end up in the same bucket. Textures need the same pixel format to be packed
+ * into one atlas and opacity maps the same classification, since it decides the blend mode of the material.
+ */
+Vitruvio::FMaterialAttributeContainer MakeBucketKey(const FCandidate& Candidate)
+{
+	Vitruvio::FMaterialAttributes Attributes = Candidate.Material.CopyAttributes();
+	for (auto& [Key, Uri] : Attributes.TextureProperties)
+	{
+		if (Uri.IsEmpty())
+		{
+			continue;
+		}
+
+		const FPackableTexturePtr& Texture = Candidate.ChannelTextures[GetUVChannel(Candidate.Material, Key)][Key];
+		Uri = FString::FromInt(static_cast<int32>(Texture->Metadata.PixelFormat));
+		if (Key == TEXT("opacityMap"))
+		{
+			Uri += TEXT("|") + FString::FromInt(static_cast<int32>(Vitruvio::ClassifyOpacity(Texture->Metadata, Texture->Pixels.get())));
+		}
+	}
+
+	return Vitruvio::FMaterialAttributeContainer(MoveTemp(Attributes), FString());
+}
+
+class FShelfPacker
+{
+public:
+	explicit FShelfPacker(int32 Size) : Size(Size) {}
+
+	bool Add(const FIntPoint& TextureSize, FIntPoint& OutPosition)
+	{
+		const FIntPoint PaddedSize = TextureSize + FIntPoint(2 * AtlasPadding, 2 * AtlasPadding);
+		if (PaddedSize.X > Size)
+		{
+			return false;
+		}
+
+		if (ShelfX + PaddedSize.X > Size)
+		{
+			ShelfY += ShelfHeight;
+			ShelfX = 0;
+			ShelfHeight = 0;
+		}
+
+		if (ShelfY + PaddedSize.Y > Size)
+		{
+			return false;
+		}
+
+		OutPosition = FIntPoint(ShelfX + AtlasPadding, ShelfY + AtlasPadding);
+		ShelfX += PaddedSize.X;
+		ShelfHeight = FMath::Max(ShelfHeight, PaddedSize.Y);
+		UsedSize = FIntPoint(FMath::Max(UsedSize.X, ShelfX), FMath::Max(UsedSize.Y, ShelfY + ShelfHeight));
+		return true;
+	}
+
+	FIntPoint GetUsedSize() const
+	{
+		return UsedSize;
+	}
+
+private:
+	int32 Size;
+	int32 ShelfX = 0;
+	int32 ShelfY = 0;
+	int32 ShelfHeight = 0;
+	FIntPoint UsedSize = FIntPoint::ZeroValue;
+};
+
+struct FPlacement
+{
+	FIntPoint Position;
+	int32 CandidateIndex;
+};
+
+/** A set of candidates whose textures are packed into one atlas per texture key. */
+struct FAtlasPage
+{
+	TMap<int32, FShelfPacker> Packers;
+	TMap<int32, TMap<FString, FPlacement>> Placements;
+
+	TArray<int32> Members;
+	TArray<TMap<int32, FIntPoint>> MemberPositions;
+};
+
+/** Adds the textures of all uv channels of a candidate to the page, or nothing if any of them does not fit anymore. */
+bool TryAddToPage(FAtlasPage& Page, const TArray<FCandidate>& Candidates, int32 CandidateIndex, int32 AtlasSize)
+{
+	const FCandidate& Candidate = Candidates[CandidateIndex];
+
+	TMap<int32, FShelfPacker> Packers = Page.Packers;
+	TMap<int32, FIntPoint> Positions;
+	TArray<int32> NewPlacements;
+
+	for (const auto& [UVChannel, Signature] : Candidate.ChannelSignatures)
+	{
+		const TMap<FString, FPlacement>* ChannelPlacements = Page.Placements.Find(UVChannel);
+		if (const FPlacement* Placement = ChannelPlacements ? ChannelPlacements->Find(Signature) : nullptr)
+		{
+			Positions.Add(UVChannel, Placement->Position);
+			continue;
+		}
+
+		FShelfPacker* Packer = Packers.Find(UVChannel);
+		if (!Packer)
+		{
+			Packer = &Packers.Add(UVChannel, FShelfPacker(AtlasSize));
+		}
+
+		FIntPoint Position;
+		if (!Packer->Add(Candidate.ChannelSizes[UVChannel], Position))
+		{
+			return false;
+		}
+
+		Positions.Add(UVChannel, Position);
+		NewPlacements.Add(UVChannel);
+	}
+
+	Page.Packers = MoveTemp(Packers);
+	for (const int32 UVChannel : NewPlacements)
+	{
+		Page.Placements.FindOrAdd(UVChannel).Add(Candidate.ChannelSignatures[UVChannel], {Positions[UVChannel], CandidateIndex});
+	}
+	Page.Members.Add(CandidateIndex);
+	Page.MemberPositions.Add(MoveTemp(Positions));
+	return true;
+}
+
+FIntPoint GetAtlasSize(const FAtlasPage& Page, int32 UVChannel)
+{
+	const FIntPoint UsedSize = Page.Packers[UVChannel].GetUsedSize();
+	return FIntPoint(Align(UsedSize.X, 4), Align(UsedSize.Y, 4));
+}
+
+void CopyIntoAtlas(TArray64<uint8>& Atlas, const FIntPoint& AtlasSize, const FPackableTexture& Texture, const FIntPoint& Position)
+{
+	const int64 BytesPerPixel = static_cast<int64>(Texture.Metadata.Bands);
+	const int32 Width = static_cast<int32>(Texture.Metadata.Width);
+	const int32 Height = static_cast<int32>(Texture.Metadata.Height);
+
+	const int32 FirstRow = FMath::Max(Position.Y - AtlasPadding, 0);
+	const int32 EndRow = FMath::Min(Position.Y + Height + AtlasPadding, AtlasSize.Y);
+	const int32 FirstColumn = FMath::Max(Position.X - AtlasPadding, 0);
+	const int32 EndColumn = FMath::Min(Position.X + Width + AtlasPadding, AtlasSize.X);
+
+	// Positions count rows from the top, while pixel data is stored from the bottom row up as in PRT
+	for (int32 Row = FirstRow; Row < EndRow; ++Row)
+	{
+		const int32 SourceRow = Height - 1 - FMath::Clamp(Row - Position.Y, 0, Height - 1);
+		const uint8* Source = Texture.Pixels.get() + SourceRow * Width * BytesPerPixel;
+		uint8* Target = Atlas.GetData() + (AtlasSize.Y - 1 - Row) * AtlasSize.X * BytesPerPixel;
+
+		FMemory::Memcpy(Target + Position.X * BytesPerPixel, Source, Width * BytesPerPixel);
+		for (int32 Column = FirstColumn; Column < Position.X; ++Column)
+		{
+			FMemory::Memcpy(Target + Column * BytesPerPixel, Source, BytesPerPixel);
+		}
+		for (int32 Column = Position.X + Width; Column < EndColumn; ++Column)
+		{
+			FMemory::Memcpy(Target + Column * BytesPerPixel, Source + (Width - 1) * BytesPerPixel, BytesPerPixel);
+		}
+	}
+}
+
+FString ComposeAtlas(const FAtlasPage& Page, const TArray<FCandidate>& Candidates, const FString& TextureKey, int32 UVChannel)
+{
+	const FIntPoint AtlasSize = GetAtlasSize(Page, UVChannel);
+	const TMap<FString, FPlacement>& ChannelPlacements = Page.Placements[UVChannel];
+
+	Vitruvio::FTextureMetadata Metadata = Candidates[Page.Members[0]].ChannelTextures[UVChannel][TextureKey]->Metadata;
+	Metadata.Width = AtlasSize.X;
+	Metadata.Height = AtlasSize.Y;
+
+	TArray64<uint8> Pixels;
+	Pixels.Init(0xFF, static_cast<int64>(AtlasSize.X) * AtlasSize.Y * Metadata.Bands);
+
+	for (const auto& [Signature, Placement] : ChannelPlacements)
+	{
+		const FPackableTexturePtr& Texture = Candidates[Placement.CandidateIndex].ChannelTextures[UVChannel][TextureKey];
+		CopyIntoAtlas(Pixels, AtlasSize, *Texture, Placement.Position);
+	}
+
+	return VitruvioModule::Get().RegisterGeneratedTexture(TextureKey + TEXT("Atlas"), Metadata, MoveTemp(Pixels));
+}
+
+void RemapUVs(FMeshDescription& Description, TVertexInstanceAttributesRef<FVector2f> VertexInstanceUVs, FPolygonGroupID PolygonGroupId,
+			  int32 UVChannel, const FIntPoint& Position, const FIntPoint& TextureSize, const FIntPoint& AtlasSize)
+{
+	const FVector2f Offset(static_cast<float>(Position.X) / AtlasSize.X, static_cast<float>(Position.Y) / AtlasSize.Y);
+	const FVector2f Scale(static_cast<float>(TextureSize.X) / AtlasSize.X, static_cast<float>(TextureSize.Y) / AtlasSize.Y);
+
+	for (const FPolygonID PolygonId : Description.GetPolygonGroupPolygonIDs(PolygonGroupId))
+	{
+		for (const FVertexInstanceID VertexInstanceId : Description.GetPolygonVertexInstances(PolygonId))
+		{
+			// v is flipped, so -1 is the top and 0 the bottom of the texture
+			const FVector2f UV = VertexInstanceUVs.Get(VertexInstanceId, UVChannel);
+			const FVector2f TextureUV(FMath::Clamp(UV.X, 0.0f, 1.0f), FMath::Clamp(1.0f + UV.Y, 0.0f, 1.0f));
+			VertexInstanceUVs.Set(VertexInstanceId, UVChannel, Offset + TextureUV * Scale);
+		}
+	}
+}
+} // namespace
+
+namespace Vitruvio
+{
+TSharedPtr<FVitruvioMesh> ConsolidateMaterials(const TSharedPtr<FVitruvioMesh>& Mesh, TArray<FString>& OutGeneratedTextures)
+{
+	if (!Mesh)
+	{
+		return Mesh;
+	}
+
+	const TArray<FMaterialAttributeContainer> Materials = Mesh->GetMaterials();
+	if (Materials.Num() < 2)
+	{
+		return Mesh;
+	}
+
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_MaterialConsolidation_ConsolidateMaterials);
+
+	FMeshDescription Description;
+	if (!Mesh->GetMeshDescription(Description))
+	{
+		return Mesh;
+	}
+
+	TArray<FPolygonGroupID> PolygonGroupIds;
+	for (const FPolygonGroupID PolygonGroupId : Description.PolygonGroups().GetElementIDs())
+	{
+		PolygonGroupIds.Add(PolygonGroupId);
+	}
+	if (PolygonGroupIds.Num() != Materials.Num())
+	{
+		return Mesh;
+	}
+
+	const int32 AtlasSize = FMath::Max(CVarTextureAtlasSize.GetValueOnAnyThread(), 1);
+	const int32 MaxInputSize = FMath::Min(CVarTextureAtlasMaxInputSize.GetValueOnAnyThread(), AtlasSize - 2 * AtlasPadding);
+
+	FStaticMeshAttributes Attributes(Description);
+	TVertexInstanceAttributesRef<FVector2f> VertexInstanceUVs = Attributes.GetVertexInstanceUVs();
+
+	TArray<FCandidate> Candidates;
+	TMap<FMaterialAttributeContainer, TArray<int32>> Buckets;
+	TMap<FString, FPackableTexturePtr> Textures;
+	for (int32 MaterialIndex = 0; MaterialIndex < Materials.Num(); ++MaterialIndex)
+	{
+		FCandidate Candidate;
+		if (MakeCandidate(Description, VertexInstanceUVs, PolygonGroupIds[MaterialIndex], Materials[MaterialIndex], Textures, MaxInputSize,
+						  Candidate))
+		{
+			Buckets.FindOrAdd(MakeBucketKey(Candidate)).Add(Candidates.Add(MoveTemp(Candidate)));
+		}
+	}
+
+	TArray<FAtlasPage> Pages;
+	for (auto& [BucketKey, Members] : Buckets)
+	{
+		if (Members.Num() < 2)
+		{
+			continue;
+		}
+
+		// Packing the tallest textures first keeps the shelves of the atlas tight
+		Members.StableSort([&Candidates](int32 A, int32 B) { return Candidates[A].MaxHeight > Candidates[B].MaxHeight; });
+
+		FAtlasPage Page;
+		for (const int32 CandidateIndex : Members)
+		{
+			if (TryAddToPage(Page, Candidates, CandidateIndex, AtlasSize))
+			{
+				continue;
+			}
+
+			if (Page.Members.Num() > 1)
+			{
+				Pages.Add(MoveTemp(Page));
+			}
+
+			Page = FAtlasPage();
+			TryAddToPage(Page, Candidates, CandidateIndex, AtlasSize);
+		}
+
+		if (Page.Members.Num() > 1)
+		{
+			Pages.Add(MoveTemp(Page));
+		}
+	}
+
+	if (Pages.IsEmpty())
+	{
+		return Mesh;
+	}
+
+	TArray<FString> GeneratedTextures;
+	TMap<FPolygonGroupID, FMaterialAttributeContainer> GroupMaterials;
+	for (int32 MaterialIndex = 0; MaterialIndex < Materials.Num(); ++MaterialIndex)
+	{
+		GroupMaterials.Add(PolygonGroupIds[MaterialIndex], Materials[MaterialIndex]);
+	}
+
+	for (const FAtlasPage& Page : Pages)
+	{
+		const FCandidate& FirstMember = Candidates[Page.Members[0]];
+
+		FMaterialAttributes MergedAttributes = FirstMember.Material.CopyAttributes();
+		for (auto& [Key, Uri] : MergedAttributes.TextureProperties)
+		{
+			if (!Uri.IsEmpty())
+			{
+				Uri = ComposeAtlas(Page, Candidates, Key, GetUVChannel(FirstMember.Material, Key));
+				GeneratedTextures.Add(Uri);
+			}
+		}
+		// The merged material keeps the identifier of its first member, so that material replacements keyed by it still apply. The resolved
+		// identifier is used since the name of default materials is derived from their color map, which now points to the atlas.
+		GroupMaterials[FirstMember.PolygonGroupId] =
+			FMaterialAttributeContainer(MoveTemp(MergedAttributes), FirstMember.Material.GetMaterialName());
+
+		for (int32 MemberIndex = 0; MemberIndex < Page.Members.Num(); ++MemberIndex)
+		{
+			const FCandidate& Member = Candidates[Page.Members[MemberIndex]];
+			for (const auto& [UVChannel, Position] : Page.MemberPositions[MemberIndex])
+			{
+				RemapUVs(Description, VertexInstanceUVs, Member.PolygonGroupId, UVChannel, Position, Member.ChannelSizes[UVChannel],
+						 GetAtlasSize(Page, UVChannel));
+			}
+
+			if (MemberIndex > 0)
+			{
+				const TArray<FPolygonID> PolygonIds(Description.GetPolygonGroupPolygonIDs(Member.PolygonGroupId));
+				for (const FPolygonID PolygonId : PolygonIds)
+				{
+					Description.SetPolygonPolygonGroup(PolygonId, FirstMember.PolygonGroupId);
+				}
+				Description.DeletePolygonGroup(Member.PolygonGroupId);
+				GroupMaterials.Remove(Member.PolygonGroupId);
+			}
+		}
+	}
+
+	FElementIDRemappings Remappings;
+	Description.Compact(Remappings);
+
+	// Materials are assigned to the polygon groups in the order of their ids (see FVitruvioMesh::Build)
+	TArray<FMaterialAttributeContainer> ConsolidatedMaterials;
+	ConsolidatedMaterials.SetNum(GroupMaterials.Num());
+	for (const auto& [PolygonGroupId, Material] : GroupMaterials)
+	{
+		const int32 MaterialIndex = Remappings.GetRemappedPolygonGroupID(PolygonGroupId).GetValue();
+		if (!ConsolidatedMaterials.IsValidIndex(MaterialIndex))
+		{
+			for (const FString& Uri : GeneratedTextures)
+			{
+				VitruvioModule::Get().ReleaseGeneratedTexture(Uri);
+			}
+			return Mesh;
+		}
+		ConsolidatedMaterials[MaterialIndex] = Material;
+	}
+
+	OutGeneratedTextures.Append(MoveTemp(GeneratedTextures));
+	return MakeShared<FVitruvioMesh>(Mesh->GetIdentifier(), Description, ConsolidatedMaterials);
+}
+} // namespace Vitruvio
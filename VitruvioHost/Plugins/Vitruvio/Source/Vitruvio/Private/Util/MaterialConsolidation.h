@@ -0,0 +1,36 @@
+﻿/* Copyright 2024 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "VitruvioTypes.h"
+
+class FVitruvioMesh;
+
+namespace Vitruvio
+{
+/**
+ * \brief Reduces the draw calls of a generated model by merging its polygon groups whose materials only differ by their textures. The
+ * textures of merged materials are packed into atlases on the CPU (see VitruvioModule::RegisterGeneratedTexture) and the uvs of the
+ * merged polygons are remapped into the atlases. Only 8 bit textures which are not repeated (all uvs within the texture) are packed and
+ * only materials with the same blend mode are merged. Merged materials keep the material identifier of their first member, so material
+ * replacements of the other members do not apply to them. Thread safe and intended to be called on a worker thread before LODs are generated.
+ *
+ * \param Mesh the generated model, which must not have been built or prepared yet. The returned model is not prepared either.
+ * \param OutGeneratedTextures the uris of the registered atlases, which need to be released once the model is not used anymore.
+ * \return the consolidated model or Mesh if no materials have been merged.
+ */
+TSharedPtr<FVitruvioMesh> ConsolidateMaterials(const TSharedPtr<FVitruvioMesh>& Mesh, TArray<FString>& OutGeneratedTextures);
+} // namespace Vitruvio
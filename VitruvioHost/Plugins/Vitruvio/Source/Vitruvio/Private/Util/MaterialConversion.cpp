@@ -18,7 +18,6 @@
 #include "MaterialConversion.h"
 #include "Runtime/Engine/Public/TextureResource.h"
 #include "Engine/Texture2D.h"
-#include "HAL/PlatformFileManager.h"
 #include "Runtime/ImageCore/Public/ImageCore.h"
 #include "VitruvioModule.h"
 #include "VitruvioTypes.h"
@@ -30,98 +29,19 @@ DEFINE_LOG_CATEGORY(LogMaterialConversion);
 namespace
 {
 
-constexpr double BlackColorThreshold = 0.02;
-constexpr double WhiteColorThreshold = 1.0 - BlackColorThreshold;
 constexpr double OpacityThreshold = 0.98;
 
 const FString CityEngineDefaultShaderName("CityEngineShader");
 const FString CityEnginePBRShaderName("CityEnginePBRShader");
 
-template <typename T, typename F>
-void CountOpacityMapPixels(const T* SrcColors, int32 SizeX, int32 SizeY, uint32& BlackPixels, uint32& WhitePixels, F Accessor)
+// The default material, used if the encoder does not emit materials (eg. the GeometryOnly profile), has no properties at all
+double GetOpacity(const Vitruvio::FMaterialAttributeContainer& MaterialContainer)
 {
-	BlackPixels = 0;
-	WhitePixels = 0;
-
-	const T* LastColor = SrcColors + (SizeX * SizeY);
-	while (SrcColors < LastColor)
-	{
-		const float Value = Accessor(SrcColors);
-
-		if (Value < BlackColorThreshold)
-		{
-			BlackPixels++;
-		}
-		else if (Value > WhiteColorThreshold)
-		{
-			WhitePixels++;
-		}
-		++SrcColors;
-	}
-}
-
-void CountOpacityMapPixels(const FColor* SrcColors, bool UseAlphaChannel, int32 SizeX, int32 SizeY, uint32& BlackPixels, uint32& WhitePixels)
-{
-	return CountOpacityMapPixels(SrcColors, SizeX, SizeY, BlackPixels, WhitePixels,
-								 [UseAlphaChannel](const FColor* Color) { return static_cast<float>(UseAlphaChannel ? Color->A : Color->R) / 0xFF; });
-}
-
-void CountOpacityMapPixels(const uint8* SrcColors, int32 SizeX, int32 SizeY, uint32& BlackPixels, uint32& WhitePixels)
-{
-	return CountOpacityMapPixels(SrcColors, SizeX, SizeY, BlackPixels, WhitePixels,
-								 [](const uint8* Color) { return static_cast<float>(*Color) / 0xFF; });
-}
-
-void CountOpacityMapPixels(const uint16* SrcColors, int32 SizeX, int32 SizeY, uint32& BlackPixels, uint32& WhitePixels)
-{
-	return CountOpacityMapPixels(SrcColors, SizeX, SizeY, BlackPixels, WhitePixels,
-								 [](const uint16* Color) { return static_cast<float>(*Color) / 0xFFFF; });
-}
-
-EBlendMode ChooseBlendModeFromOpacityMap(const Vitruvio::FTextureData& OpacityMapData, bool UseAlphaAsOpacity)
-{
-	const UTexture2D* OpacityMap = OpacityMapData.Texture;
-	const EPixelFormat PixelFormat = OpacityMap->GetPixelFormat();
-	check(PixelFormat == PF_B8G8R8A8 || PixelFormat == PF_A16B16G16R16 || PixelFormat == PF_FloatRGBA);
-
-	uint32 BlackPixels = 0;
-	uint32 WhitePixels = 0;
-
-	// Now count the black and white pixels of the appropriate opacity map channel to determine the opacity mode
-	const FTexturePlatformData* PlatformData = OpacityMap->GetPlatformData();
-	switch (PixelFormat)
-	{
-	case PF_B8G8R8A8:
-	{
-		const FColor* ImageData = reinterpret_cast<const FColor*>(PlatformData->Mips[0].BulkData.LockReadOnly());
-		CountOpacityMapPixels(ImageData, UseAlphaAsOpacity, OpacityMap->GetSizeX(), OpacityMap->GetSizeY(), BlackPixels, WhitePixels);
-		break;
-	}
-	case PF_A16B16G16R16:
-	{
-		const uint16* ImageData = reinterpret_cast<const uint16*>(PlatformData->Mips[0].BulkData.LockReadOnly());
-		CountOpacityMapPixels(ImageData, OpacityMap->GetSizeX(), OpacityMap->GetSizeY(), BlackPixels, WhitePixels);
-		break;
-	}
-	default:
-		check(0)
-	}
-
-	OpacityMap->GetPlatformData()->Mips[0].BulkData.Unlock();
-
-	const uint32 TotalPixels = OpacityMap->GetSizeX() * OpacityMap->GetSizeY();
-	if (WhitePixels >= TotalPixels * OpacityThreshold)
-	{
-		return BLEND_Opaque;
-	}
-	if (WhitePixels + BlackPixels >= TotalPixels * OpacityThreshold)
-	{
-		return BLEND_Masked;
-	}
-	return BLEND_Translucent;
+	const double* Opacity = MaterialContainer.GetScalarProperties().Find(TEXT("opacity"));
+	return Opacity ? *Opacity : 1.0;
 }
 
-EBlendMode ChooseBlendMode(const Vitruvio::FTextureData& OpacityMapData, double Opacity, EBlendMode BlendMode, bool UseAlphaAsOpacity)
+EBlendMode ChooseBlendMode(const Vitruvio::FTextureData& OpacityMapData, double Opacity, EBlendMode BlendMode)
 {
 	if (Opacity < OpacityThreshold)
 	{
@@ -131,12 +51,19 @@ EBlendMode ChooseBlendMode(const Vitruvio::FTextureData& OpacityMapData, double
 	{
 		return BLEND_Masked;
 	}
-	else if (BlendMode == BLEND_Translucent && OpacityMapData.Texture && OpacityMapData.Texture->GetPixelFormat() != PF_FloatRGBA)
-	// explicitly don't check FloatRGBA textures as they were converted from grayscale float16/32 textures which will never have alpha channels
+	else if (BlendMode == BLEND_Translucent && OpacityMapData.Texture)
 	{
-		// OpacityMap exists and opacitymap.mode is blend (which is the default value) so we need to check the content of the OpacityMap
-		// to really decide which material we need for Unreal
-		return ChooseBlendModeFromOpacityMap(OpacityMapData, UseAlphaAsOpacity);
+		// OpacityMap exists and opacitymap.mode is blend (which is the default value) so the content of the OpacityMap, which has been
+		// classified while decoding it, decides which material we really need for Unreal
+		switch (OpacityMapData.OpacityClassification)
+		{
+		case Vitruvio::EOpacityClassification::Opaque:
+			return BLEND_Opaque;
+		case Vitruvio::EOpacityClassification::Masked:
+			return BLEND_Masked;
+		default:
+			return BLEND_Translucent;
+		}
 	}
 	else
 	{
@@ -173,18 +100,14 @@ UMaterialInterface* GetMaterialByBlendMode(EBlendMode Mode, UMaterialInterface*
 class FLoadTextureTask
 {
 	TPromise<Vitruvio::FTextureData> Promise;
-	UObject* Outer;
-	TMap<FString, Vitruvio::FTextureData>& Cache;
-	FCriticalSection& CacheCriticalSection;
+	TWeakObjectPtr<UObject> Outer;
 
 	FString ImagePath;
 	FString TextureKey;
 
 public:
-	FLoadTextureTask(TPromise<Vitruvio::FTextureData>&& InPromise, UObject* Outer, TMap<FString, Vitruvio::FTextureData>& Cache,
-					 FCriticalSection& CacheCriticalSection, const FString& ImagePath, const FString& TextureKey)
-		: Promise(MoveTemp(InPromise)), Outer(Outer), Cache(Cache), CacheCriticalSection(CacheCriticalSection), ImagePath(ImagePath),
-		  TextureKey(TextureKey)
+	FLoadTextureTask(TPromise<Vitruvio::FTextureData>&& InPromise, UObject* Outer, const FString& ImagePath, const FString& TextureKey)
+		: Promise(MoveTemp(InPromise)), Outer(Outer), ImagePath(ImagePath), TextureKey(TextureKey)
 	{
 	}
 
@@ -211,12 +134,10 @@ public:
 	{
 		QUICK_SCOPE_CYCLE_COUNTER(STAT_MaterialConversion_LoadTexture);
 		FTaskTagScope Scope(ETaskTag::EParallelRenderingThread);
-		Vitruvio::FTextureData TextureData = VitruvioModule::Get().DecodeTexture(Outer, ImagePath, TextureKey);
-		{
-			FScopeLock CacheLock(&CacheCriticalSection);
 
-			Cache.Add(ImagePath, TextureData);
-		}
+		// The texture is returned rooted, since it is not referenced until the game thread creates a material instance with it
+		UObject* TextureOuter = Outer.IsValid() ? Outer.Get() : GetTransientPackage();
+		const Vitruvio::FTextureData TextureData = VitruvioModule::Get().DecodeTexture(TextureOuter, ImagePath, TextureKey);
 
 		Promise.SetValue(TextureData);
 	}
@@ -226,83 +147,68 @@ public:
 
 namespace Vitruvio
 {
-UMaterialInstanceDynamic* GameThread_CreateMaterialInstance(UObject* Outer, const FString& Name, UMaterialInterface* OpaqueParent,
-															UMaterialInterface* MaskedParent, UMaterialInterface* TranslucentParent,
-															const FMaterialAttributeContainer& MaterialContainer,
-															TMap<FString, FTextureData>& TextureCache)
+TMap<FString, TSharedFuture<FTextureData>> GameThread_LoadTexturesAsync(UObject* Outer, const FMaterialAttributeContainer& MaterialContainer,
+																		FTextureCache& TextureCache,
+																		TMap<FString, TSharedFuture<FTextureData>>& PendingTextures)
 {
 	check(IsInGameThread());
 
-	TMap<FString, FGraphEventRef> TexturePropertyTasks;
-	TMap<FString, TFuture<FTextureData>> TextureProperties;
-
-	FCriticalSection CacheCriticalSection;
+	const uint32 TextureCacheGeneration = VitruvioModule::Get().GetTextureCacheGeneration();
 
-	for (const auto& TextureProperty : MaterialContainer.TextureProperties)
+	TMap<FString, TSharedFuture<FTextureData>> Textures;
+	for (const auto& [TextureKey, TexturePath] : MaterialContainer.GetTextureProperties())
 	{
-		const FString TexturePath = TextureProperty.Value;
-		TPromise<FTextureData> Promise;
-		TFuture<FTextureData> Future = Promise.GetFuture();
-
-		bool ValidCache = false;
+		if (TexturePath.IsEmpty())
 		{
-			FScopeLock CacheLock(&CacheCriticalSection);
+			Textures.Add(TextureKey, MakeFulfilledPromise<FTextureData>().GetFuture().Share());
+			continue;
+		}
 
-			auto Cached = TextureCache.Find(TexturePath);
-			if (Cached)
+		if (const FTextureData* Cached = TextureCache.Find(TexturePath))
+		{
+			if (Cached->Generation == TextureCacheGeneration)
 			{
-				auto FileSystemTimeStamp = FPlatformFileManager::Get().GetPlatformFile().GetAccessTimeStamp(*TexturePath);
-				if (FileSystemTimeStamp > Cached->LoadTime)
-				{
-					// If the timestamp on the filesystem is newer than our cached version we have to evict it from the cache and reload the texture
-					// because it has changed
-					TextureCache.Remove(*TextureCache.FindKey(*Cached));
-				}
-				else
-				{
-					// Found a valid entry in the cache which we can just use
-					Promise.SetValue(*Cached);
-					ValidCache = true;
-				}
+				// Found a valid entry in the cache which we can just use
+				Textures.Add(TextureKey, MakeFulfilledPromise<FTextureData>(*Cached).GetFuture().Share());
+				continue;
 			}
+
+			// The texture has been decoded before PRT reloaded its rule packages, so it might have changed and needs to be reloaded
+			TextureCache.Remove(TexturePath);
 		}
 
-		if (!ValidCache)
+		// Textures which are used by several materials are only loaded once
+		if (const TSharedFuture<FTextureData>* PendingTexture = PendingTextures.Find(TexturePath))
 		{
-			// No valid entry found in the cache so we have to load it from the disk
-			auto LoadTextureTask = TexturePropertyTasks.Find(TexturePath);
-			if (LoadTextureTask)
-			{
-				FGraphEventArray Prerequisites;
-				Prerequisites.Add(*LoadTextureTask);
-				TGraphTask<TAsyncGraphTask<FTextureData>>::CreateTask(&Prerequisites)
-					.ConstructAndDispatchWhenReady(
-						[&TextureCache, TexturePath, &CacheCriticalSection]() {
-							FScopeLock CacheLock(&CacheCriticalSection);
-							return TextureCache[TexturePath];
-						},
-						MoveTemp(Promise), ENamedThreads::AnyThread);
-			}
-			else if (!TexturePath.IsEmpty())
-			{
-				FGraphEventRef LoadTask = TGraphTask<FLoadTextureTask>::CreateTask().ConstructAndDispatchWhenReady(
-					MoveTemp(Promise), Outer, TextureCache, CacheCriticalSection, TextureProperty.Value, TextureProperty.Key);
-				TexturePropertyTasks.Add(TexturePath, LoadTask);
-			}
-			else
-			{
-				Promise.SetValue({});
-			}
+			Textures.Add(TextureKey, *PendingTexture);
+			continue;
 		}
 
-		TextureProperties.Add(TextureProperty.Key, MoveTemp(Future));
+		TPromise<FTextureData> Promise;
+		TSharedFuture<FTextureData> Future = Promise.GetFuture().Share();
+		TGraphTask<FLoadTextureTask>::CreateTask().ConstructAndDispatchWhenReady(MoveTemp(Promise), Outer, TexturePath, TextureKey);
+
+		PendingTextures.Add(TexturePath, Future);
+		Textures.Add(TextureKey, MoveTemp(Future));
 	}
-	const float Opacity = MaterialContainer.ScalarProperties["opacity"];
-	const FTextureData OpacityMapData = TextureProperties.Contains("opacityMap") ? TextureProperties["opacityMap"].Get() : FTextureData{};
+
+	return Textures;
+}
+
+UMaterialInstanceDynamic* GameThread_CreateMaterialInstance(UObject* Outer, const FString& Name, UMaterialInterface* OpaqueParent,
+															UMaterialInterface* MaskedParent, UMaterialInterface* TranslucentParent,
+															const FMaterialAttributeContainer& MaterialContainer,
+															const TMap<FString, FTextureData>& Textures)
+{
+	check(IsInGameThread());
+
+	const float Opacity = GetOpacity(MaterialContainer);
+	const FTextureData* OpacityMap = Textures.Find("opacityMap");
+	const FTextureData OpacityMapData = OpacityMap ? *OpacityMap : FTextureData{};
 	const bool UseAlphaAsOpacity = OpacityMapData.Texture && OpacityMapData.NumChannels == 4;
-	const EBlendMode ChosenBlendMode = ChooseBlendMode(OpacityMapData, Opacity, GetBlendMode(MaterialContainer.BlendMode), UseAlphaAsOpacity);
+	const EBlendMode ChosenBlendMode = ChooseBlendMode(OpacityMapData, Opacity, GetBlendMode(MaterialContainer.GetBlendMode()));
 
-	const FString Shader = MaterialContainer.StringProperties["shader"];
+	const FString Shader = MaterialContainer.GetStringProperties().FindRef(TEXT("shader"));
 
 	UMaterialInterface* Parent = nullptr;
 
@@ -325,16 +231,42 @@ UMaterialInstanceDynamic* GameThread_CreateMaterialInstance(UObject* Outer, cons
 
 	MaterialInstance->SetScalarParameterValue(FName(TEXT("opacitySource")), UseAlphaAsOpacity);
 
-	for (const TPair<FString, TFuture<FTextureData>>& TextureFuture : TextureProperties)
+	for (const TPair<FString, FTextureData>& Texture : Textures)
 	{
-		const auto Result = TextureFuture.Value.Get();
-		MaterialInstance->SetTextureParameterValue(FName(TextureFuture.Key), Result.Texture);
+		MaterialInstance->SetTextureParameterValue(FName(Texture.Key), Texture.Value.Texture);
 	}
-	for (const TPair<FString, double>& ScalarProperty : MaterialContainer.ScalarProperties)
+	for (const TPair<FString, double>& ScalarProperty : MaterialContainer.GetScalarProperties())
+	{
+		MaterialInstance->SetScalarParameterValue(FName(ScalarProperty.Key), ScalarProperty.Value);
+	}
+	for (const TPair<FString, FLinearColor>& ColorProperty : MaterialContainer.GetColorProperties())
+	{
+		MaterialInstance->SetVectorParameterValue(FName(ColorProperty.Key), ColorProperty.Value);
+	}
+
+	return MaterialInstance;
+}
+
+UMaterialInstanceDynamic* GameThread_CreatePlaceholderMaterialInstance(const FString& Name, UMaterialInterface* OpaqueParent,
+																	   UMaterialInterface* MaskedParent, UMaterialInterface* TranslucentParent,
+																	   const FMaterialAttributeContainer& MaterialContainer)
+{
+	check(IsInGameThread());
+
+	// Without its opacity map, a material whose opacity map is blended is shown opaque until the map has been classified
+	const float Opacity = GetOpacity(MaterialContainer);
+	const EBlendMode BlendMode = ChooseBlendMode(FTextureData{}, Opacity, GetBlendMode(MaterialContainer.GetBlendMode()));
+	UMaterialInterface* Parent = GetMaterialByBlendMode(BlendMode, OpaqueParent, MaskedParent, TranslucentParent);
+
+	UMaterialInstanceDynamic* MaterialInstance = UMaterialInstanceDynamic::Create(Parent, GetTransientPackage(), *Name);
+	MaterialInstance->SetFlags(RF_Transient | RF_TextExportTransient | RF_DuplicateTransient);
+
+	// The colors of the material are already shown while its textures are being loaded
+	for (const TPair<FString, double>& ScalarProperty : MaterialContainer.GetScalarProperties())
 	{
 		MaterialInstance->SetScalarParameterValue(FName(ScalarProperty.Key), ScalarProperty.Value);
 	}
-	for (const TPair<FString, FLinearColor>& ColorProperty : MaterialContainer.ColorProperties)
+	for (const TPair<FString, FLinearColor>& ColorProperty : MaterialContainer.GetColorProperties())
 	{
 		MaterialInstance->SetVectorParameterValue(FName(ColorProperty.Key), ColorProperty.Value);
 	}
@@ -17,12 +17,37 @@
 
 #include "VitruvioTypes.h"
 
+#include "Async/Future.h"
+
+class FTextureCache;
+
 DECLARE_LOG_CATEGORY_EXTERN(LogMaterialConversion, Log, All);
 
 namespace Vitruvio
 {
+/**
+ * Starts loading the textures of a material on worker threads. Cached textures and textures which are already being loaded are reused.
+ * Loaded textures are rooted until they have been added to the texture cache (see FMaterialPipeline).
+ *
+ * \return the futures of the textures of the material, by texture property.
+ */
+TMap<FString, TSharedFuture<FTextureData>> GameThread_LoadTexturesAsync(UObject* Outer, const FMaterialAttributeContainer& MaterialAttributes,
+																		FTextureCache& TextureCache,
+																		TMap<FString, TSharedFuture<FTextureData>>& PendingTextures);
+
+/**
+ * Creates the material instance of a material whose textures have already been loaded.
+ */
 UMaterialInstanceDynamic* GameThread_CreateMaterialInstance(UObject* Outer, const FString& Name, UMaterialInterface* OpaqueParent,
 															UMaterialInterface* MaskedParent, UMaterialInterface* TranslucentParent,
 															const FMaterialAttributeContainer& MaterialAttributes,
-															TMap<FString, FTextureData>& TextureCache);
+															const TMap<FString, FTextureData>& Textures);
+
+/**
+ * Creates a placeholder material instance which only uses the non texture parameters of a material. Its parent is chosen by the blend
+ * mode which can be determined without the textures of the material.
+ */
+UMaterialInstanceDynamic* GameThread_CreatePlaceholderMaterialInstance(const FString& Name, UMaterialInterface* OpaqueParent,
+																	   UMaterialInterface* MaskedParent, UMaterialInterface* TranslucentParent,
+																	   const FMaterialAttributeContainer& MaterialAttributes);
 }
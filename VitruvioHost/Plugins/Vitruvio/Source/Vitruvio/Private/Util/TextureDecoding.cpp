@@ -14,14 +14,26 @@
  */
 
 #include "TextureDecoding.h"
+#include "Async/ParallelFor.h"
 #include "Engine/TextureDefines.h"
-#include "HAL/PlatformFileManager.h"
+#include "HAL/IConsoleManager.h"
 #include "Engine/Texture2D.h"
+#include "Hash/xxhash.h"
 #include "Runtime/Engine/Public/TextureResource.h"
+#include "UObject/GarbageCollection.h"
 #include "UObject/Package.h"
 
 #include <string>
 
+TAutoConsoleVariable<bool> CVarTextureMipMaps(TEXT("Esri.Vitruvio.TextureMipMaps"), true,
+	TEXT("Whether a mip chain is generated for textures created from PRT (box filtered)."));
+
+TAutoConsoleVariable<bool> CVarTextureCompression(TEXT("Esri.Vitruvio.TextureCompression"), true,
+	TEXT("Whether 8 bit textures created from PRT are block compressed (BC1 for opaque, BC3 for transparent and BC5 for normal maps)."));
+
+TAutoConsoleVariable<int32> CVarTextureMaxResolution(TEXT("Esri.Vitruvio.TextureMaxResolution"), 0,
+	TEXT("The maximum width and height of textures created from PRT. Larger textures are downsampled (0 for no limit)."));
+
 namespace
 {
 struct FTextureSettings
@@ -43,6 +55,522 @@ FTextureSettings GetTextureSettings(const FString& Key, EPixelFormat PixelFormat
 	bool IsGrayscale = PixelFormat == EPixelFormat::PF_G8 || PixelFormat == EPixelFormat::PF_G16 || EPixelFormat::PF_R32_FLOAT;
 	return {!IsGrayscale, TC_Default};
 }
+
+// Number of rows decoded per parallel task
+constexpr int32 DecodeRowsPerBlock = 64;
+
+// Row kernels which convert one flipped source row to the destination pixel format. Grayscale images are also converted to rgba
+// since texture params don't automatically update their sample method.
+
+void DecodeRowRGBA8(const uint8* Src, uint8* Dst, int32 Width)
+{
+	// Swap the red and blue bytes of four pixels at once
+	const VectorRegister4Int ByteMask = VectorIntSet1(0x000000FF);
+	const VectorRegister4Int GreenAlphaMask = VectorIntSet1(static_cast<int32>(0xFF00FF00));
+
+	int32 X = 0;
+	for (; X + 4 <= Width; X += 4)
+	{
+		const VectorRegister4Int Pixels = VectorIntLoad(Src + X * 4);
+		const VectorRegister4Int Red = VectorShiftLeftImm(VectorIntAnd(Pixels, ByteMask), 16);
+		const VectorRegister4Int Blue = VectorIntAnd(VectorShiftRightImmLogical(Pixels, 16), ByteMask);
+		VectorIntStore(VectorIntOr(VectorIntAnd(Pixels, GreenAlphaMask), VectorIntOr(Red, Blue)), Dst + X * 4);
+	}
+
+	for (; X < Width; ++X)
+	{
+		Dst[X * 4 + 0] = Src[X * 4 + 2];
+		Dst[X * 4 + 1] = Src[X * 4 + 1];
+		Dst[X * 4 + 2] = Src[X * 4 + 0];
+		Dst[X * 4 + 3] = Src[X * 4 + 3];
+	}
+}
+
+void DecodeRowRGB8(const uint8* Src, uint8* Dst, int32 Width)
+{
+	for (int32 X = 0; X < Width; ++X)
+	{
+		Dst[X * 4 + 0] = Src[X * 3 + 2];
+		Dst[X * 4 + 1] = Src[X * 3 + 1];
+		Dst[X * 4 + 2] = Src[X * 3 + 0];
+		Dst[X * 4 + 3] = 0;
+	}
+}
+
+void DecodeRowGrey8(const uint8* Src, uint8* Dst, int32 Width)
+{
+	uint32* DstPixels = reinterpret_cast<uint32*>(Dst);
+	for (int32 X = 0; X < Width; ++X)
+	{
+		DstPixels[X] = Src[X] * 0x00010101u;
+	}
+}
+
+void DecodeRowGrey16(const uint8* Src, uint8* Dst, int32 Width)
+{
+	const uint16* SrcValues = reinterpret_cast<const uint16*>(Src);
+	uint64* DstPixels = reinterpret_cast<uint64*>(Dst);
+	for (int32 X = 0; X < Width; ++X)
+	{
+		DstPixels[X] = SrcValues[X] * 0x0000000100010001ull;
+	}
+}
+
+void DecodeRowFloat32(const uint8* Src, uint8* Dst, int32 Width)
+{
+	// Convert 32 bit grayscale float textures to 16 bit RGBA float textures
+	const float* SrcValues = reinterpret_cast<const float*>(Src);
+	FFloat16Color* DstPixels = reinterpret_cast<FFloat16Color*>(Dst);
+	const FFloat16 One(1.0f);
+	for (int32 X = 0; X < Width; ++X)
+	{
+		const FFloat16 Value(SrcValues[X]);
+		DstPixels[X].R = Value;
+		DstPixels[X].G = Value;
+		DstPixels[X].B = Value;
+		DstPixels[X].A = One;
+	}
+}
+
+using FDecodeRowFunction = void (*)(const uint8* Src, uint8* Dst, int32 Width);
+
+FDecodeRowFunction GetDecodeRowFunction(Vitruvio::EPRTPixelFormat PixelFormat)
+{
+	switch (PixelFormat)
+	{
+	case Vitruvio::EPRTPixelFormat::RGBA8:
+		return &DecodeRowRGBA8;
+	case Vitruvio::EPRTPixelFormat::RGB8:
+		return &DecodeRowRGB8;
+	case Vitruvio::EPRTPixelFormat::GREY8:
+		return &DecodeRowGrey8;
+	case Vitruvio::EPRTPixelFormat::GREY16:
+		return &DecodeRowGrey16;
+	case Vitruvio::EPRTPixelFormat::FLOAT32:
+		return &DecodeRowFloat32;
+	default:
+		return nullptr;
+	}
+}
+
+struct FMipLevel
+{
+	int32 Width = 0;
+	int32 Height = 0;
+	TArray64<uint8> Data;
+};
+
+float ChannelToFloat(uint8 Value)
+{
+	return Value;
+}
+
+float ChannelToFloat(uint16 Value)
+{
+	return Value;
+}
+
+float ChannelToFloat(FFloat16 Value)
+{
+	return Value.GetFloat();
+}
+
+template <typename ChannelType>
+ChannelType FloatToChannel(float Value)
+{
+	return static_cast<ChannelType>(FMath::RoundToInt(Value));
+}
+
+template <>
+FFloat16 FloatToChannel<FFloat16>(float Value)
+{
+	return FFloat16(Value);
+}
+
+// Averages 2x2 pixels of four channels each, odd sizes repeat the last row or column
+template <typename ChannelType>
+FMipLevel DownsampleBox(const FMipLevel& Source)
+{
+	FMipLevel Result;
+	Result.Width = FMath::Max(1, Source.Width / 2);
+	Result.Height = FMath::Max(1, Source.Height / 2);
+	Result.Data.SetNumUninitialized(static_cast<int64>(Result.Width) * Result.Height * 4 * sizeof(ChannelType));
+
+	const ChannelType* Src = reinterpret_cast<const ChannelType*>(Source.Data.GetData());
+	ChannelType* Dst = reinterpret_cast<ChannelType*>(Result.Data.GetData());
+	ParallelFor(FMath::DivideAndRoundUp(Result.Height, DecodeRowsPerBlock), [&Source, &Result, Src, Dst](int32 BlockIndex) {
+		const int32 EndY = FMath::Min(Result.Height, (BlockIndex + 1) * DecodeRowsPerBlock);
+		for (int32 Y = BlockIndex * DecodeRowsPerBlock; Y < EndY; ++Y)
+		{
+			const int64 SrcRow0 = static_cast<int64>(FMath::Min(2 * Y, Source.Height - 1)) * Source.Width;
+			const int64 SrcRow1 = static_cast<int64>(FMath::Min(2 * Y + 1, Source.Height - 1)) * Source.Width;
+			for (int32 X = 0; X < Result.Width; ++X)
+			{
+				const int32 SrcX0 = FMath::Min(2 * X, Source.Width - 1);
+				const int32 SrcX1 = FMath::Min(2 * X + 1, Source.Width - 1);
+				for (int32 Channel = 0; Channel < 4; ++Channel)
+				{
+					const float Sum = ChannelToFloat(Src[(SrcRow0 + SrcX0) * 4 + Channel]) + ChannelToFloat(Src[(SrcRow0 + SrcX1) * 4 + Channel]) +
+									  ChannelToFloat(Src[(SrcRow1 + SrcX0) * 4 + Channel]) + ChannelToFloat(Src[(SrcRow1 + SrcX1) * 4 + Channel]);
+					Dst[(static_cast<int64>(Y) * Result.Width + X) * 4 + Channel] = FloatToChannel<ChannelType>(Sum * 0.25f);
+				}
+			}
+		}
+	});
+
+	return Result;
+}
+
+FMipLevel Downsample(const FMipLevel& Source, EPixelFormat PixelFormat)
+{
+	switch (PixelFormat)
+	{
+	case EPixelFormat::PF_A16B16G16R16:
+		return DownsampleBox<uint16>(Source);
+	case EPixelFormat::PF_FloatRGBA:
+		return DownsampleBox<FFloat16>(Source);
+	case EPixelFormat::PF_B8G8R8A8:
+	default:
+		return DownsampleBox<uint8>(Source);
+	}
+}
+
+// Only 8 bit textures are block compressed, higher precision textures (eg. height maps) are kept as is. Opacity maps are kept uncompressed
+// since block compression artifacts would show at the edges of masked and translucent materials.
+EPixelFormat GetCompressedPixelFormat(const FString& Key, EPixelFormat PixelFormat, size_t Bands)
+{
+	if (PixelFormat != EPixelFormat::PF_B8G8R8A8 || Key == TEXT("opacityMap"))
+	{
+		return EPixelFormat::PF_Unknown;
+	}
+	if (Key == TEXT("normalMap"))
+	{
+		return EPixelFormat::PF_BC5;
+	}
+	return Bands == 4 ? EPixelFormat::PF_DXT5 : EPixelFormat::PF_DXT1;
+}
+
+uint16 ToRGB565(const FColor& Color)
+{
+	return static_cast<uint16>(((Color.R >> 3) << 11) | ((Color.G >> 2) << 5) | (Color.B >> 3));
+}
+
+FColor FromRGB565(uint16 Value)
+{
+	const uint8 R = (Value >> 11) & 0x1F;
+	const uint8 G = (Value >> 5) & 0x3F;
+	const uint8 B = Value & 0x1F;
+	return FColor((R << 3) | (R >> 2), (G << 2) | (G >> 4), (B << 3) | (B >> 2));
+}
+
+int32 ColorDistance(const FColor& A, const FColor& B)
+{
+	return FMath::Square(A.R - B.R) + FMath::Square(A.G - B.G) + FMath::Square(A.B - B.B);
+}
+
+// Encodes the colors of a 4x4 block as BC1 (range fit along the bounding box diagonal, four color mode)
+void EncodeColorBlock(const FColor (&Pixels)[16], uint8* Out)
+{
+	FColor Min(255, 255, 255);
+	FColor Max(0, 0, 0);
+	for (const FColor& Pixel : Pixels)
+	{
+		Min = FColor(FMath::Min(Min.R, Pixel.R), FMath::Min(Min.G, Pixel.G), FMath::Min(Min.B, Pixel.B));
+		Max = FColor(FMath::Max(Max.R, Pixel.R), FMath::Max(Max.G, Pixel.G), FMath::Max(Max.B, Pixel.B));
+	}
+
+	// Inset the bounding box to reduce the error of the endpoints
+	Min = FColor(FMath::Min(255, Min.R + (Max.R - Min.R) / 16), FMath::Min(255, Min.G + (Max.G - Min.G) / 16), FMath::Min(255, Min.B + (Max.B - Min.B) / 16));
+	Max = FColor(FMath::Max(0, Max.R - (Max.R - Min.R) / 16), FMath::Max(0, Max.G - (Max.G - Min.G) / 16), FMath::Max(0, Max.B - (Max.B - Min.B) / 16));
+
+	uint16 Color0 = ToRGB565(Max);
+	uint16 Color1 = ToRGB565(Min);
+	if (Color0 < Color1)
+	{
+		Swap(Color0, Color1);
+	}
+
+	uint32 Indices = 0;
+	if (Color0 != Color1)
+	{
+		const FColor Endpoint0 = FromRGB565(Color0);
+		const FColor Endpoint1 = FromRGB565(Color1);
+		const FColor Palette[4] = {Endpoint0, Endpoint1,
+								   FColor((2 * Endpoint0.R + Endpoint1.R) / 3, (2 * Endpoint0.G + Endpoint1.G) / 3, (2 * Endpoint0.B + Endpoint1.B) / 3),
+								   FColor((Endpoint0.R + 2 * Endpoint1.R) / 3, (Endpoint0.G + 2 * Endpoint1.G) / 3, (Endpoint0.B + 2 * Endpoint1.B) / 3)};
+
+		for (int32 PixelIndex = 0; PixelIndex < 16; ++PixelIndex)
+		{
+			uint32 BestIndex = 0;
+			int32 BestDistance = MAX_int32;
+			for (uint32 PaletteIndex = 0; PaletteIndex < 4; ++PaletteIndex)
+			{
+				const int32 Distance = ColorDistance(Pixels[PixelIndex], Palette[PaletteIndex]);
+				if (Distance < BestDistance)
+				{
+					BestDistance = Distance;
+					BestIndex = PaletteIndex;
+				}
+			}
+			Indices |= BestIndex << (2 * PixelIndex);
+		}
+	}
+
+	Out[0] = Color0 & 0xFF;
+	Out[1] = Color0 >> 8;
+	Out[2] = Color1 & 0xFF;
+	Out[3] = Color1 >> 8;
+	FMemory::Memcpy(Out + 4, &Indices, sizeof(Indices));
+}
+
+// Encodes a single channel of a 4x4 block as BC4 (eight value mode)
+void EncodeChannelBlock(const uint8 (&Values)[16], uint8* Out)
+{
+	uint8 Min = 255;
+	uint8 Max = 0;
+	for (const uint8 Value : Values)
+	{
+		Min = FMath::Min(Min, Value);
+		Max = FMath::Max(Max, Value);
+	}
+
+	uint64 Indices = 0;
+	if (Max != Min)
+	{
+		int32 Palette[8] = {Max, Min};
+		for (int32 Step = 1; Step < 7; ++Step)
+		{
+			Palette[Step + 1] = ((7 - Step) * Max + Step * Min) / 7;
+		}
+
+		for (int32 PixelIndex = 0; PixelIndex < 16; ++PixelIndex)
+		{
+			uint64 BestIndex = 0;
+			int32 BestDistance = MAX_int32;
+			for (uint64 PaletteIndex = 0; PaletteIndex < 8; ++PaletteIndex)
+			{
+				const int32 Distance = FMath::Abs(Values[PixelIndex] - Palette[PaletteIndex]);
+				if (Distance < BestDistance)
+				{
+					BestDistance = Distance;
+					BestIndex = PaletteIndex;
+				}
+			}
+			Indices |= BestIndex << (3 * PixelIndex);
+		}
+	}
+
+	Out[0] = Max;
+	Out[1] = Min;
+	for (int32 Byte = 0; Byte < 6; ++Byte)
+	{
+		Out[2 + Byte] = static_cast<uint8>(Indices >> (8 * Byte));
+	}
+}
+
+// Compresses a BGRA8 mip level into the given block compressed format
+void CompressLevel(const FMipLevel& Level, EPixelFormat PixelFormat, uint8* Out)
+{
+	const int32 BlocksX = FMath::DivideAndRoundUp(Level.Width, 4);
+	const int32 BlocksY = FMath::DivideAndRoundUp(Level.Height, 4);
+	const int32 BlockBytes = GPixelFormats[PixelFormat].BlockBytes;
+	const FColor* Src = reinterpret_cast<const FColor*>(Level.Data.GetData());
+
+	ParallelFor(BlocksY, [&Level, PixelFormat, BlocksX, BlockBytes, Src, Out](int32 BlockY) {
+		for (int32 BlockX = 0; BlockX < BlocksX; ++BlockX)
+		{
+			// Blocks at the border repeat the last row or column
+			FColor Pixels[16];
+			for (int32 PixelIndex = 0; PixelIndex < 16; ++PixelIndex)
+			{
+				const int32 X = FMath::Min(BlockX * 4 + PixelIndex % 4, Level.Width - 1);
+				const int32 Y = FMath::Min(BlockY * 4 + PixelIndex / 4, Level.Height - 1);
+				Pixels[PixelIndex] = Src[static_cast<int64>(Y) * Level.Width + X];
+			}
+
+			uint8* Block = Out + (static_cast<int64>(BlockY) * BlocksX + BlockX) * BlockBytes;
+			if (PixelFormat == EPixelFormat::PF_DXT1)
+			{
+				EncodeColorBlock(Pixels, Block);
+			}
+			else if (PixelFormat == EPixelFormat::PF_DXT5)
+			{
+				uint8 Alpha[16];
+				for (int32 PixelIndex = 0; PixelIndex < 16; ++PixelIndex)
+				{
+					Alpha[PixelIndex] = Pixels[PixelIndex].A;
+				}
+				EncodeChannelBlock(Alpha, Block);
+				EncodeColorBlock(Pixels, Block + 8);
+			}
+			else if (PixelFormat == EPixelFormat::PF_BC5)
+			{
+				uint8 Red[16];
+				uint8 Green[16];
+				for (int32 PixelIndex = 0; PixelIndex < 16; ++PixelIndex)
+				{
+					Red[PixelIndex] = Pixels[PixelIndex].R;
+					Green[PixelIndex] = Pixels[PixelIndex].G;
+				}
+				EncodeChannelBlock(Red, Block);
+				EncodeChannelBlock(Green, Block + 8);
+			}
+		}
+	});
+}
+
+// A pixel counts as transparent below the black threshold and as opaque above the white threshold
+constexpr double BlackColorThreshold = 0.02;
+constexpr double WhiteColorThreshold = 1.0 - BlackColorThreshold;
+// Share of the pixels which need to be opaque (or opaque and transparent) for an opaque (or masked) classification
+constexpr double OpacityPixelsThreshold = 0.98;
+
+struct FOpacityHistogram
+{
+	uint64 BlackPixels = 0;
+	uint64 WhitePixels = 0;
+};
+
+// Counts the lanes below BlackLimit and at least WhiteLimit. Comparisons result in -1 for matching lanes, so they are subtracted.
+FORCEINLINE void CountOpacityLanes(const VectorRegister4Int& Values, const VectorRegister4Int& BlackLimit, const VectorRegister4Int& WhiteLimit,
+								   VectorRegister4Int& BlackLanes, VectorRegister4Int& WhiteLanes)
+{
+	BlackLanes = VectorIntSubtract(BlackLanes, VectorIntCompareLT(Values, BlackLimit));
+	WhiteLanes = VectorIntSubtract(WhiteLanes, VectorIntCompareGE(Values, WhiteLimit));
+}
+
+// Counts the opacity values of one source row. The opacity of RGBA8 images is stored in the alpha channel, all other formats use their
+// first channel. Integer values are compared against integer limits which are equivalent to the float thresholds.
+void CountOpacityRow(const uint8* Src, int32 Width, Vitruvio::EPRTPixelFormat PixelFormat, int32 BlackLimit, int32 WhiteLimit,
+					 FOpacityHistogram& Histogram)
+{
+	const VectorRegister4Int BlackLimits = VectorIntSet1(BlackLimit);
+	const VectorRegister4Int WhiteLimits = VectorIntSet1(WhiteLimit);
+	VectorRegister4Int BlackLanes = VectorIntSet1(0);
+	VectorRegister4Int WhiteLanes = VectorIntSet1(0);
+
+	auto CountValue = [&Histogram, BlackLimit, WhiteLimit](int32 Value) {
+		Histogram.BlackPixels += Value < BlackLimit;
+		Histogram.WhitePixels += Value >= WhiteLimit;
+	};
+
+	int32 X = 0;
+	switch (PixelFormat)
+	{
+	case Vitruvio::EPRTPixelFormat::RGBA8:
+	{
+		for (; X + 4 <= Width; X += 4)
+		{
+			const VectorRegister4Int Alpha = VectorShiftRightImmLogical(VectorIntLoad(Src + X * 4), 24);
+			CountOpacityLanes(Alpha, BlackLimits, WhiteLimits, BlackLanes, WhiteLanes);
+		}
+		for (; X < Width; ++X)
+		{
+			CountValue(Src[X * 4 + 3]);
+		}
+		break;
+	}
+	case Vitruvio::EPRTPixelFormat::GREY8:
+	{
+		const VectorRegister4Int ByteMask = VectorIntSet1(0x000000FF);
+		for (; X + 16 <= Width; X += 16)
+		{
+			const VectorRegister4Int Values = VectorIntLoad(Src + X);
+			CountOpacityLanes(VectorIntAnd(Values, ByteMask), BlackLimits, WhiteLimits, BlackLanes, WhiteLanes);
+			CountOpacityLanes(VectorIntAnd(VectorShiftRightImmLogical(Values, 8), ByteMask), BlackLimits, WhiteLimits, BlackLanes, WhiteLanes);
+			CountOpacityLanes(VectorIntAnd(VectorShiftRightImmLogical(Values, 16), ByteMask), BlackLimits, WhiteLimits, BlackLanes, WhiteLanes);
+			CountOpacityLanes(VectorShiftRightImmLogical(Values, 24), BlackLimits, WhiteLimits, BlackLanes, WhiteLanes);
+		}
+		for (; X < Width; ++X)
+		{
+			CountValue(Src[X]);
+		}
+		break;
+	}
+	case Vitruvio::EPRTPixelFormat::GREY16:
+	{
+		const VectorRegister4Int ShortMask = VectorIntSet1(0x0000FFFF);
+		for (; X + 8 <= Width; X += 8)
+		{
+			const VectorRegister4Int Values = VectorIntLoad(Src + X * 2);
+			CountOpacityLanes(VectorIntAnd(Values, ShortMask), BlackLimits, WhiteLimits, BlackLanes, WhiteLanes);
+			CountOpacityLanes(VectorShiftRightImmLogical(Values, 16), BlackLimits, WhiteLimits, BlackLanes, WhiteLanes);
+		}
+		const uint16* Values = reinterpret_cast<const uint16*>(Src);
+		for (; X < Width; ++X)
+		{
+			CountValue(Values[X]);
+		}
+		break;
+	}
+	case Vitruvio::EPRTPixelFormat::RGB8:
+	{
+		for (; X < Width; ++X)
+		{
+			CountValue(Src[X * 3]);
+		}
+		break;
+	}
+	case Vitruvio::EPRTPixelFormat::FLOAT32:
+	{
+		const float* Values = reinterpret_cast<const float*>(Src);
+		for (; X < Width; ++X)
+		{
+			Histogram.BlackPixels += Values[X] < BlackColorThreshold;
+			Histogram.WhitePixels += Values[X] > WhiteColorThreshold;
+		}
+		break;
+	}
+	default:
+		break;
+	}
+
+	int32 BlackCounts[4];
+	int32 WhiteCounts[4];
+	VectorIntStore(BlackLanes, BlackCounts);
+	VectorIntStore(WhiteLanes, WhiteCounts);
+	Histogram.BlackPixels += BlackCounts[0] + BlackCounts[1] + BlackCounts[2] + BlackCounts[3];
+	Histogram.WhitePixels += WhiteCounts[0] + WhiteCounts[1] + WhiteCounts[2] + WhiteCounts[3];
+}
+
+// Classifies the opacity of the source pixels, so that the blend mode of materials which use the texture as opacity map can be chosen
+// without reading back the texture
+Vitruvio::EOpacityClassification ComputeOpacityClassification(const Vitruvio::FTextureMetadata& TextureMetadata, const uint8* SrcData, size_t SrcRowSize)
+{
+	const int32 Width = static_cast<int32>(TextureMetadata.Width);
+	const int32 Height = static_cast<int32>(TextureMetadata.Height);
+	const double MaxValue = TextureMetadata.BytesPerBand == 2 ? 0xFFFF : 0xFF;
+	const int32 BlackLimit = FMath::CeilToInt32(BlackColorThreshold * MaxValue);
+	const int32 WhiteLimit = FMath::FloorToInt32(WhiteColorThreshold * MaxValue) + 1;
+
+	TArray<FOpacityHistogram> BlockHistograms;
+	BlockHistograms.SetNum(FMath::DivideAndRoundUp(Height, DecodeRowsPerBlock));
+	ParallelFor(BlockHistograms.Num(), [&](int32 BlockIndex) {
+		const int32 EndY = FMath::Min(Height, (BlockIndex + 1) * DecodeRowsPerBlock);
+		for (int32 Y = BlockIndex * DecodeRowsPerBlock; Y < EndY; ++Y)
+		{
+			CountOpacityRow(SrcData + Y * SrcRowSize, Width, TextureMetadata.PixelFormat, BlackLimit, WhiteLimit, BlockHistograms[BlockIndex]);
+		}
+	});
+
+	FOpacityHistogram Histogram;
+	for (const FOpacityHistogram& BlockHistogram : BlockHistograms)
+	{
+		Histogram.BlackPixels += BlockHistogram.BlackPixels;
+		Histogram.WhitePixels += BlockHistogram.WhitePixels;
+	}
+
+	const double TotalPixels = static_cast<double>(Width) * Height;
+	if (Histogram.WhitePixels >= TotalPixels * OpacityPixelsThreshold)
+	{
+		return Vitruvio::EOpacityClassification::Opaque;
+	}
+	if (Histogram.WhitePixels + Histogram.BlackPixels >= TotalPixels * OpacityPixelsThreshold)
+	{
+		return Vitruvio::EOpacityClassification::Masked;
+	}
+	return Vitruvio::EOpacityClassification::Translucent;
+}
 } // namespace
 
 namespace Vitruvio
@@ -120,83 +648,156 @@ EPixelFormat GetUnrealPixelFormat(EPRTPixelFormat PRTPixelFormat)
 	}
 }
 
+EOpacityClassification ClassifyOpacity(const FTextureMetadata& TextureMetadata, const uint8_t* Buffer)
+{
+	return ComputeOpacityClassification(TextureMetadata, Buffer, TextureMetadata.Width * TextureMetadata.Bands * TextureMetadata.BytesPerBand);
+}
+
+uint64 ComputeTextureContentHash(const FString& Key, const FTextureMetadata& TextureMetadata, const uint8_t* Buffer, size_t BufferSize)
+{
+	const EPixelFormat UnrealPixelFormat = GetUnrealPixelFormat(TextureMetadata.PixelFormat);
+	const FTextureSettings Settings = GetTextureSettings(Key, UnrealPixelFormat);
+	const EPixelFormat CompressedPixelFormat =
+		CVarTextureCompression.GetValueOnAnyThread() ? GetCompressedPixelFormat(Key, UnrealPixelFormat, TextureMetadata.Bands) : EPixelFormat::PF_Unknown;
+
+	const uint64 Dimensions[] = {TextureMetadata.Width, TextureMetadata.Height, TextureMetadata.BytesPerBand, TextureMetadata.Bands};
+	// Only opacity maps are classified, so they must not share textures decoded for other keys
+	const int32 Options[] = {static_cast<int32>(TextureMetadata.PixelFormat), static_cast<int32>(CompressedPixelFormat), Settings.SRGB,
+							 static_cast<int32>(Settings.Compression), CVarTextureMipMaps.GetValueOnAnyThread(),
+							 CVarTextureMaxResolution.GetValueOnAnyThread(), Key == TEXT("opacityMap")};
+
+	FXxHash64Builder Builder;
+	Builder.Update(Buffer, BufferSize);
+	Builder.Update(Dimensions, sizeof(Dimensions));
+	Builder.Update(Options, sizeof(Options));
+	return Builder.Finalize().Hash;
+}
+
 FTextureData DecodeTexture(UObject* Outer, const FString& Key, const FString& Path, const FTextureMetadata& TextureMetadata,
 						   std::unique_ptr<uint8_t[]> Buffer, size_t BufferSize)
 {
 	EPixelFormat UnrealPixelFormat = GetUnrealPixelFormat(TextureMetadata.PixelFormat);
 	check(UnrealPixelFormat != EPixelFormat::PF_Unknown);
 
-	const size_t BytesPerBand = FMath::Min<size_t>(2, TextureMetadata.BytesPerBand);
-	const bool bIsColor = (TextureMetadata.Bands >= 3);
+	const FDecodeRowFunction DecodeRow = GetDecodeRowFunction(TextureMetadata.PixelFormat);
+	const int32 Width = static_cast<int32>(TextureMetadata.Width);
+	const int32 Height = static_cast<int32>(TextureMetadata.Height);
+	const size_t SrcRowSize = TextureMetadata.Width * TextureMetadata.Bands * TextureMetadata.BytesPerBand;
+	const size_t DstRowSize = TextureMetadata.Width * GPixelFormats[UnrealPixelFormat].BlockBytes;
+	check(BufferSize >= SrcRowSize * TextureMetadata.Height);
+
+	const FTextureSettings Settings = GetTextureSettings(Key, UnrealPixelFormat);
+	const EPixelFormat CompressedPixelFormat =
+		CVarTextureCompression.GetValueOnAnyThread() ? GetCompressedPixelFormat(Key, UnrealPixelFormat, TextureMetadata.Bands) : EPixelFormat::PF_Unknown;
+	const bool bGenerateMips = CVarTextureMipMaps.GetValueOnAnyThread();
+	const int32 MaxResolution = CVarTextureMaxResolution.GetValueOnAnyThread();
+	const bool bAboveMaxResolution = MaxResolution > 0 && FMath::Max(Width, Height) > MaxResolution;
+
+	// The classification is only needed to choose the blend mode of materials which use the texture as opacity map
+	const Vitruvio::EOpacityClassification OpacityClassification = Key == TEXT("opacityMap")
+																	   ? ComputeOpacityClassification(TextureMetadata, Buffer.get(), SrcRowSize)
+																	   : Vitruvio::EOpacityClassification::Translucent;
 
-	size_t NewBufferSize = TextureMetadata.Width * TextureMetadata.Height * 4 * BytesPerBand;
-	auto NewBuffer = std::make_unique<uint8_t[]>(NewBufferSize);
+	auto DecodeImage = [DecodeRow, Width, Height, SrcRowSize, DstRowSize, SrcData = Buffer.get()](uint8* TextureData) {
+		ParallelFor(FMath::DivideAndRoundUp(Height, DecodeRowsPerBlock), [=](int32 BlockIndex) {
+			const int32 EndY = FMath::Min(Height, (BlockIndex + 1) * DecodeRowsPerBlock);
+			for (int32 Y = BlockIndex * DecodeRowsPerBlock; Y < EndY; ++Y)
+			{
+				DecodeRow(SrcData + (Height - Y - 1) * SrcRowSize, TextureData + Y * DstRowSize, Width);
+			}
+		});
+	};
 
-	for (int Y = 0; Y < TextureMetadata.Height; ++Y)
+	// Decode into intermediate mip levels if they need further processing, the levels above the max resolution are dropped
+	TArray<FMipLevel> Levels;
+	const bool bSingleUncompressedLevel = CompressedPixelFormat == EPixelFormat::PF_Unknown && !bGenerateMips && !bAboveMaxResolution;
+	if (!bSingleUncompressedLevel)
 	{
-		for (int X = 0; X < TextureMetadata.Width; ++X)
+		FMipLevel& BaseLevel = Levels.AddDefaulted_GetRef();
+		BaseLevel.Width = Width;
+		BaseLevel.Height = Height;
+		BaseLevel.Data.SetNumUninitialized(static_cast<int64>(DstRowSize) * Height);
+		DecodeImage(BaseLevel.Data.GetData());
+
+		while (Levels.Last().Width > 1 || Levels.Last().Height > 1)
 		{
-			if (TextureMetadata.PixelFormat == EPRTPixelFormat::FLOAT32)
+			const bool bLevelAboveMaxResolution = MaxResolution > 0 && FMath::Max(Levels.Last().Width, Levels.Last().Height) > MaxResolution;
+			if (!bGenerateMips && !bLevelAboveMaxResolution)
 			{
-				// Convert 32 bit grayscale float textures to 16 bit RGBA float textures
-				const int OldOffset = ((TextureMetadata.Height - Y - 1) * TextureMetadata.Width + X) * TextureMetadata.Bands;
-				const int NewOffset = (Y * TextureMetadata.Width + X);
-				const float* FloatBuffer = reinterpret_cast<const float*>(Buffer.get());
-				FFloat16Color* NewFloat16Buffer = reinterpret_cast<FFloat16Color*>(NewBuffer.get());
-				const float Float32Value = FloatBuffer[OldOffset];
-				const FFloat16 Float16Value(Float32Value);
-				FFloat16Color Color;
-				Color.R = Float16Value;
-				Color.G = Float16Value;
-				Color.B = Float16Value;
-				Color.A = FFloat16(1.0f);
-				NewFloat16Buffer[NewOffset] = Color;
+				break;
+			}
+
+			FMipLevel NextLevel = Downsample(Levels.Last(), UnrealPixelFormat);
+			if (bLevelAboveMaxResolution)
+			{
+				Levels.Last() = MoveTemp(NextLevel);
 			}
 			else
 			{
-				// Workaround: Also convert grayscale images to rgba, since texture params don't automatically update their sample method
-				const int OldOffset = ((TextureMetadata.Height - Y - 1) * TextureMetadata.Width + X) * TextureMetadata.Bands * BytesPerBand;
-				const int NewOffset = (Y * TextureMetadata.Width + X) * 4 * BytesPerBand;
-				for (int B = 0; B < BytesPerBand; ++B)
-				{
-					NewBuffer[NewOffset + 0 * BytesPerBand + B] = bIsColor ? Buffer[OldOffset + 2 + B] : Buffer[OldOffset + B];
-					NewBuffer[NewOffset + 1 * BytesPerBand + B] = bIsColor ? Buffer[OldOffset + 1 + B] : Buffer[OldOffset + B];
-					NewBuffer[NewOffset + 2 * BytesPerBand + B] = bIsColor ? Buffer[OldOffset + 0 + B] : Buffer[OldOffset + B];
-					NewBuffer[NewOffset + 3 * BytesPerBand + B] = (TextureMetadata.Bands == 4) ? Buffer[OldOffset + 3 + B] : 0;
-				}
+				Levels.Add(MoveTemp(NextLevel));
 			}
 		}
 	}
 
-	const FTextureSettings Settings = GetTextureSettings(Key, UnrealPixelFormat);
+	const EPixelFormat TexturePixelFormat = CompressedPixelFormat != EPixelFormat::PF_Unknown ? CompressedPixelFormat : UnrealPixelFormat;
+
+	FTexturePlatformData* PlatformData = new FTexturePlatformData();
+	PlatformData->SizeX = bSingleUncompressedLevel ? Width : Levels[0].Width;
+	PlatformData->SizeY = bSingleUncompressedLevel ? Height : Levels[0].Height;
+	PlatformData->PixelFormat = TexturePixelFormat;
 
-	const FString TextureBaseName = TEXT("T_") + FPaths::GetBaseFilename(Path);
-	const FName TextureName = MakeUniqueObjectName(GetTransientPackage(), UTexture2D::StaticClass(), *TextureBaseName);
-	UTexture2D* NewTexture = NewObject<UTexture2D>(GetTransientPackage(), TextureName, RF_Transient | RF_TextExportTransient | RF_DuplicateTransient);
+	if (bSingleUncompressedLevel)
+	{
+		// Allocate first mipmap and decode the pixel data directly into it, flipping the rows
+		FTexture2DMipMap* Mip = new FTexture2DMipMap();
+		PlatformData->Mips.Add(Mip);
+		Mip->SizeX = Width;
+		Mip->SizeY = Height;
+		Mip->BulkData.Lock(LOCK_READ_WRITE);
+		DecodeImage(static_cast<uint8*>(Mip->BulkData.Realloc(CalculateImageBytes(Width, Height, 0, UnrealPixelFormat))));
+		Mip->BulkData.Unlock();
+	}
+
+	for (const FMipLevel& Level : Levels)
+	{
+		FTexture2DMipMap* Mip = new FTexture2DMipMap();
+		PlatformData->Mips.Add(Mip);
+		Mip->SizeX = Level.Width;
+		Mip->SizeY = Level.Height;
+		Mip->BulkData.Lock(LOCK_READ_WRITE);
+		uint8* MipData = static_cast<uint8*>(Mip->BulkData.Realloc(CalculateImageBytes(Level.Width, Level.Height, 0, TexturePixelFormat)));
+		if (CompressedPixelFormat != EPixelFormat::PF_Unknown)
+		{
+			CompressLevel(Level, CompressedPixelFormat, MipData);
+		}
+		else
+		{
+			FMemory::Memcpy(MipData, Level.Data.GetData(), Level.Data.Num());
+		}
+		Mip->BulkData.Unlock();
+	}
+
+	// The texture is not referenced until the game thread creates a material instance with it, so it is rooted before the garbage
+	// collector can run again. The guard only covers the object creation, decoding above must not block garbage collection.
+	UTexture2D* NewTexture;
+	{
+		FGCScopeGuard GCGuard;
+		const FString TextureBaseName = TEXT("T_") + FPaths::GetBaseFilename(Path);
+		const FName TextureName = MakeUniqueObjectName(GetTransientPackage(), UTexture2D::StaticClass(), *TextureBaseName);
+		NewTexture = NewObject<UTexture2D>(GetTransientPackage(), TextureName, RF_Transient | RF_TextExportTransient | RF_DuplicateTransient);
+		NewTexture->AddToRoot();
+	}
 	NewTexture->CompressionSettings = Settings.Compression;
 	NewTexture->SRGB = Settings.SRGB;
-
-	FTexturePlatformData* PlatformData = new FTexturePlatformData();
-	PlatformData = new FTexturePlatformData();
-	PlatformData->SizeX = TextureMetadata.Width;
-	PlatformData->SizeY = TextureMetadata.Height;
-	PlatformData->PixelFormat = UnrealPixelFormat;
-
-	// Allocate first mipmap and upload the pixel data
-	FTexture2DMipMap* Mip = new FTexture2DMipMap();
-	PlatformData->Mips.Add(Mip);
-	Mip->SizeX = TextureMetadata.Width;
-	Mip->SizeY = TextureMetadata.Height;
-	Mip->BulkData.Lock(LOCK_READ_WRITE);
-	void* TextureData = Mip->BulkData.Realloc(CalculateImageBytes(TextureMetadata.Width, TextureMetadata.Height, 0, UnrealPixelFormat));
-	FMemory::Memcpy(TextureData, NewBuffer.get(), NewBufferSize);
-	Mip->BulkData.Unlock();
+	// The mips only exist in memory and can therefore not be streamed
+	NewTexture->NeverStream = true;
 
 	NewTexture->SetPlatformData(PlatformData);
 
 	NewTexture->UpdateResource();
 
-	const auto TimeStamp = FPlatformFileManager::Get().GetPlatformFile().GetAccessTimeStamp(*Path);
-	return FTextureData { NewTexture, static_cast<uint32>(TextureMetadata.Bands), TimeStamp };
+	FTextureData Result{NewTexture, static_cast<uint32>(TextureMetadata.Bands)};
+	Result.OpacityClassification = OpacityClassification;
+	return Result;
 }
 } // namespace Vitruvio
@@ -46,6 +46,17 @@ struct FTextureMetadata
 
 VITRUVIO_API FTextureMetadata ParseTextureMetadata(const prt::AttributeMap* TextureMetadata);
 
+/** Classifies the opacity of the pixel data of a texture in the layout of PRT, as it is done when decoding the texture. */
+VITRUVIO_API EOpacityClassification ClassifyOpacity(const FTextureMetadata& TextureMetadata, const uint8_t* Buffer);
+
+/**
+ * Computes a hash of the pixel data of a texture and of all settings which affect its decoding. Textures with the same hash therefore
+ * decode to identical textures, regardless of their uri.
+ */
+VITRUVIO_API uint64 ComputeTextureContentHash(const FString& Key, const FTextureMetadata& TextureMetadata, const uint8_t* Buffer,
+											  size_t BufferSize);
+
+/** Decodes the pixel data of a texture into a new texture, which is rooted until its caller removes it from the root set. */
 VITRUVIO_API FTextureData DecodeTexture(UObject* Outer, const FString& Key, const FString& Path, const FTextureMetadata& TextureMetadata,
 										std::unique_ptr<uint8_t[]> Buffer, size_t BufferSize);
 
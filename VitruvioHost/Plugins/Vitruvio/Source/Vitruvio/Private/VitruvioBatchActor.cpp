@@ -18,6 +18,26 @@
 #include "Materials/Material.h"
 #include "Runtime/CoreUObject/Public/UObject/ConstructorHelpers.h"
 #include "GenerateCompletedCallbackProxy.h"
+#include "Util/MaterialConsolidation.h"
+
+namespace
+{
+void ReleaseGeneratedTextures(const TArray<FString>& GeneratedTextures)
+{
+	if (GeneratedTextures.IsEmpty())
+	{
+		return;
+	}
+
+	if (VitruvioModule* Module = VitruvioModule::GetUnchecked())
+	{
+		for (const FString& Uri : GeneratedTextures)
+		{
+			Module->ReleaseGeneratedTexture(Uri);
+		}
+	}
+}
+} // namespace
 
 void UTile::MarkForAttributeEvaluation(UVitruvioComponent* VitruvioComponent, UGenerateCompletedCallbackProxy* CallbackProxy)
 {
@@ -91,6 +111,14 @@ TTuple<TArray<FInitialShape>, TArray<UVitruvioComponent*>> UTile::GetInitialShap
 	return GetInitialShapes([](UVitruvioComponent*) { return true; });
 }
 
+void UTile::BeginDestroy()
+{
+	ReleaseGeneratedTextures(GeneratedTextures);
+	GeneratedTextures.Empty();
+
+	Super::BeginDestroy();
+}
+
 void FGrid::MarkForAttributeEvaluation(UVitruvioComponent* VitruvioComponent, UGenerateCompletedCallbackProxy* CallbackProxy)
 {
 	if (UTile** FoundTile = TilesByComponent.Find(VitruvioComponent))
@@ -300,6 +328,33 @@ AVitruvioBatchActor::AVitruvioBatchActor()
 #endif // WITH_EDITORONLY_DATA
 }
 
+void AVitruvioBatchActor::BeginDestroy()
+{
+	if (VitruvioModule* Module = FModuleManager::GetModulePtr<VitruvioModule>("Vitruvio"))
+	{
+		Module->GetMaterialPipeline().OnPlaceholdersReplaced.Remove(PlaceholdersReplacedDelegate);
+	}
+	PlaceholdersReplacedDelegate.Reset();
+
+	// Generate results which have not been built yet still hold their atlases
+	{
+		FScopeLock QueueLock(&ProcessGenerateQueueCriticalSection);
+		FBatchGenerateQueueItem Item;
+		while (GenerateQueue.Dequeue(Item))
+		{
+			ReleaseGeneratedTextures(Item.GeneratedTextures);
+		}
+	}
+
+	Super::BeginDestroy();
+}
+
+void AVitruvioBatchActor::OnPlaceholdersReplaced(const TMap<UMaterialInterface*, UMaterialInterface*>& Replacements)
+{
+	ReplaceMaterialIdentifiers(MaterialIdentifiers, Replacements);
+	ReplaceMaterialIdentifiers(PendingMaterialIdentifiers, Replacements);
+}
+
 FIntPoint AVitruvioBatchActor::GetPosition(const UVitruvioComponent* VitruvioComponent) const
 {
 	const FVector Position = VitruvioComponent->GetOwner()->GetTransform().GetLocation();
@@ -314,21 +369,9 @@ void AVitruvioBatchActor::ProcessTiles()
 {
 	for (UTile* Tile : Grid.GetTilesMarkedForGenerate())
 	{
-		// Initialize and cleanup the model component
+		// Initialize the model component. An existing model stays visible until the new result has been built in ProcessGenerateQueue.
 		UGeneratedModelStaticMeshComponent* VitruvioModelComponent = Tile->GeneratedModelComponent;
-		if (VitruvioModelComponent)
-		{
-			VitruvioModelComponent->SetStaticMesh(nullptr);
-
-			// Cleanup old hierarchical instances
-			TArray<USceneComponent*> InstanceSceneComponents;
-			VitruvioModelComponent->GetChildrenComponents(true, InstanceSceneComponents);
-			for (USceneComponent* InstanceComponent : InstanceSceneComponents)
-			{
-				InstanceComponent->DestroyComponent(true);
-			}
-		}
-		else
+		if (!VitruvioModelComponent)
 		{
 			const FString TileName = FString::FromInt(NumModelComponents++);
 			VitruvioModelComponent = NewObject<UGeneratedModelStaticMeshComponent>(RootComponent, FName(TEXT("GeneratedModel") + TileName),
@@ -360,30 +403,46 @@ void AVitruvioBatchActor::ProcessTiles()
 				OccluderOnlyShapes = Grid.GetNeighboringShapes(Tile, InitialShapes);
 			}
 			
-			FBatchGenerateResult GenerateResult = VitruvioModule::Get().BatchGenerateAsync(MoveTemp(InitialShapes), bEnableOcclusionQueries, MoveTemp(OccluderOnlyShapes));
+			FBatchGenerateResult GenerateResult = VitruvioModule::Get().BatchGenerateAsync(MoveTemp(InitialShapes), bEnableOcclusionQueries, MoveTemp(OccluderOnlyShapes), OutputProfile);
 			
 			Tile->GenerateToken = GenerateResult.Token;
 			Tile->bIsGenerating = true;
 		
 			// clang-format off
-			GenerateResult.Result.Next([WeakThis = MakeWeakObjectPtr(this), Tile, InitialShapeVitruvioComponents](const FBatchGenerateResult::ResultType& Result)
+			GenerateResult.Result.Next([WeakThis = MakeWeakObjectPtr(this), Tile, InitialShapeVitruvioComponents, LodSettings = LodSettings, bMergeMaterials = bMergeMaterials](const FBatchGenerateResult::ResultType& Result)
 			{
-				if (!WeakThis.IsValid())
+				if (!WeakThis.IsValid() || Result.Token->IsInvalid())
 				{
 					return;
 				}
-				
+
+				FGenerateResultDescription GenerateResultDescription = Result.Value;
+				TArray<FString> GeneratedTextures;
+				if (bMergeMaterials)
+				{
+					GenerateResultDescription.GeneratedModel = Vitruvio::ConsolidateMaterials(GenerateResultDescription.GeneratedModel, GeneratedTextures);
+				}
+
+				GenerateLods(GenerateResultDescription, LodSettings);
+
+				// The generated model is not prepared by BatchGenerate, so that it is only prepared once after its materials have been merged
+				if (GenerateResultDescription.GeneratedModel)
+				{
+					GenerateResultDescription.GeneratedModel->PrepareBuild();
+				}
+
 				FScopeLock Lock(&Result.Token->Lock);
 
 				if (Result.Token->IsInvalid())
 				{
+					ReleaseGeneratedTextures(GeneratedTextures);
 					return;
 				}
 
 				Tile->GenerateToken.Reset();
 
 				FScopeLock QueueLock(&WeakThis->ProcessGenerateQueueCriticalSection);
-				WeakThis->GenerateQueue.Enqueue({Result.Value, Tile, InitialShapeVitruvioComponents});
+				WeakThis->GenerateQueue.Enqueue({MoveTemp(GenerateResultDescription), Tile, InitialShapeVitruvioComponents, MoveTemp(GeneratedTextures)});
 			});
 			// clang-format on
 		}
@@ -436,11 +495,41 @@ void AVitruvioBatchActor::ProcessGenerateQueue()
 	
 	if (!GenerateQueue.IsEmpty())
 	{
-		FBatchGenerateQueueItem Item;
-		GenerateQueue.Dequeue(Item);
+		FBatchGenerateQueueItem* PendingItem = GenerateQueue.Peek();
 
 		ProcessGenerateQueueCriticalSection.Unlock();
 
+		if (!bBuildingGenerateResult)
+		{
+			if (!PlaceholdersReplacedDelegate.IsValid())
+			{
+				PlaceholdersReplacedDelegate =
+					VitruvioModule::Get().GetMaterialPipeline().OnPlaceholdersReplaced.AddUObject(this, &AVitruvioBatchActor::OnPlaceholdersReplaced);
+			}
+
+			PendingMaterialIdentifiers.Empty();
+			PendingUniqueMaterialIdentifiers.Empty();
+			bBuildingGenerateResult = true;
+		}
+
+		// Build the tile meshes time sliced. The previously generated tile and its material identifiers stay in use until all meshes have been built.
+		if (!BuildGenerateResultMeshes(PendingItem->GenerateResultDescription, VitruvioModule::Get().GetMaterialCache(),
+									   VitruvioModule::Get().GetTextureCache(), PendingMaterialIdentifiers, PendingUniqueMaterialIdentifiers,
+									   OpaqueParent, MaskedParent, TranslucentParent, GetWorld(), GetMeshBuildFrameEndTime()))
+		{
+			return;
+		}
+
+		bBuildingGenerateResult = false;
+		MaterialIdentifiers = MoveTemp(PendingMaterialIdentifiers);
+		UniqueMaterialIdentifiers = MoveTemp(PendingUniqueMaterialIdentifiers);
+
+		FBatchGenerateQueueItem Item;
+		{
+			FScopeLock QueueLock(&ProcessGenerateQueueCriticalSection);
+			GenerateQueue.Dequeue(Item);
+		}
+
 		if (Item.GenerateResultDescription.EvaluatedAttributes.Num() ==  Item.VitruvioComponents.Num())
 		{
 			for (int ComponentIndex = 0; ComponentIndex < Item.VitruvioComponents.Num(); ++ComponentIndex)
@@ -458,9 +547,19 @@ void AVitruvioBatchActor::ProcessGenerateQueue()
 	VitruvioModule::Get().GetMaterialCache(), VitruvioModule::Get().GetTextureCache(),
 				MaterialIdentifiers, UniqueMaterialIdentifiers, OpaqueParent, MaskedParent, TranslucentParent, GetWorld());
 
+		Item.Tile->LazyCollisionMeshes = CreateCollision(ConvertedResult, CollisionSettings.Policy);
+
+		// The previous model of the tile has been replaced, so its atlases are not needed anymore
+		ReleaseGeneratedTextures(Item.Tile->GeneratedTextures);
+		Item.Tile->GeneratedTextures = MoveTemp(Item.GeneratedTextures);
+		const ECollisionEnabled::Type CollisionEnabled =
+			CollisionSettings.Policy == EVitruvioCollisionPolicy::None ? ECollisionEnabled::NoCollision : ECollisionEnabled::QueryAndPhysics;
+		VitruvioModelComponent->SetCollisionEnabled(CollisionEnabled);
+
 		if (ConvertedResult.ShapeMesh)
 		{
 			VitruvioModelComponent->SetStaticMesh(ConvertedResult.ShapeMesh->GetStaticMesh());
+			ConvertedResult.ShapeMesh->AddUser(VitruvioModelComponent);
 			
 			// Reset Material replacements
 			for (int32 MaterialIndex = 0; MaterialIndex < VitruvioModelComponent->GetNumMaterials(); ++MaterialIndex)
@@ -469,6 +568,11 @@ void AVitruvioBatchActor::ProcessGenerateQueue()
 			}
 
 			ApplyMaterialReplacements(VitruvioModelComponent, MaterialIdentifiers, MaterialReplacement);
+			VitruvioModule::Get().GetMaterialPipeline().GameThread_TrackComponent(VitruvioModelComponent);
+		}
+		else
+		{
+			VitruvioModelComponent->SetStaticMesh(nullptr);
 		}
 
 		// Cleanup old hierarchical instances
@@ -491,21 +595,20 @@ void AVitruvioBatchActor::ProcessGenerateQueue()
 			FString UniqueName = UniqueComponentName(Instance.Name, NameMap);
 			auto InstancedComponent = NewObject<UGeneratedModelHISMComponent>(VitruvioModelComponent, FName(UniqueName),
 																			  RF_Transient | RF_TextExportTransient | RF_DuplicateTransient);
-			const TArray<FTransform>& Transforms = Instance.Transforms;
 			InstancedComponent->SetStaticMesh(Instance.InstanceMesh->GetStaticMesh());
+			Instance.InstanceMesh->AddUser(InstancedComponent);
 			InstancedComponent->SetMeshIdentifier(Instance.InstanceMesh->GetIdentifier());
+			InstancedComponent->SetCollisionEnabled(CollisionEnabled);
 			
-			// Add all instance transforms
-			for (const FTransform& Transform : Transforms)
-			{
-				InstancedComponent->AddInstance(Transform);
-			}
+			// Add all instance transforms and their custom data
+			AddInstances(InstancedComponent, Instance);
 
 			// Apply override materials
 			for (int32 MaterialIndex = 0; MaterialIndex < Instance.OverrideMaterials.Num(); ++MaterialIndex)
 			{
 				InstancedComponent->SetMaterial(MaterialIndex, Instance.OverrideMaterials[MaterialIndex]);
 			}
+			VitruvioModule::Get().GetMaterialPipeline().GameThread_TrackComponent(InstancedComponent);
 
 			// Attach and register instance component
 			InstancedComponent->AttachToComponent(VitruvioModelComponent, FAttachmentTransformRules::KeepRelativeTransform);
@@ -570,12 +673,37 @@ void AVitruvioBatchActor::ProcessAttributeEvaluationQueue()
 	}
 }
 
+void AVitruvioBatchActor::ProcessLazyCollision()
+{
+	for (const auto& [Location, Tile] : Grid.Tiles)
+	{
+		if (Tile->LazyCollisionMeshes.IsEmpty() || !Tile->GeneratedModelComponent)
+		{
+			continue;
+		}
+
+		FBox TileBounds = Tile->GeneratedModelComponent->Bounds.GetBox();
+		TArray<USceneComponent*> ChildComponents;
+		Tile->GeneratedModelComponent->GetChildrenComponents(true, ChildComponents);
+		for (const USceneComponent* ChildComponent : ChildComponents)
+		{
+			TileBounds += ChildComponent->Bounds.GetBox();
+		}
+
+		if (CreateLazyCollision(Tile->LazyCollisionMeshes, GetWorld(), TileBounds, CollisionSettings.CookDistance))
+		{
+			Tile->LazyCollisionMeshes.Empty();
+		}
+	}
+}
+
 void AVitruvioBatchActor::Tick(float DeltaSeconds)
 {
 	ProcessTiles();
 	
 	ProcessAttributeEvaluationQueue();
 	ProcessGenerateQueue();
+	ProcessLazyCollision();
 }
 
 void AVitruvioBatchActor::RegisterVitruvioComponent(UVitruvioComponent* VitruvioComponent, bool bGenerateModel)
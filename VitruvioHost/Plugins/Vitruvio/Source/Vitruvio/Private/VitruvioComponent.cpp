@@ -24,6 +24,7 @@
 #include "VitruvioModule.h"
 #include "VitruvioTypes.h"
 
+#include "Algo/AnyOf.h"
 #include "Algo/Transform.h"
 #include "Components/HierarchicalInstancedStaticMeshComponent.h"
 #include "Components/SplineComponent.h"
@@ -39,11 +40,51 @@ DEFINE_LOG_CATEGORY(LogVitruvioComponent);
 
 TAutoConsoleVariable<float> CVarInterOcclusionNeighborQueryDistance(TEXT("Esri.Vitruvio.InterOcclusionNeighborQueryDistance"), 10000.0f, TEXT("The distance in cm to query for inter-occlusion neighbors."));
 
+TAutoConsoleVariable<float> CVarMeshBuildFrameBudget(TEXT("Esri.Vitruvio.MeshBuildFrameBudget"), 5.0f,
+	TEXT("The time in ms per frame which is spent building generated meshes on the game thread (0 builds all meshes of a result at once)."));
+
+TAutoConsoleVariable<bool> CVarInstanceColorCustomData(TEXT("Esri.Vitruvio.InstanceColorCustomData"), false,
+	TEXT("Store the diffuse colors of instance material overrides in the per instance custom data, so that instances of the same mesh which only ")
+	TEXT("differ by their colors share one instanced component. Requires parent materials which multiply the diffuse color with the three ")
+	TEXT("custom data floats starting at the scalar parameter instanceColorIndex (if it is not negative)."));
+
 namespace
 {
 
 int64 InitialShapeCounter;
 
+/**
+ * Replaces the diffuse colors of material overrides by white and records the index of the colors in the per instance custom data, so that
+ * overrides which only differ by their colors become equal.
+ *
+ * \return the custom data of the instances using the material overrides (three floats per override) or an empty array if no override has a
+ * diffuse color.
+ */
+TArray<float> SplitInstanceColorVariants(TArray<Vitruvio::FMaterialAttributeContainer>& MaterialOverrides)
+{
+	TArray<float> CustomData;
+	bool bHasColors = false;
+	for (Vitruvio::FMaterialAttributeContainer& MaterialOverride : MaterialOverrides)
+	{
+		const int32 ColorIndex = CustomData.Num();
+		FLinearColor Color = FLinearColor::White;
+
+		Vitruvio::FMaterialAttributes Attributes = MaterialOverride.CopyAttributes();
+		if (FLinearColor* DiffuseColor = Attributes.ColorProperties.Find(TEXT("diffuseColor")))
+		{
+			Color = *DiffuseColor;
+			*DiffuseColor = FLinearColor::White;
+			Attributes.ScalarProperties.Add(TEXT("instanceColorIndex"), ColorIndex);
+			MaterialOverride = Vitruvio::FMaterialAttributeContainer(MoveTemp(Attributes), MaterialOverride.Name);
+			bHasColors = true;
+		}
+
+		CustomData.Append({Color.R, Color.G, Color.B});
+	}
+
+	return bHasColors ? CustomData : TArray<float>();
+}
+
 bool ToBool(const FString& Value)
 {
 	if (Value.ToLower() == "true")
@@ -273,9 +314,13 @@ void ApplyMaterialReplacements(UStaticMeshComponent* StaticMeshComponent, const
 	for (int32 MaterialIndex = 0; MaterialIndex < StaticMeshComponent->GetNumMaterials(); ++MaterialIndex)
 	{
 		const UMaterialInterface* SourceMaterial = StaticMeshComponent->GetMaterial(MaterialIndex);
-		FString MaterialIdentifier = MaterialIdentifiers[SourceMaterial];
+		const FString* MaterialIdentifier = MaterialIdentifiers.Find(SourceMaterial);
+		if (!MaterialIdentifier)
+		{
+			continue;
+		}
 
-		if (UMaterialInterface** Result = ReplacementMaterials.Find(MaterialIdentifier))
+		if (UMaterialInterface** Result = ReplacementMaterials.Find(*MaterialIdentifier))
 		{
 			UMaterialInterface* ReplacementMaterial = *Result;
 			StaticMeshComponent->SetMaterial(MaterialIndex, ReplacementMaterial);
@@ -283,6 +328,19 @@ void ApplyMaterialReplacements(UStaticMeshComponent* StaticMeshComponent, const
 	}
 }
 
+void ReplaceMaterialIdentifiers(TMap<UMaterialInterface*, FString>& MaterialIdentifiers,
+								const TMap<UMaterialInterface*, UMaterialInterface*>& Replacements)
+{
+	for (const auto& [Placeholder, Material] : Replacements)
+	{
+		FString MaterialIdentifier;
+		if (MaterialIdentifiers.RemoveAndCopyValue(Placeholder, MaterialIdentifier))
+		{
+			MaterialIdentifiers.Add(Material, MoveTemp(MaterialIdentifier));
+		}
+	}
+}
+
 TSet<FInstance> ApplyInstanceReplacements(UGeneratedModelStaticMeshComponent* GeneratedModelComponent, 
 											  const TArray<FInstance>& Instances, UInstanceReplacementAsset* Replacement, TMap<FString, int32>& NameMap)
 {
@@ -342,9 +400,11 @@ TSet<FInstance> ApplyInstanceReplacements(UGeneratedModelStaticMeshComponent* Ge
 				return FVector{RandX, RandY, RandZ};
 			};
 
-			TMap<int, TArray<FTransform>>  ModifiedTransforms;
-			for (const FTransform& Transform : Instance.Transforms)
+			// The replaced instances keep their per instance custom data (see Esri.Vitruvio.InstanceColorCustomData)
+			TMap<int, FInstance> ReplacementInstances;
+			for (int32 TransformIndex = 0; TransformIndex < Instance.Transforms.Num(); ++TransformIndex)
 			{
+				const FTransform& Transform = Instance.Transforms[TransformIndex];
 				const float RandomProbability = FMath::RandRange(0.0f, CumulativeProbability);
 				const int ComponentIndex = Algo::LowerBound(CumulativeProbabilities, RandomProbability);
 
@@ -368,13 +428,19 @@ TSet<FInstance> ApplyInstanceReplacements(UGeneratedModelStaticMeshComponent* Ge
 					ModifiedTransform.SetRotation(FQuat::MakeFromEuler(RandomVector(ReplacementOption.MinRotation, ReplacementOption.MaxRotation)));
 				}
 
-				ModifiedTransforms.FindOrAdd(ComponentIndex).Add(ModifiedTransform);
-				
+				FInstance& ReplacementInstance = ReplacementInstances.FindOrAdd(ComponentIndex);
+				ReplacementInstance.Transforms.Add(ModifiedTransform);
+				if (Instance.NumCustomDataFloats > 0)
+				{
+					ReplacementInstance.NumCustomDataFloats = Instance.NumCustomDataFloats;
+					ReplacementInstance.CustomData.Append(Instance.CustomData.GetData() + TransformIndex * Instance.NumCustomDataFloats,
+														  Instance.NumCustomDataFloats);
+				}
 			}
 
-			for (const auto& [ComponentIndex, Transforms] : ModifiedTransforms)
+			for (const auto& [ComponentIndex, ReplacementInstance] : ReplacementInstances)
 			{
-				InstancedComponents[ComponentIndex]->AddInstances(Transforms, false);
+				AddInstances(InstancedComponents[ComponentIndex], ReplacementInstance);
 			}
 
 			Replaced.Add(Instance);
@@ -383,52 +449,235 @@ TSet<FInstance> ApplyInstanceReplacements(UGeneratedModelStaticMeshComponent* Ge
 	return Replaced;
 }
 
-FConvertedGenerateResult BuildGenerateResult(const FGenerateResultDescription& GenerateResult,
-									 TMap<Vitruvio::FMaterialAttributeContainer, TObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
-									 TMap<FString, Vitruvio::FTextureData>& TextureCache,
-									 TMap<UMaterialInterface*, FString>& MaterialIdentifiers,
-									 TMap<FString, int32>& UniqueMaterialIdentifiers,
-									 UMaterial* OpaqueParent, UMaterial* MaskedParent, UMaterial* TranslucentParent,
-									 UWorld* World)
+void GenerateLods(const FGenerateResultDescription& GenerateResult, const FVitruvioLodSettings& LodSettings)
 {
-	MaterialIdentifiers.Empty();
-	UniqueMaterialIdentifiers.Empty();
+	if (!LodSettings.bGenerateLods)
+	{
+		return;
+	}
+
+#if !WITH_EDITOR
+	// The mesh reduction module is not part of packaged builds, so the setting would otherwise silently do nothing
+	UE_CALL_ONCE([] { UE_LOG(LogVitruvioComponent, Warning, TEXT("Generate LODs is only supported in editor builds and is ignored.")); });
+	return;
+#else
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_VitruvioActor_GenerateLods);
+
+	const int32 NumLods = FMath::Clamp(LodSettings.NumLods, 1, 3);
+	TArray<float> ReductionPercentages;
+	TArray<float> ScreenSizes;
+	for (int32 LodIndex = 0; LodIndex < NumLods; ++LodIndex)
+	{
+		ReductionPercentages.Add(LodSettings.ReductionPercentages[LodIndex]);
+		ScreenSizes.Add(LodSettings.ScreenSizes[LodIndex]);
+	}
 
-	// Build all meshes
 	if (GenerateResult.GeneratedModel)
 	{
-		GenerateResult.GeneratedModel->Build(TEXT("GeneratedModel"), MaterialCache, TextureCache, MaterialIdentifiers, UniqueMaterialIdentifiers,
-			OpaqueParent, MaskedParent, TranslucentParent, World);
+		GenerateResult.GeneratedModel->GenerateLods(ReductionPercentages, ScreenSizes);
+	}
+
+	for (const auto& [Identifier, InstanceMesh] : GenerateResult.InstanceMeshes)
+	{
+		InstanceMesh->GenerateLods(ReductionPercentages, ScreenSizes);
+	}
+#endif
+}
+
+TArray<TSharedPtr<FVitruvioMesh>> CreateCollision(const FConvertedGenerateResult& Result, EVitruvioCollisionPolicy Policy)
+{
+	TArray<TSharedPtr<FVitruvioMesh>> Meshes;
+	if (Result.ShapeMesh)
+	{
+		Meshes.Add(Result.ShapeMesh);
+	}
+	for (const FInstance& Instance : Result.Instances)
+	{
+		Meshes.AddUnique(Instance.InstanceMesh);
+	}
+
+	switch (Policy)
+	{
+	case EVitruvioCollisionPolicy::None:
+		return {};
+	case EVitruvioCollisionPolicy::Lazy:
+		return Meshes.FilterByPredicate([](const TSharedPtr<FVitruvioMesh>& Mesh) { return !Mesh->HasCollision(); });
+	case EVitruvioCollisionPolicy::Sync:
+	case EVitruvioCollisionPolicy::Async:
+	case EVitruvioCollisionPolicy::Simplified:
+		for (const TSharedPtr<FVitruvioMesh>& Mesh : Meshes)
+		{
+			Mesh->CreateCollision(Policy == EVitruvioCollisionPolicy::Simplified, Policy == EVitruvioCollisionPolicy::Async);
+		}
+		return {};
+	}
+
+	return {};
+}
+
+bool CreateLazyCollision(const TArray<TSharedPtr<FVitruvioMesh>>& Meshes, const UWorld* World, const FBox& Bounds, float CookDistance)
+{
+	if (!World || !Bounds.IsValid)
+	{
+		return false;
+	}
+
+	const bool bIsInCookDistance = Algo::AnyOf(World->ViewLocationsRenderedLastFrame, [&Bounds, CookDistance](const FVector& ViewLocation) {
+		return Bounds.ComputeSquaredDistanceToPoint(ViewLocation) <= FMath::Square(CookDistance);
+	});
+
+	if (!bIsInCookDistance)
+	{
+		return false;
+	}
+
+	for (const TSharedPtr<FVitruvioMesh>& Mesh : Meshes)
+	{
+		Mesh->CreateCollision(false, true);
+	}
+
+	return true;
+}
+
+bool BuildGenerateResultMeshes(const FGenerateResultDescription& GenerateResult,
+							   TMap<Vitruvio::FMaterialAttributeContainer, TWeakObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
+							   FTextureCache& TextureCache,
+							   TMap<UMaterialInterface*, FString>& MaterialIdentifiers,
+							   TMap<FString, int32>& UniqueMaterialIdentifiers,
+							   UMaterial* OpaqueParent, UMaterial* MaskedParent, UMaterial* TranslucentParent,
+							   UWorld* World, double EndTime)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(STAT_VitruvioActor_BuildMeshes);
+
+	bool bBuiltMesh = false;
+	auto BuildMesh = [&](const TSharedPtr<FVitruvioMesh>& Mesh, const FString& Name) {
+		if (Mesh->IsBuilt())
+		{
+			return true;
+		}
+
+		if (bBuiltMesh && FPlatformTime::Seconds() > EndTime)
+		{
+			return false;
+		}
+
+		Mesh->Build(Name, MaterialCache, TextureCache, MaterialIdentifiers, UniqueMaterialIdentifiers, OpaqueParent, MaskedParent,
+					TranslucentParent, World);
+		bBuiltMesh = true;
+		return true;
+	};
+
+	if (GenerateResult.GeneratedModel && !BuildMesh(GenerateResult.GeneratedModel, TEXT("GeneratedModel")))
+	{
+		return false;
 	}
 
 	for (const auto& IdAndMesh : GenerateResult.InstanceMeshes)
 	{
-		FString Name = GenerateResult.InstanceNames[IdAndMesh.Key];
-		IdAndMesh.Value->Build(Name, MaterialCache, TextureCache, MaterialIdentifiers, UniqueMaterialIdentifiers,
-			OpaqueParent, MaskedParent, TranslucentParent, World);
+		if (!BuildMesh(IdAndMesh.Value, GenerateResult.InstanceNames[IdAndMesh.Key]))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+double GetMeshBuildFrameEndTime()
+{
+	check(IsInGameThread());
+
+	static uint64 BudgetFrameCounter = TNumericLimits<uint64>::Max();
+	static double BudgetEndTime = 0.0;
+
+	if (BudgetFrameCounter != GFrameCounter)
+	{
+		BudgetFrameCounter = GFrameCounter;
+
+		const float Budget = CVarMeshBuildFrameBudget.GetValueOnGameThread();
+		BudgetEndTime = Budget > 0.0f ? FPlatformTime::Seconds() + Budget / 1000.0 : TNumericLimits<double>::Max();
 	}
 
-	// Convert instances
+	return BudgetEndTime;
+}
+
+FConvertedGenerateResult BuildGenerateResult(const FGenerateResultDescription& GenerateResult,
+									 TMap<Vitruvio::FMaterialAttributeContainer, TWeakObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
+									 FTextureCache& TextureCache,
+									 TMap<UMaterialInterface*, FString>& MaterialIdentifiers,
+									 TMap<FString, int32>& UniqueMaterialIdentifiers,
+									 UMaterial* OpaqueParent, UMaterial* MaskedParent, UMaterial* TranslucentParent,
+									 UWorld* World)
+{
+	// Build all remaining meshes (usually they have already been built time sliced using BuildGenerateResultMeshes)
+	BuildGenerateResultMeshes(GenerateResult, MaterialCache, TextureCache, MaterialIdentifiers, UniqueMaterialIdentifiers, OpaqueParent,
+							  MaskedParent, TranslucentParent, World);
+
+	// Convert instances. Instances whose material overrides only differ by their colors are merged if the colors are stored in the per
+	// instance custom data.
+	const bool bInstanceColorCustomData = CVarInstanceColorCustomData.GetValueOnGameThread();
 	TArray<FInstance> Instances;
+	TMap<Vitruvio::FInstanceCacheKey, int32> MergedInstanceIndices;
 	for (const auto& [Key, Transform] : GenerateResult.Instances)
 	{
-		const TSharedPtr<FVitruvioMesh>& VitruvioMesh = GenerateResult.InstanceMeshes[Key.MeshId];
-		const FString MeshName = GenerateResult.InstanceNames[Key.MeshId];
-		TArray<UMaterialInstanceDynamic*> OverrideMaterials;
+		Vitruvio::FInstanceCacheKey InstanceKey = Key;
+		const TArray<float> CustomData = bInstanceColorCustomData ? SplitInstanceColorVariants(InstanceKey.MaterialOverrides) : TArray<float>();
 
-		for (size_t MaterialIndex = 0; MaterialIndex < Key.MaterialOverrides.Num(); ++MaterialIndex)
+		int32 InstanceIndex = INDEX_NONE;
+		if (const int32* MergedInstanceIndex = CustomData.IsEmpty() ? nullptr : MergedInstanceIndices.Find(InstanceKey))
 		{
-			const Vitruvio::FMaterialAttributeContainer& MaterialContainer = Key.MaterialOverrides[MaterialIndex];
-			OverrideMaterials.Add(CacheMaterial(OpaqueParent, MaskedParent, TranslucentParent, TextureCache, MaterialCache, MaterialContainer,
-												UniqueMaterialIdentifiers, MaterialIdentifiers, VitruvioMesh->GetStaticMesh()));
+			InstanceIndex = *MergedInstanceIndex;
+			Instances[InstanceIndex].Transforms.Append(Transform);
 		}
+		else
+		{
+			const TSharedPtr<FVitruvioMesh>& VitruvioMesh = GenerateResult.InstanceMeshes[InstanceKey.MeshId];
+			const FString MeshName = GenerateResult.InstanceNames[InstanceKey.MeshId];
+			TArray<UMaterialInstanceDynamic*> OverrideMaterials;
 
-		Instances.Add({MeshName, VitruvioMesh, OverrideMaterials, Transform});
+			for (size_t MaterialIndex = 0; MaterialIndex < InstanceKey.MaterialOverrides.Num(); ++MaterialIndex)
+			{
+				const Vitruvio::FMaterialAttributeContainer& MaterialContainer = InstanceKey.MaterialOverrides[MaterialIndex];
+				OverrideMaterials.Add(CacheMaterial(OpaqueParent, MaskedParent, TranslucentParent, TextureCache, MaterialCache, MaterialContainer,
+													UniqueMaterialIdentifiers, MaterialIdentifiers, VitruvioMesh->GetStaticMesh()));
+			}
+
+			InstanceIndex = Instances.Add({MeshName, VitruvioMesh, OverrideMaterials, Transform});
+			if (!CustomData.IsEmpty())
+			{
+				Instances[InstanceIndex].NumCustomDataFloats = CustomData.Num();
+				MergedInstanceIndices.Add(MoveTemp(InstanceKey), InstanceIndex);
+			}
+		}
+
+		if (!CustomData.IsEmpty())
+		{
+			for (int32 TransformIndex = 0; TransformIndex < Transform.Num(); ++TransformIndex)
+			{
+				Instances[InstanceIndex].CustomData.Append(CustomData);
+			}
+		}
 	}
 
 	return {GenerateResult.GeneratedModel, Instances, GenerateResult.Reports};
 }
 
+void AddInstances(UInstancedStaticMeshComponent* InstancedComponent, const FInstance& Instance)
+{
+	InstancedComponent->SetNumCustomDataFloats(Instance.NumCustomDataFloats);
+
+	for (int32 TransformIndex = 0; TransformIndex < Instance.Transforms.Num(); ++TransformIndex)
+	{
+		const int32 InstanceIndex = InstancedComponent->AddInstance(Instance.Transforms[TransformIndex]);
+		if (Instance.NumCustomDataFloats > 0)
+		{
+			InstancedComponent->SetCustomData(InstanceIndex,
+											  MakeArrayView(Instance.CustomData.GetData() + TransformIndex * Instance.NumCustomDataFloats,
+															Instance.NumCustomDataFloats));
+		}
+	}
+}
+
 FString UniqueComponentName(const FString& Name, TMap<FString, int32>& UsedNames)
 {
 	FString CurrentName = Name;
@@ -904,10 +1153,37 @@ void UVitruvioComponent::ProcessGenerateQueue()
 	{
 		RemoveGeneratedMeshes();
 		GenerateQueue.Empty();
+		bBuildingGenerateResult = false;
 		return;
 	}
-		
-	// Get from queue and build meshes
+
+	FGenerateQueueItem* PendingResult = GenerateQueue.Peek();
+	if (!bBuildingGenerateResult)
+	{
+		if (!PlaceholdersReplacedDelegate.IsValid())
+		{
+			PlaceholdersReplacedDelegate =
+				VitruvioModule::Get().GetMaterialPipeline().OnPlaceholdersReplaced.AddUObject(this, &UVitruvioComponent::OnPlaceholdersReplaced);
+		}
+
+		PendingMaterialIdentifiers.Empty();
+		PendingUniqueMaterialIdentifiers.Empty();
+		bBuildingGenerateResult = true;
+	}
+
+	// Build the meshes time sliced. The previously generated model and its material identifiers stay in use until all meshes have been built.
+	if (!BuildGenerateResultMeshes(PendingResult->GenerateResultDescription, VitruvioModule::Get().GetMaterialCache(),
+								   VitruvioModule::Get().GetTextureCache(), PendingMaterialIdentifiers, PendingUniqueMaterialIdentifiers,
+								   OpaqueParent, MaskedParent, TranslucentParent, GetWorld(), GetMeshBuildFrameEndTime()))
+	{
+		return;
+	}
+
+	bBuildingGenerateResult = false;
+	MaterialIdentifiers = MoveTemp(PendingMaterialIdentifiers);
+	UniqueMaterialIdentifiers = MoveTemp(PendingUniqueMaterialIdentifiers);
+
+	// Get from queue and finalize the generated model
 	FGenerateQueueItem Result;
 	GenerateQueue.Dequeue(Result);
 
@@ -917,6 +1193,10 @@ VitruvioModule::Get().GetMaterialCache(), VitruvioModule::Get().GetTextureCache(
 
 	Reports = ConvertedResult.Reports;
 
+	LazyCollisionMeshes = CreateCollision(ConvertedResult, CollisionSettings.Policy);
+	const ECollisionEnabled::Type CollisionEnabled =
+		CollisionSettings.Policy == EVitruvioCollisionPolicy::None ? ECollisionEnabled::NoCollision : ECollisionEnabled::QueryAndPhysics;
+
 	QUICK_SCOPE_CYCLE_COUNTER(STAT_VitruvioActor_CreateModelActors);
 
 	UGeneratedModelStaticMeshComponent* VitruvioModelComponent = nullptr;
@@ -954,9 +1234,12 @@ VitruvioModule::Get().GetMaterialCache(), VitruvioModule::Get().GetTextureCache(
 		VitruvioModelComponent->RegisterComponent();
 	}
 
+	VitruvioModelComponent->SetCollisionEnabled(CollisionEnabled);
+
 	if (ConvertedResult.ShapeMesh)
 	{
 		VitruvioModelComponent->SetStaticMesh(ConvertedResult.ShapeMesh->GetStaticMesh());
+		ConvertedResult.ShapeMesh->AddUser(VitruvioModelComponent);
 		VitruvioModelComponent->RecreatePhysicsState();
 		
 		// Reset Material replacements
@@ -969,6 +1252,8 @@ VitruvioModule::Get().GetMaterialCache(), VitruvioModule::Get().GetTextureCache(
 		{
 			ApplyMaterialReplacements(VitruvioModelComponent, MaterialIdentifiers, MaterialReplacement);
 		}
+
+		VitruvioModule::Get().GetMaterialPipeline().GameThread_TrackComponent(VitruvioModelComponent);
 	}
 	else
 	{
@@ -996,15 +1281,13 @@ VitruvioModule::Get().GetMaterialCache(), VitruvioModule::Get().GetTextureCache(
 		
 		UStaticMesh* StaticMesh = Instance.InstanceMesh->GetStaticMesh();
 		InstancedComponent->SetStaticMesh(StaticMesh);
+		Instance.InstanceMesh->AddUser(InstancedComponent);
 		InstancedComponent->SetMeshIdentifier(Instance.InstanceMesh->GetIdentifier());
+		InstancedComponent->SetCollisionEnabled(CollisionEnabled);
 		InstancedComponent->RecreatePhysicsState();
 
-		// Add all instance transforms
-		const TArray<FTransform>& Transforms = Instance.Transforms;
-		for (const FTransform& Transform : Transforms)
-		{
-			InstancedComponent->AddInstance(Transform);
-		}
+		// Add all instance transforms and their custom data
+		AddInstances(InstancedComponent, Instance);
 
 		// Apply override materials
 		for (int32 MaterialIndex = 0; MaterialIndex < Instance.OverrideMaterials.Num(); ++MaterialIndex)
@@ -1023,6 +1306,8 @@ VitruvioModule::Get().GetMaterialCache(), VitruvioModule::Get().GetTextureCache(
 		{
 			ApplyMaterialReplacements(InstancedComponent, MaterialIdentifiers, MaterialReplacement);
 		}
+
+		VitruvioModule::Get().GetMaterialPipeline().GameThread_TrackComponent(InstancedComponent);
 	}
 
 	OnHierarchyChanged.Broadcast(this);
@@ -1080,6 +1365,12 @@ void UVitruvioComponent::TickComponent(float DeltaTime, ELevelTick TickType, FAc
 	ProcessGenerateQueue();
 	ProcessAttributesEvaluationQueue();
 
+	if (!LazyCollisionMeshes.IsEmpty() && CreateLazyCollision(LazyCollisionMeshes, GetWorld(),
+		GetOwner()->GetComponentsBoundingBox(true, true), CollisionSettings.CookDistance))
+	{
+		LazyCollisionMeshes.Empty();
+	}
+
 	if (bNotifyAttributeChange)
 	{
 		NotifyAttributesChanged();
@@ -1111,6 +1402,7 @@ void UVitruvioComponent::RemoveGeneratedMeshes()
 	}
 
 	bHasGeneratedModel = false;
+	LazyCollisionMeshes.Empty();
 	SetInitialShapeVisible(true);
 }
 
@@ -1193,6 +1485,9 @@ void UVitruvioComponent::OnComponentDestroyed(bool bDestroyingHierarchy)
 
 	VitruvioModule::Get().InvalidateOcclusionHandle(InitialShapeIndex);
 
+	VitruvioModule::Get().GetMaterialPipeline().OnPlaceholdersReplaced.Remove(PlaceholdersReplacedDelegate);
+	PlaceholdersReplacedDelegate.Reset();
+
 #if WITH_EDITOR
 	FCoreUObjectDelegates::OnObjectPropertyChanged.Remove(PropertyChangeDelegate);
 	PropertyChangeDelegate.Reset();
@@ -1205,6 +1500,12 @@ void UVitruvioComponent::OnComponentDestroyed(bool bDestroyingHierarchy)
 #endif
 }
 
+void UVitruvioComponent::OnPlaceholdersReplaced(const TMap<UMaterialInterface*, UMaterialInterface*>& Replacements)
+{
+	ReplaceMaterialIdentifiers(MaterialIdentifiers, Replacements);
+	ReplaceMaterialIdentifiers(PendingMaterialIdentifiers, Replacements);
+}
+
 void UVitruvioComponent::Generate(UGenerateCompletedCallbackProxy* CallbackProxy, const FGenerateOptions& GenerateOptions)
 {
 	Initialize();
@@ -1244,13 +1545,20 @@ void UVitruvioComponent::Generate(UGenerateCompletedCallbackProxy* CallbackProxy
 			Shapes.Append(GetNeighboringShapes());
 		}
 		
-		FGenerateResult GenerateResult = VitruvioModule::Get().GenerateAsync(MoveTemp(Shapes));
+		FGenerateResult GenerateResult = VitruvioModule::Get().GenerateAsync(MoveTemp(Shapes), GenerateOptions.OutputProfile);
 
 		GenerateToken = GenerateResult.Token;
 
 		// clang-format off
-		GenerateResult.Result.Next([this, CallbackProxy, GenerateOptions](const FGenerateResult::ResultType& Result)
+		GenerateResult.Result.Next([this, CallbackProxy, GenerateOptions, LodSettings = LodSettings](const FGenerateResult::ResultType& Result)
 		{
+			if (Result.Token->IsInvalid())
+			{
+				return;
+			}
+
+			GenerateLods(Result.Value, LodSettings);
+
 			FScopeLock Lock(&Result.Token->Lock);
 
 			if (Result.Token->IsInvalid())
@@ -14,7 +14,7 @@
  */
 
 #include "VitruvioMesh.h"
-#include "MaterialConversion.h"
+#include "Algo/AnyOf.h"
 #include "Materials/Material.h"
 #include "StaticMeshAttributes.h"
 #include "VitruvioModule.h"
@@ -22,6 +22,24 @@
 #include "Engine/CollisionProfile.h"
 #include "UObject/Package.h"
 #include "Engine/World.h"
+#include "StaticMeshResources.h"
+#include "Components/StaticMeshComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/Compression.h"
+#include "Serialization/CustomVersion.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+#if WITH_EDITOR
+#include "IMeshReductionInterfaces.h"
+#include "IMeshReductionManagerModule.h"
+#include "Modules/ModuleManager.h"
+#include "OverlappingCorners.h"
+#include "StaticMeshOperations.h"
+#endif
+
+TAutoConsoleVariable<int32> CVarMeshDescriptionRetention(TEXT("Esri.Vitruvio.MeshDescriptionRetention"), WITH_EDITOR ? 0 : 2,
+	TEXT("What happens to the mesh descriptions of generated meshes after they have been built. 0: keep, 1: compress in memory, 2: drop (default outside of the editor)."));
 
 namespace
 {
@@ -40,11 +58,25 @@ FString MakeUniqueMaterialName(FString Name, TMap<FString, int32>& UniqueMateria
 	return Name;
 }
 
+// The conversion always allocates all uv channels, so only channels up to the last one which contains any uv coordinate are built
+int32 GetNumUsedUVChannels(const TVertexInstanceAttributesConstRef<FVector2f>& VertexInstanceUVs)
+{
+	for (int32 UVIndex = FMath::Min(VertexInstanceUVs.GetNumChannels(), static_cast<int32>(MAX_STATIC_TEXCOORDS)) - 1; UVIndex > 0; --UVIndex)
+	{
+		const TArrayView<const FVector2f> UVs = VertexInstanceUVs.GetRawArray(UVIndex);
+		if (Algo::AnyOf(UVs, [](const FVector2f& UV) { return !UV.IsZero(); }))
+		{
+			return UVIndex + 1;
+		}
+	}
+	return 1;
+}
+
 } // namespace
 
 UMaterialInstanceDynamic* CacheMaterial(UMaterial* OpaqueParent, UMaterial* MaskedParent, UMaterial* TranslucentParent,
-										TMap<FString, Vitruvio::FTextureData>& TextureCache,
-										TMap<Vitruvio::FMaterialAttributeContainer, TObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
+										FTextureCache& TextureCache,
+										TMap<Vitruvio::FMaterialAttributeContainer, TWeakObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
 										const Vitruvio::FMaterialAttributeContainer& MaterialAttributes, TMap<FString, int32>& UniqueMaterialNames,
 										TMap<UMaterialInterface*, FString>& MaterialIdentifiers, UObject* Outer)
 {
@@ -52,23 +84,160 @@ UMaterialInstanceDynamic* CacheMaterial(UMaterial* OpaqueParent, UMaterial* Mask
 
 	const FString MaterialIdentifier = MaterialAttributes.GetMaterialName();
 
-	if (const TObjectPtr<UMaterialInstanceDynamic>* Result = MaterialCache.Find(MaterialAttributes))
+	// The cache does not keep the material instances alive, so that their textures can be evicted once no mesh uses them anymore
+	if (const TWeakObjectPtr<UMaterialInstanceDynamic>* Result = MaterialCache.Find(MaterialAttributes); Result && Result->IsValid())
 	{
-		const TObjectPtr<UMaterialInstanceDynamic> Material = *Result;
+		UMaterialInstanceDynamic* Material = Result->Get();
 		MaterialIdentifiers.Add(Material, MaterialIdentifier);
 		return Material;
 	}
 
+	// Materials whose textures are not loaded yet start out as placeholders which are replaced once the textures have been loaded
 	const FString UniqueMaterialIdentifier = MakeUniqueMaterialName(MaterialIdentifier, UniqueMaterialNames);
-	UMaterialInstanceDynamic* Material = GameThread_CreateMaterialInstance(Outer, UniqueMaterialIdentifier, OpaqueParent, MaskedParent,
-																		   TranslucentParent, MaterialAttributes, TextureCache);
+	bool bCacheable;
+	UMaterialInstanceDynamic* Material = VitruvioModule::Get().GetMaterialPipeline().GameThread_RequestMaterial(
+		Outer, UniqueMaterialIdentifier, OpaqueParent, MaskedParent, TranslucentParent, MaterialAttributes, TextureCache, bCacheable);
 
-	MaterialCache.Add(MaterialAttributes, Material);
+	if (bCacheable)
+	{
+		MaterialCache.Add(MaterialAttributes, Material);
+	}
 	MaterialIdentifiers.Add(Material, MaterialIdentifier);
 
 	return Material;
 }
 
+void BuildLodResources(const FMeshDescription& MeshDescription, FStaticMeshLODResources& LodResources)
+{
+	const FStaticMeshConstAttributes Attributes(MeshDescription);
+	const TVertexAttributesConstRef<FVector3f> VertexPositions = Attributes.GetVertexPositions();
+	const TVertexInstanceAttributesConstRef<FVector3f> VertexInstanceNormals = Attributes.GetVertexInstanceNormals();
+	const TVertexInstanceAttributesConstRef<FVector3f> VertexInstanceTangents = Attributes.GetVertexInstanceTangents();
+	const TVertexInstanceAttributesConstRef<float> VertexInstanceBinormalSigns = Attributes.GetVertexInstanceBinormalSigns();
+	const TVertexInstanceAttributesConstRef<FVector2f> VertexInstanceUVs = Attributes.GetVertexInstanceUVs();
+	const TVertexInstanceAttributesConstRef<FVector4f> VertexInstanceColors = Attributes.GetVertexInstanceColors();
+	const int32 NumUVChannels = GetNumUsedUVChannels(VertexInstanceUVs);
+	bool bHasColorVertexData = false;
+
+	// Vertex instance ids are used as render vertex indices, which works since generated meshes never remove vertex instances
+	TArray<FStaticMeshBuildVertex> BuildVertices;
+	BuildVertices.SetNumZeroed(MeshDescription.VertexInstances().GetArraySize());
+	for (const FVertexInstanceID VertexInstanceId : MeshDescription.VertexInstances().GetElementIDs())
+	{
+		FStaticMeshBuildVertex& BuildVertex = BuildVertices[VertexInstanceId.GetValue()];
+		BuildVertex.Position = VertexPositions[MeshDescription.GetVertexInstanceVertex(VertexInstanceId)];
+		BuildVertex.TangentX = VertexInstanceTangents[VertexInstanceId];
+		BuildVertex.TangentZ = VertexInstanceNormals[VertexInstanceId];
+		BuildVertex.TangentY = FVector3f::CrossProduct(BuildVertex.TangentZ, BuildVertex.TangentX).GetSafeNormal() *
+							   VertexInstanceBinormalSigns[VertexInstanceId];
+		// Vertex colors carry the collapsed color variants of materials, like the editor build they are converted to sRGB
+		BuildVertex.Color = FLinearColor(VertexInstanceColors[VertexInstanceId]).ToFColor(true);
+		bHasColorVertexData |= BuildVertex.Color != FColor::White;
+		for (int32 UVIndex = 0; UVIndex < NumUVChannels; ++UVIndex)
+		{
+			BuildVertex.UVs[UVIndex] = VertexInstanceUVs.Get(VertexInstanceId, UVIndex);
+		}
+	}
+
+	LodResources.VertexBuffers.PositionVertexBuffer.Init(BuildVertices);
+	LodResources.VertexBuffers.StaticMeshVertexBuffer.Init(BuildVertices, NumUVChannels);
+	if (bHasColorVertexData)
+	{
+		LodResources.VertexBuffers.ColorVertexBuffer.Init(BuildVertices);
+	}
+	else
+	{
+		LodResources.VertexBuffers.ColorVertexBuffer.InitFromSingleColor(FColor::White, BuildVertices.Num());
+	}
+	LodResources.bHasColorVertexData = bHasColorVertexData;
+
+	// Every polygon group gets its own section since Build adds one material slot per polygon group in the same order
+	TArray<uint32> Indices;
+	Indices.Reserve(MeshDescription.Triangles().Num() * 3);
+	EIndexBufferStride::Type IndexBufferStride = EIndexBufferStride::Force16Bit;
+
+	int32 MaterialIndex = 0;
+	for (const FPolygonGroupID PolygonGroupId : MeshDescription.PolygonGroups().GetElementIDs())
+	{
+		const TArray<FTriangleID>& TriangleIds = MeshDescription.GetPolygonGroupTriangles(PolygonGroupId);
+		if (TriangleIds.IsEmpty())
+		{
+			++MaterialIndex;
+			continue;
+		}
+
+		FStaticMeshSection& Section = LodResources.Sections.AddDefaulted_GetRef();
+		Section.MaterialIndex = MaterialIndex++;
+		Section.FirstIndex = Indices.Num();
+		Section.NumTriangles = TriangleIds.Num();
+		Section.MinVertexIndex = TNumericLimits<uint32>::Max();
+		Section.MaxVertexIndex = 0;
+		Section.bEnableCollision = true;
+		Section.bCastShadow = true;
+
+		for (const FTriangleID TriangleId : TriangleIds)
+		{
+			for (const FVertexInstanceID VertexInstanceId : MeshDescription.GetTriangleVertexInstances(TriangleId))
+			{
+				const uint32 VertexIndex = static_cast<uint32>(VertexInstanceId.GetValue());
+				Section.MinVertexIndex = FMath::Min(Section.MinVertexIndex, VertexIndex);
+				Section.MaxVertexIndex = FMath::Max(Section.MaxVertexIndex, VertexIndex);
+				Indices.Add(VertexIndex);
+			}
+		}
+
+		if (Section.MaxVertexIndex > TNumericLimits<uint16>::Max())
+		{
+			IndexBufferStride = EIndexBufferStride::Force32Bit;
+		}
+	}
+
+	LodResources.IndexBuffer.SetIndices(Indices, IndexBufferStride);
+}
+
+Vitruvio::FCollisionDataPtr CreateCollisionData(const FMeshDescription& MeshDescription)
+{
+	Vitruvio::FCollisionDataPtr CollisionDataPtr = MakeShared<Vitruvio::FCollisionData, ESPMode::ThreadSafe>();
+	Vitruvio::FCollisionData& CollisionData = *CollisionDataPtr;
+
+	const FStaticMeshConstAttributes Attributes(MeshDescription);
+	const TVertexAttributesConstRef<FVector3f> VertexPositions = Attributes.GetVertexPositions();
+	CollisionData.Vertices = TArray<FVector3f>(VertexPositions.GetRawArray().GetData(), VertexPositions.GetRawArray().Num());
+
+	CollisionData.Indices.Reserve(MeshDescription.Triangles().Num());
+	for (const FPolygonGroupID PolygonGroupId : MeshDescription.PolygonGroups().GetElementIDs())
+	{
+		for (const FTriangleID TriangleId : MeshDescription.GetPolygonGroupTriangles(PolygonGroupId))
+		{
+			const auto TriangleVertices = MeshDescription.GetTriangleVertices(TriangleId);
+
+			FTriIndices TriIndex;
+			TriIndex.v0 = TriangleVertices[0].GetValue();
+			TriIndex.v1 = TriangleVertices[1].GetValue();
+			TriIndex.v2 = TriangleVertices[2].GetValue();
+			CollisionData.Indices.Add(TriIndex);
+		}
+	}
+
+	return CollisionDataPtr;
+}
+
+// Mesh descriptions can not report their size, so it is estimated from the attributes written by the conversion
+SIZE_T EstimateMeshDescriptionSize(const FMeshDescription& MeshDescription)
+{
+	if (MeshDescription.IsEmpty())
+	{
+		return 0;
+	}
+
+	const int32 NumUVChannels = FStaticMeshConstAttributes(MeshDescription).GetVertexInstanceUVs().GetNumChannels();
+
+	SIZE_T Size = MeshDescription.Vertices().Num() * sizeof(FVector3f);
+	Size += MeshDescription.VertexInstances().Num() * (3 * sizeof(FVector3f) + sizeof(FVector4f) + NumUVChannels * sizeof(FVector2f));
+	Size += MeshDescription.Triangles().Num() * (3 * sizeof(FVertexInstanceID) + sizeof(FPolygonID) + sizeof(FPolygonGroupID));
+	return Size;
+}
+
 void InitializeBodySetup(UBodySetup* BodySetup)
 {
 	BodySetup->DefaultInstance.SetCollisionProfileName(UCollisionProfile::BlockAll_ProfileName);
@@ -76,6 +245,19 @@ void InitializeBodySetup(UBodySetup* BodySetup)
 	BodySetup->bDoubleSidedGeometry = true;
 	BodySetup->bMeshCollideAll = true;
 	BodySetup->InvalidatePhysicsData();
+}
+
+void InitializeSimplifiedBodySetup(UBodySetup* BodySetup, UStaticMesh* StaticMesh)
+{
+	const FBox Bounds = StaticMesh->GetBoundingBox();
+
+	FKBoxElem BoxElem(Bounds.GetSize().X, Bounds.GetSize().Y, Bounds.GetSize().Z);
+	BoxElem.Center = Bounds.GetCenter();
+	BodySetup->AggGeom.BoxElems.Add(BoxElem);
+
+	BodySetup->DefaultInstance.SetCollisionProfileName(UCollisionProfile::BlockAll_ProfileName);
+	BodySetup->CollisionTraceFlag = ECollisionTraceFlag::CTF_UseSimpleAsComplex;
+	BodySetup->InvalidatePhysicsData();
 	BodySetup->CreatePhysicsMeshes();
 }
 
@@ -93,13 +275,83 @@ FVitruvioMesh::~FVitruvioMesh()
 	}
 }
 
-void FVitruvioMesh::Build(const FString& Name, TMap<Vitruvio::FMaterialAttributeContainer, TObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
-						  TMap<FString, Vitruvio::FTextureData>& TextureCache, TMap<UMaterialInterface*, FString>& UniqueMaterialIdentifiers,
+void FVitruvioMesh::GenerateLods(const TArray<float>& ReductionPercentages, const TArray<float>& ScreenSizes)
+{
+#if WITH_EDITOR
+	FScopeLock Lock(&BuildCriticalSection);
+
+	if (StaticMesh || !LodMeshDescriptions.IsEmpty())
+	{
+		return;
+	}
+
+	// The reduction module is loaded on startup since modules can not be loaded from worker threads
+	IMeshReductionManagerModule* MeshReductionModule = FModuleManager::GetModulePtr<IMeshReductionManagerModule>("MeshReductionInterface");
+	IMeshReduction* MeshReduction = MeshReductionModule ? MeshReductionModule->GetStaticMeshReductionInterface() : nullptr;
+	if (!MeshReduction)
+	{
+		return;
+	}
+
+	FOverlappingCorners OverlappingCorners;
+	FStaticMeshOperations::FindOverlappingCorners(OverlappingCorners, MeshDescription, THRESH_POINTS_ARE_SAME);
+
+	const int32 NumLods = FMath::Min3(ReductionPercentages.Num(), ScreenSizes.Num(), MAX_STATIC_MESH_LODS - 1);
+	for (int32 LodIndex = 0; LodIndex < NumLods; ++LodIndex)
+	{
+		FMeshReductionSettings ReductionSettings;
+		ReductionSettings.PercentTriangles = FMath::Clamp(ReductionPercentages[LodIndex], 0.0f, 1.0f);
+		ReductionSettings.TerminationCriterion = EStaticMeshReductionTerimationCriterion::Triangles;
+
+		FMeshDescription ReducedMeshDescription;
+		FStaticMeshAttributes(ReducedMeshDescription).Register();
+
+		float MaxDeviation = 0.0f;
+		MeshReduction->ReduceMeshDescription(ReducedMeshDescription, MaxDeviation, MeshDescription, OverlappingCorners, ReductionSettings);
+
+		// Stop once the mesh can not be reduced any further
+		if (ReducedMeshDescription.Triangles().Num() == 0)
+		{
+			break;
+		}
+
+		LodMeshDescriptions.Add(MoveTemp(ReducedMeshDescription));
+		LodScreenSizes.Add(ScreenSizes[LodIndex]);
+	}
+#endif
+}
+
+void FVitruvioMesh::PrepareBuild()
+{
+	FScopeLock Lock(&BuildCriticalSection);
+
+	if (StaticMesh || PreparedCollisionData || MeshDescription.Triangles().Num() == 0)
+	{
+		return;
+	}
+
+	PreparedCollisionData = CreateCollisionData(MeshDescription);
+
+#if !WITH_EDITOR
+	TUniquePtr<FStaticMeshRenderData> RenderData = MakeUnique<FStaticMeshRenderData>();
+	RenderData->AllocateLODResources(1);
+	BuildLodResources(MeshDescription, RenderData->LODResources[0]);
+	RenderData->Bounds = MeshDescription.GetBounds();
+	RenderData->ScreenSize[0].Default = 1.0f;
+
+	PreparedRenderData = MoveTemp(RenderData);
+#endif
+}
+
+void FVitruvioMesh::Build(const FString& Name, TMap<Vitruvio::FMaterialAttributeContainer, TWeakObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
+						  FTextureCache& TextureCache, TMap<UMaterialInterface*, FString>& UniqueMaterialIdentifiers,
 						  TMap<FString, int32>& UniqueMaterialNames, UMaterial* OpaqueParent, UMaterial* MaskedParent, UMaterial* TranslucentParent,
 						  UWorld* World)
 {
 	check(IsInGameThread());
 
+	FScopeLock BuildLock(&BuildCriticalSection);
+
 	if (StaticMesh)
 	{
 		return;
@@ -116,14 +368,6 @@ void FVitruvioMesh::Build(const FString& Name, TMap<Vitruvio::FMaterialAttribute
 
 	FStaticMeshAttributes MeshAttributes(MeshDescription);
 
-	TArray<FVector3f> Vertices;
-	auto VertexPositions = MeshAttributes.GetVertexPositions();
-	for (int32 VertexIndex = 0; VertexIndex < VertexPositions.GetNumElements(); ++VertexIndex)
-	{
-		Vertices.Add(VertexPositions[FVertexID(VertexIndex)]);
-	}
-
-	TArray<FTriIndices> Indices;
 	const auto PolygonGroups = MeshDescription.PolygonGroups();
 	size_t MaterialIndex = 0;
 
@@ -137,39 +381,241 @@ void FVitruvioMesh::Build(const FString& Name, TMap<Vitruvio::FMaterialAttribute
 		MaterialSlots.Add(Material, SlotName);
 
 		++MaterialIndex;
+	}
+
+	TArray<const FMeshDescription*> MeshDescriptionPtrs;
+	MeshDescriptionPtrs.Emplace(&MeshDescription);
 
-		// cache collision data
-		for (FPolygonID PolygonID : MeshDescription.GetPolygonGroupPolygonIDs(PolygonGroupId))
+	// Reduced LODs keep the polygon groups of the base mesh, so they can share its material slots
+	for (FMeshDescription& LodMeshDescription : LodMeshDescriptions)
+	{
+		FStaticMeshAttributes LodMeshAttributes(LodMeshDescription);
+		for (const FPolygonGroupID PolygonGroupId : LodMeshDescription.PolygonGroups().GetElementIDs())
 		{
-			for (FTriangleID TriangleID : MeshDescription.GetPolygonTriangles(PolygonID))
+			if (MeshDescription.IsPolygonGroupValid(PolygonGroupId))
 			{
-				auto TriangleVertexInstances = MeshDescription.GetTriangleVertexInstances(TriangleID);
-
-				auto VertexID0 = MeshDescription.GetVertexInstanceVertex(TriangleVertexInstances[0]);
-				auto VertexID1 = MeshDescription.GetVertexInstanceVertex(TriangleVertexInstances[1]);
-				auto VertexID2 = MeshDescription.GetVertexInstanceVertex(TriangleVertexInstances[2]);
-
-				FTriIndices TriIndex;
-				TriIndex.v0 = VertexID0.GetValue();
-				TriIndex.v1 = VertexID1.GetValue();
-				TriIndex.v2 = VertexID2.GetValue();
-				Indices.Add(TriIndex);
+				LodMeshAttributes.GetPolygonGroupMaterialSlotNames()[PolygonGroupId] = MeshAttributes.GetPolygonGroupMaterialSlotNames()[PolygonGroupId];
 			}
 		}
+		MeshDescriptionPtrs.Emplace(&LodMeshDescription);
 	}
 
-	TArray<const FMeshDescription*> MeshDescriptionPtrs;
-	MeshDescriptionPtrs.Emplace(&MeshDescription);
+#if WITH_EDITORONLY_DATA
+	StaticMesh->bAutoComputeLODScreenSize = LodScreenSizes.IsEmpty();
+#endif
+
+	if (PreparedRenderData)
+	{
+		// The render data has already been built on a worker thread, so only the render resources are left to initialize
+		StaticMesh->NeverStream = true;
+		StaticMesh->SetRenderData(MoveTemp(PreparedRenderData));
+		StaticMesh->CalculateExtendedBounds();
+		StaticMesh->InitResources();
+	}
+	else
+	{
+		UStaticMesh::FBuildMeshDescriptionsParams Params;
+		Params.bCommitMeshDescription = true;
+		Params.bFastBuild = true;
+		StaticMesh->BuildFromMeshDescriptions(MeshDescriptionPtrs, Params);
+	}
 
-	UStaticMesh::FBuildMeshDescriptionsParams Params;
-	Params.bCommitMeshDescription = true;
-	Params.bFastBuild = true;
-	StaticMesh->BuildFromMeshDescriptions(MeshDescriptionPtrs, Params);
+	if (FStaticMeshRenderData* RenderData = StaticMesh->GetRenderData())
+	{
+		for (int32 LodIndex = 0; LodIndex < LodScreenSizes.Num(); ++LodIndex)
+		{
+			RenderData->ScreenSize[LodIndex + 1].Default = LodScreenSizes[LodIndex];
+		}
+	}
+
+	// The LODs have been committed to the static mesh and are not needed anymore
+	LodMeshDescriptions.Empty();
 	
-	Vitruvio::FCollisionData CollisionData = {Indices, Vertices};
-	CollisionDataProvider->SetCollisionData(CollisionData);
+	// Fall back to creating the collision data here if the mesh has not been prepared on a worker thread. The provider becomes the only
+	// owner of the collision data, which allows it to hand the data over to cooking without copying it.
+	if (!PreparedCollisionData)
+	{
+		PreparedCollisionData = CreateCollisionData(MeshDescription);
+	}
+	CollisionDataProvider->SetCollisionData(PreparedCollisionData);
+	PreparedCollisionData.Reset();
+
+	const int32 Retention = FMath::Clamp(CVarMeshDescriptionRetention.GetValueOnGameThread(), 0, static_cast<int32>(EMeshDescriptionRetention::Drop));
+	ApplyMeshDescriptionRetention(static_cast<EMeshDescriptionRetention>(Retention));
+}
+
+void FVitruvioMesh::ApplyMeshDescriptionRetention(EMeshDescriptionRetention Retention)
+{
+	if (Retention == EMeshDescriptionRetention::Compress)
+	{
+		TArray<uint8> SerializedMeshDescription;
+		FMemoryWriter Writer(SerializedMeshDescription);
+		Writer << MeshDescription;
+
+		int32 CompressedSize = FCompression::GetMaximumCompressedSize(NAME_Oodle, SerializedMeshDescription.Num());
+		CompressedMeshDescription.SetNumUninitialized(CompressedSize);
+		if (FCompression::CompressMemory(NAME_Oodle, CompressedMeshDescription.GetData(), CompressedSize, SerializedMeshDescription.GetData(),
+										 SerializedMeshDescription.Num()))
+		{
+			CompressedMeshDescription.SetNum(CompressedSize);
+			CompressedMeshDescription.Shrink();
+			UncompressedMeshDescriptionSize = SerializedMeshDescription.Num();
+			MeshDescription = FMeshDescription();
+		}
+		else
+		{
+			CompressedMeshDescription.Empty();
+		}
+	}
+	else if (Retention == EMeshDescriptionRetention::Drop)
+	{
+		MeshDescription = FMeshDescription();
+	}
+}
+
+TArray<Vitruvio::FMaterialAttributeContainer> FVitruvioMesh::GetMaterials() const
+{
+	FScopeLock Lock(&BuildCriticalSection);
+	return Materials;
+}
+
+bool FVitruvioMesh::GetMeshDescription(FMeshDescription& OutMeshDescription) const
+{
+	FScopeLock Lock(&BuildCriticalSection);
+
+	if (!CompressedMeshDescription.IsEmpty())
+	{
+		TArray<uint8> SerializedMeshDescription;
+		SerializedMeshDescription.SetNumUninitialized(UncompressedMeshDescriptionSize);
+		if (!FCompression::UncompressMemory(NAME_Oodle, SerializedMeshDescription.GetData(), UncompressedMeshDescriptionSize,
+											CompressedMeshDescription.GetData(), CompressedMeshDescription.Num()))
+		{
+			return false;
+		}
+
+		// The mesh description has been serialized by this process, so the current custom versions apply
+		FMemoryReader Reader(SerializedMeshDescription);
+		Reader.SetCustomVersions(FCurrentCustomVersions::GetAll());
+		Reader << OutMeshDescription;
+		return true;
+	}
+
+	if (MeshDescription.IsEmpty())
+	{
+		return false;
+	}
+
+	OutMeshDescription = MeshDescription;
+	return true;
+}
+
+SIZE_T FVitruvioMesh::GetAllocatedSize() const
+{
+	FScopeLock Lock(&BuildCriticalSection);
+
+	SIZE_T Size = sizeof(FVitruvioMesh) + Materials.GetAllocatedSize() + CompressedMeshDescription.GetAllocatedSize();
+
+	Size += EstimateMeshDescriptionSize(MeshDescription);
+	for (const FMeshDescription& LodMeshDescription : LodMeshDescriptions)
+	{
+		Size += EstimateMeshDescriptionSize(LodMeshDescription);
+	}
+
+	if (PreparedCollisionData)
+	{
+		Size += PreparedCollisionData->Indices.GetAllocatedSize() + PreparedCollisionData->Vertices.GetAllocatedSize();
+	}
+
+	const FStaticMeshRenderData* RenderData = PreparedRenderData ? PreparedRenderData.Get() : StaticMesh ? StaticMesh->GetRenderData() : nullptr;
+	if (RenderData)
+	{
+		FResourceSizeEx ResourceSize(EResourceSizeMode::Exclusive);
+		RenderData->GetResourceSizeEx(ResourceSize);
+		Size += ResourceSize.GetTotalMemoryBytes();
+	}
+
+	return Size;
+}
+
+void FVitruvioMesh::CreateCollision(bool bSimplified, bool bAsync)
+{
+	check(IsInGameThread());
+
+	if (!StaticMesh || StaticMesh->GetBodySetup())
+	{
+		return;
+	}
 
 	UBodySetup* BodySetup = NewObject<UBodySetup>(CollisionDataProvider, NAME_None, RF_Transient | RF_DuplicateTransient | RF_TextExportTransient | RF_Transactional);
-	InitializeBodySetup(BodySetup);
 	StaticMesh->SetBodySetup(BodySetup);
+
+	if (bSimplified)
+	{
+		// Simplified collision does not need the triangles
+		CollisionDataProvider->ClearCollisionData();
+		InitializeSimplifiedBodySetup(BodySetup, StaticMesh);
+		RecreatePhysicsState();
+	}
+	else if (bAsync)
+	{
+		InitializeBodySetup(BodySetup);
+
+		// Cook on a worker thread and recreate the physics state of the components using the mesh once cooking has finished
+		BodySetup->CreatePhysicsMeshesAsync(FOnAsyncPhysicsCookFinished::CreateLambda([WeakThis = AsWeak()](bool bSuccess) {
+			const TSharedPtr<FVitruvioMesh> CookedMesh = WeakThis.Pin();
+			if (!CookedMesh)
+			{
+				return;
+			}
+
+			CookedMesh->CollisionDataProvider->OnCookFinished(bSuccess);
+			if (bSuccess)
+			{
+				CookedMesh->RecreatePhysicsState();
+			}
+		}));
+	}
+	else
+	{
+		InitializeBodySetup(BodySetup);
+		BodySetup->CreatePhysicsMeshes();
+		CollisionDataProvider->OnCookFinished(BodySetup->bCreatedPhysicsMeshes && !BodySetup->bFailedToCreatePhysicsMeshes);
+		RecreatePhysicsState();
+	}
+}
+
+bool FVitruvioMesh::HasCollision() const
+{
+	return StaticMesh && StaticMesh->GetBodySetup();
+}
+
+void FVitruvioMesh::AddUser(UStaticMeshComponent* Component)
+{
+	check(IsInGameThread());
+
+	// Forget components which have been destroyed or which have been assigned another mesh in the meantime
+	Users.RemoveAll([this](const TWeakObjectPtr<UStaticMeshComponent>& User) { return !User.IsValid() || User->GetStaticMesh() != StaticMesh; });
+	Users.AddUnique(Component);
+}
+
+bool FVitruvioMesh::IsInUse() const
+{
+	check(IsInGameThread());
+
+	return Algo::AnyOf(Users, [this](const TWeakObjectPtr<UStaticMeshComponent>& User) {
+		return User.IsValid() && User->GetStaticMesh() == StaticMesh;
+	});
+}
+
+void FVitruvioMesh::RecreatePhysicsState()
+{
+	check(IsInGameThread());
+
+	for (const TWeakObjectPtr<UStaticMeshComponent>& User : Users)
+	{
+		if (User.IsValid() && User->GetStaticMesh() == StaticMesh && User->IsRegistered())
+		{
+			User->RecreatePhysicsState();
+		}
+	}
 }
\ No newline at end of file
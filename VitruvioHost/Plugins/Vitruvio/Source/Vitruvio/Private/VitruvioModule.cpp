@@ -19,6 +19,7 @@
 
 #include "PRTTypes.h"
 #include "PRTUtils.h"
+#include "PersistentMeshCache.h"
 #include "TextureDecoding.h"
 #include "UnrealCallbacks.h"
 
@@ -26,11 +27,15 @@
 
 #include "Async/Async.h"
 #include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
 #include "HAL/PlatformFileManager.h"
+#include "Hash/xxhash.h"
 #include "Interfaces/IPluginManager.h"
 #include "Modules/ModuleManager.h"
 
+#include "UObject/GarbageCollection.h"
 #include "UObject/UObjectBaseUtility.h"
+#include "UObject/UObjectGlobals.h"
 #include "Util/AttributeConversion.h"
 
 #define LOCTEXT_NAMESPACE "VitruvioModule"
@@ -56,6 +61,28 @@ DEFINE_LOG_CATEGORY(LogUnrealPrt);
 namespace
 {
 constexpr const wchar_t* ATTRIBUTE_EVAL_ENCODER_ID = L"com.esri.prt.core.AttributeEvalEncoder";
+constexpr const wchar_t* EO_TRIANGULATE_AND_SHARE_INDICES = L"triangulateAndShareIndices";
+constexpr const wchar_t* EO_AUTO_INSTANCING_MIN_COUNT = L"autoInstancingMinCount";
+constexpr const wchar_t* EO_MIN_INSTANCE_COUNT = L"minInstanceCount";
+constexpr const wchar_t* EO_MAX_MERGED_INSTANCE_VERTEX_COUNT = L"maxMergedInstanceVertexCount";
+constexpr const wchar_t* EO_EMIT_REPORTS = L"emitReports";
+constexpr const wchar_t* EO_EMIT_MATERIALS = L"emitMaterials";
+constexpr const wchar_t* EO_EMIT_NORMALS = L"emitNormals";
+constexpr const wchar_t* EO_MAX_UV_SETS = L"maxUVSets";
+
+// Uris of textures generated on the CPU, which are not resolved by PRT
+const FString GeneratedTextureUriPrefix(TEXT("vitruvio-generated:/"));
+
+TAutoConsoleVariable<int32> CVarAutoInstancingMinCount(TEXT("Esri.Vitruvio.AutoInstancingMinCount"), 0,
+	TEXT("Minimum number of repetitions of identical procedural geometry before it is converted to instances (0 disables auto instancing)."));
+
+TAutoConsoleVariable<int32> CVarMinInstanceCount(TEXT("Esri.Vitruvio.MinInstanceCount"), 1,
+	TEXT("Prototypes with fewer instances are baked into the generated model instead of being instanced. Baked instances can not be replaced "
+		 "by instance replacements."));
+
+TAutoConsoleVariable<int32> CVarMaxMergedInstanceVertexCount(TEXT("Esri.Vitruvio.MaxMergedInstanceVertexCount"), 0,
+	TEXT("Prototypes whose instances have at most this many vertices in total are baked into the generated model instead of being instanced "
+		 "(0 disables the heuristic)."));
 
 struct FStartRuleInfo
 {
@@ -70,14 +97,17 @@ class FLoadResolveMapTask
 	TLazyObjectPtr<URulePackage> LazyRulePackagePtr;
 	TPromise<ResolveMapSPtr> Promise;
 	TMap<TLazyObjectPtr<URulePackage>, ResolveMapSPtr>& ResolveMapCache;
+	TMap<FString, FString>& RpkContentHashes;
+	TMap<TLazyObjectPtr<URulePackage>, FString>& RpkFileUris;
 	FCriticalSection& LoadResolveMapLock;
 	FString RpkFolder;
 
 public:
 	FLoadResolveMapTask(TPromise<ResolveMapSPtr>&& InPromise, const FString RpkFolder, const TLazyObjectPtr<URulePackage> LazyRulePackagePtr,
-						TMap<TLazyObjectPtr<URulePackage>, ResolveMapSPtr>& ResolveMapCache, FCriticalSection& LoadResolveMapLock)
+						TMap<TLazyObjectPtr<URulePackage>, ResolveMapSPtr>& ResolveMapCache, TMap<FString, FString>& RpkContentHashes,
+						TMap<TLazyObjectPtr<URulePackage>, FString>& RpkFileUris, FCriticalSection& LoadResolveMapLock)
 		: LazyRulePackagePtr(LazyRulePackagePtr), Promise(MoveTemp(InPromise)), ResolveMapCache(ResolveMapCache),
-		  LoadResolveMapLock(LoadResolveMapLock), RpkFolder(RpkFolder)
+		  RpkContentHashes(RpkContentHashes), RpkFileUris(RpkFileUris), LoadResolveMapLock(LoadResolveMapLock), RpkFolder(RpkFolder)
 	{
 	}
 
@@ -128,8 +158,20 @@ public:
 			const std::wstring RpkFileUri = prtu::toFileURI(AbsoluteRpkPath);
 			prt::Status Status;
 			const ResolveMapSPtr ResolveMapPtr(prt::createResolveMap(RpkFileUri.c_str(), nullptr, &Status), PRTDestroyer());
+
+			// The rpk is extracted to a different folder every session, so persistent caches identify it by its content instead. Rule packages
+			// loaded while the persistent mesh cache is disabled are not hashed and their assets are not cached until they are loaded again.
+			const bool bHashContent = FPersistentMeshCache::IsEnabled();
+			const FXxHash64 ContentHash = bHashContent ? FXxHash64::HashBuffer(LazyRulePackagePtr->Data.GetData(), LazyRulePackagePtr->Data.Num())
+													   : FXxHash64();
 			{
 				FScopeLock Lock(&LoadResolveMapLock);
+				if (bHashContent)
+				{
+					const FString RpkFileUriString(WCHAR_TO_TCHAR(RpkFileUri.c_str()));
+					RpkContentHashes.Add(RpkFileUriString, FString::Printf(TEXT("%016llx"), ContentHash.Hash));
+					RpkFileUris.Add(LazyRulePackagePtr, RpkFileUriString);
+				}
 				ResolveMapCache.Add(LazyRulePackagePtr, ResolveMapPtr);
 				Promise.SetValue(ResolveMapPtr);
 			}
@@ -220,6 +262,27 @@ void SetInitialShapeGeometry(const InitialShapeBuilderUPtr& InitialShapeBuilder,
 	}
 }
 
+AttributeMapUPtr CreateUnrealEncoderOptions(EEncoderOutputProfile OutputProfile)
+{
+	const Vitruvio::FEncoderOutputOptions OutputOptions = Vitruvio::GetEncoderOutputOptions(OutputProfile);
+
+	// Let PRT triangulate and weld the generated meshes so they can be converted without any further processing
+	AttributeMapBuilderUPtr OptionsBuilder(prt::AttributeMapBuilder::create());
+	OptionsBuilder->setBool(EO_TRIANGULATE_AND_SHARE_INDICES, true);
+	OptionsBuilder->setInt(EO_AUTO_INSTANCING_MIN_COUNT, FMath::Max(0, CVarAutoInstancingMinCount.GetValueOnAnyThread()));
+	OptionsBuilder->setInt(EO_MIN_INSTANCE_COUNT, FMath::Max(1, CVarMinInstanceCount.GetValueOnAnyThread()));
+	OptionsBuilder->setInt(EO_MAX_MERGED_INSTANCE_VERTEX_COUNT, FMath::Max(0, CVarMaxMergedInstanceVertexCount.GetValueOnAnyThread()));
+
+	// Skip outputs which are not needed by the requested profile already in the encoder
+	OptionsBuilder->setBool(EO_EMIT_REPORTS, OutputOptions.bEmitReports);
+	OptionsBuilder->setBool(EO_EMIT_MATERIALS, OutputOptions.bEmitMaterials);
+	OptionsBuilder->setBool(EO_EMIT_NORMALS, OutputOptions.bEmitNormals);
+	OptionsBuilder->setInt(EO_MAX_UV_SETS, OutputOptions.MaxUVSets);
+	const AttributeMapUPtr Options(OptionsBuilder->createAttributeMapAndReset());
+
+	return prtu::createValidatedOptions(UNREAL_GEOMETRY_ENCODER_ID, Options.get());
+}
+
 AttributeMapUPtr EvaluateRuleAttributes(const std::wstring& RuleFile, const std::wstring& StartRule, 
 										const ResolveMapSPtr& ResolveMapPtr, const FInitialShape& InitialShape, prt::Cache* Cache)
 {
@@ -352,11 +415,22 @@ void VitruvioModule::StartupModule()
 		return;
 	}
 
+#if WITH_EDITOR
+	// Needed for LOD generation, which runs on worker threads where modules can not be loaded
+	FModuleManager::Get().LoadModule("MeshReductionInterface");
+#endif
+
 	InitializePrt();
+
+	TickHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &VitruvioModule::Tick));
+	PostGarbageCollectHandle = FCoreUObjectDelegates::GetPostGarbageCollect().AddRaw(this, &VitruvioModule::OnPostGarbageCollect);
 }
 
 void VitruvioModule::ShutdownModule()
 {
+	FTSTicker::GetCoreTicker().RemoveTicker(TickHandle);
+	FCoreUObjectDelegates::GetPostGarbageCollect().Remove(PostGarbageCollectHandle);
+
 	if (!Initialized)
 	{
 		return;
@@ -392,34 +466,122 @@ void VitruvioModule::ShutdownModule()
 	UE_LOG(LogUnrealPrt, Display, TEXT("Shutdown complete"))
 }
 
-Vitruvio::FTextureData VitruvioModule::DecodeTexture(UObject* Outer, const FString& Path, const FString& Key) const
+struct VitruvioModule::FGeneratedTexture
+{
+	Vitruvio::FTextureMetadata Metadata;
+	TArray64<uint8> Pixels;
+	int32 NumReferences = 0;
+};
+
+std::unique_ptr<uint8_t[]> VitruvioModule::ReadTexture(const FString& Path, Vitruvio::FTextureMetadata& OutMetadata, size_t& OutBufferSize) const
 {
+	if (Path.StartsWith(GeneratedTextureUriPrefix))
+	{
+		FReadScopeLock Lock(GeneratedTexturesLock);
+		const TSharedPtr<FGeneratedTexture>* GeneratedTexture = GeneratedTextures.Find(Path);
+		if (!GeneratedTexture)
+		{
+			return nullptr;
+		}
+
+		OutMetadata = (*GeneratedTexture)->Metadata;
+		OutBufferSize = (*GeneratedTexture)->Pixels.Num();
+		auto Buffer = std::make_unique<uint8_t[]>(OutBufferSize);
+		FMemory::Memcpy(Buffer.get(), (*GeneratedTexture)->Pixels.GetData(), OutBufferSize);
+		return Buffer;
+	}
+
 	const prt::AttributeMap* TextureMetadataAttributeMap = prt::createTextureMetadata(*Path, PrtCache.get());
-	Vitruvio::FTextureMetadata TextureMetadata = Vitruvio::ParseTextureMetadata(TextureMetadataAttributeMap);
+	OutMetadata = Vitruvio::ParseTextureMetadata(TextureMetadataAttributeMap);
 
-	size_t BufferSize = TextureMetadata.Width * TextureMetadata.Height * TextureMetadata.Bands * TextureMetadata.BytesPerBand;
-	auto Buffer = std::make_unique<uint8_t[]>(BufferSize);
+	OutBufferSize = OutMetadata.Width * OutMetadata.Height * OutMetadata.Bands * OutMetadata.BytesPerBand;
+	auto Buffer = std::make_unique<uint8_t[]>(OutBufferSize);
 
-	prt::getTexturePixeldata(*Path, Buffer.get(), BufferSize, PrtCache.get());
+	prt::getTexturePixeldata(*Path, Buffer.get(), OutBufferSize, PrtCache.get());
+	return Buffer;
+}
+
+FString VitruvioModule::RegisterGeneratedTexture(const FString& Name, const Vitruvio::FTextureMetadata& Metadata, TArray64<uint8> Pixels)
+{
+	const uint64 Hash = FXxHash64::HashBuffer(Pixels.GetData(), Pixels.Num()).Hash;
+	const FString Uri = FString::Printf(TEXT("%s%016llx/%s_%dx%d"), *GeneratedTextureUriPrefix, Hash, *Name, static_cast<int32>(Metadata.Width),
+										static_cast<int32>(Metadata.Height));
 
-	return Vitruvio::DecodeTexture(Outer, Key, Path, TextureMetadata, std::move(Buffer), BufferSize);
+	FWriteScopeLock Lock(GeneratedTexturesLock);
+	TSharedPtr<FGeneratedTexture>& GeneratedTexture = GeneratedTextures.FindOrAdd(Uri);
+	if (!GeneratedTexture)
+	{
+		GeneratedTexture = MakeShared<FGeneratedTexture>();
+		GeneratedTexture->Metadata = Metadata;
+		GeneratedTexture->Pixels = MoveTemp(Pixels);
+	}
+	++GeneratedTexture->NumReferences;
+	return Uri;
 }
 
-FBatchGenerateResult VitruvioModule::BatchGenerateAsync(TArray<FInitialShape> InitialShapes, bool bEnableOcclusionQueries, TArray<FInitialShape> OccluderOnlyShapes) const
+void VitruvioModule::ReleaseGeneratedTexture(const FString& Uri)
+{
+	FWriteScopeLock Lock(GeneratedTexturesLock);
+	if (TSharedPtr<FGeneratedTexture>* GeneratedTexture = GeneratedTextures.Find(Uri); GeneratedTexture && --(*GeneratedTexture)->NumReferences <= 0)
+	{
+		GeneratedTextures.Remove(Uri);
+	}
+}
+
+Vitruvio::FTextureData VitruvioModule::DecodeTexture(UObject* Outer, const FString& Path, const FString& Key) const
+{
+	// Read before decoding, so that textures decoded while the PRT cache is flushed are invalid afterwards
+	const uint32 Generation = TextureCacheGeneration;
+
+	Vitruvio::FTextureMetadata TextureMetadata;
+	size_t BufferSize = 0;
+	std::unique_ptr<uint8_t[]> Buffer = ReadTexture(Path, TextureMetadata, BufferSize);
+	if (!Buffer)
+	{
+		UE_LOG(LogUnrealPrt, Warning, TEXT("Could not read texture %s"), *Path);
+		return {};
+	}
+
+	// Identical images from different uris are only decoded and uploaded once
+	const uint64 ContentHash = Vitruvio::ComputeTextureContentHash(Key, TextureMetadata, Buffer.get(), BufferSize);
+	Vitruvio::FTextureData TextureData;
+	bool bFoundInCache;
+	{
+		// Cached textures are rooted like decoded ones, the guard keeps the garbage collector from running in between
+		FGCScopeGuard GCGuard;
+		bFoundInCache = TextureCache.FindByContentHash(ContentHash, TextureData);
+		if (bFoundInCache && TextureData.Texture)
+		{
+			TextureData.Texture->AddToRoot();
+		}
+	}
+
+	if (!bFoundInCache)
+	{
+		TextureData = Vitruvio::DecodeTexture(Outer, Key, Path, TextureMetadata, std::move(Buffer), BufferSize);
+		TextureData.ContentHash = ContentHash;
+	}
+	TextureData.Generation = Generation;
+	return TextureData;
+}
+
+FBatchGenerateResult VitruvioModule::BatchGenerateAsync(TArray<FInitialShape> InitialShapes, bool bEnableOcclusionQueries, TArray<FInitialShape> OccluderOnlyShapes,
+														EEncoderOutputProfile OutputProfile) const
 {
     const FBatchGenerateResult::FTokenPtr Token = MakeShared<FGenerateToken>();
     	
 	CHECK_PRT_INITIALIZED_ASYNC(FBatchGenerateResult, Token)
 
-	FBatchGenerateResult::FFutureType ResultFuture = Async(EAsyncExecution::Thread, [this, Token, bEnableOcclusionQueries, InitialShapes = MoveTemp(InitialShapes), OccluderOnlyShapes = MoveTemp(OccluderOnlyShapes)]() mutable {
-		FGenerateResultDescription Result = BatchGenerate(MoveTemp(InitialShapes), bEnableOcclusionQueries, MoveTemp(OccluderOnlyShapes));
+	FBatchGenerateResult::FFutureType ResultFuture = Async(EAsyncExecution::Thread, [this, Token, bEnableOcclusionQueries, OutputProfile, InitialShapes = MoveTemp(InitialShapes), OccluderOnlyShapes = MoveTemp(OccluderOnlyShapes)]() mutable {
+		FGenerateResultDescription Result = BatchGenerate(MoveTemp(InitialShapes), bEnableOcclusionQueries, MoveTemp(OccluderOnlyShapes), OutputProfile);
 		return FBatchGenerateResult::ResultType { Token, MoveTemp(Result) };
 	});
 
 	return FBatchGenerateResult { MoveTemp(ResultFuture), Token };
 }
 
-FGenerateResultDescription VitruvioModule::BatchGenerate(TArray<FInitialShape> InitialShapes, bool bEnableOcclusionQueries, TArray<FInitialShape> OccluderOnlyShapes) const
+FGenerateResultDescription VitruvioModule::BatchGenerate(TArray<FInitialShape> InitialShapes, bool bEnableOcclusionQueries, TArray<FInitialShape> OccluderOnlyShapes,
+														 EEncoderOutputProfile OutputProfile) const
 {
 	if (InitialShapes.IsEmpty())
 	{
@@ -551,7 +713,7 @@ FGenerateResultDescription VitruvioModule::BatchGenerate(TArray<FInitialShape> I
 
 	// Generate Occluders
 	TArray<AttributeMapBuilderUPtr> GenerateAttributeMapBuilders;
-	TSharedPtr<UnrealCallbacks> GenerateOutputHandler(new UnrealCallbacks(GenerateAttributeMapBuilders));
+	TSharedPtr<UnrealCallbacks> GenerateOutputHandler(new UnrealCallbacks(GenerateAttributeMapBuilders, FVector::ZeroVector, OutputProfile));
 	
 	auto UnlockOcclusionLock = [bEnableOcclusionQueries](FCriticalSection& OcclusionLock)
 	{
@@ -629,7 +791,7 @@ FGenerateResultDescription VitruvioModule::BatchGenerate(TArray<FInitialShape> I
 	AttributeMapBuilderUPtr AttributeMapBuilder(prt::AttributeMapBuilder::create());
 
 	const std::vector UnrealEncoderIds = { UNREAL_GEOMETRY_ENCODER_ID };
-	const AttributeMapUPtr UnrealEncoderOptions(prtu::createValidatedOptions(UNREAL_GEOMETRY_ENCODER_ID));
+	const AttributeMapUPtr UnrealEncoderOptions(CreateUnrealEncoderOptions(OutputProfile));
 	const AttributeMapNOPtrVector GenerateEncoderOptions = {UnrealEncoderOptions.get()};
 
 	AttributeMapBuilderUPtr GenerateOptionsBuilder(prt::AttributeMapBuilder::create());
@@ -699,21 +861,21 @@ FAttributeMapsResult VitruvioModule::BatchEvaluateRuleAttributesAsync(TArray<FIn
 	return {MoveTemp(AttributeMapPtrFuture), InvalidationToken};
 }
 
-FGenerateResult VitruvioModule::GenerateAsync(TArray<FInitialShape> InitialShapes) const
+FGenerateResult VitruvioModule::GenerateAsync(TArray<FInitialShape> InitialShapes, EEncoderOutputProfile OutputProfile) const
 {
 	const FGenerateResult::FTokenPtr Token = MakeShared<FGenerateToken>();
 
 	CHECK_PRT_INITIALIZED_ASYNC(FGenerateResult, Token)
 
-	FGenerateResult::FFutureType ResultFuture = Async(EAsyncExecution::Thread, [this, Token, InitialShapes = MoveTemp(InitialShapes)]() mutable {
-		FGenerateResultDescription Result = Generate(MoveTemp(InitialShapes));
+	FGenerateResult::FFutureType ResultFuture = Async(EAsyncExecution::Thread, [this, Token, OutputProfile, InitialShapes = MoveTemp(InitialShapes)]() mutable {
+		FGenerateResultDescription Result = Generate(MoveTemp(InitialShapes), OutputProfile);
 		return FGenerateResult::ResultType{Token, MoveTemp(Result)};
 	});
 
 	return FGenerateResult{MoveTemp(ResultFuture), Token};
 }
 
-FGenerateResultDescription VitruvioModule::Generate(TArray<FInitialShape> InitialShapes) const
+FGenerateResultDescription VitruvioModule::Generate(TArray<FInitialShape> InitialShapes, EEncoderOutputProfile OutputProfile) const
 {
 	CHECK_PRT_INITIALIZED()
 
@@ -735,10 +897,10 @@ FGenerateResultDescription VitruvioModule::Generate(TArray<FInitialShape> Initia
 
 	TArray<AttributeMapBuilderUPtr> AttributeMapBuilders;
 	AttributeMapBuilders.Add(AttributeMapBuilderUPtr(prt::AttributeMapBuilder::create()));
-	const TSharedPtr<UnrealCallbacks> OutputHandler(new UnrealCallbacks(AttributeMapBuilders, FirstInitialShape.Position));
+	const TSharedPtr<UnrealCallbacks> OutputHandler(new UnrealCallbacks(AttributeMapBuilders, FirstInitialShape.Position, OutputProfile));
 
 	const std::vector<const wchar_t*> EncoderIds = {UNREAL_GEOMETRY_ENCODER_ID};
-	const AttributeMapUPtr UnrealEncoderOptions(prtu::createValidatedOptions(UNREAL_GEOMETRY_ENCODER_ID));
+	const AttributeMapUPtr UnrealEncoderOptions(CreateUnrealEncoderOptions(OutputProfile));
 	const AttributeMapNOPtrVector EncoderOptions = {UnrealEncoderOptions.get()};
 	
 	AttributeMapVector AttributeMaps;
@@ -835,6 +997,11 @@ FGenerateResultDescription VitruvioModule::Generate(TArray<FInitialShape> Initia
 	
 	NotifyGenerateCompleted();
 
+	if (const TSharedPtr<FVitruvioMesh>& GeneratedModel = OutputHandler->GetGeneratedModel())
+	{
+		GeneratedModel->PrepareBuild();
+	}
+
 	return FGenerateResultDescription{ OutputHandler->GetGeneratedModel(), OutputHandler->GetInstances(), OutputHandler->GetInstanceMeshes(),
 									  OutputHandler->GetInstanceNames(), OutputHandler->GetReports() };
 }
@@ -1002,7 +1169,40 @@ void VitruvioModule::EvictFromResolveMapCache(URulePackage* RulePackage)
 	const TLazyObjectPtr<URulePackage> LazyRulePackagePtr(RulePackage);
 	FScopeLock Lock(&LoadResolveMapLock);
 	ResolveMapCache.Remove(LazyRulePackagePtr);
+	if (FString RpkFileUri; RpkFileUris.RemoveAndCopyValue(LazyRulePackagePtr, RpkFileUri))
+	{
+		RpkContentHashes.Remove(RpkFileUri);
+	}
 	PrtCache->flushAll();
+	++TextureCacheGeneration;
+}
+
+bool VitruvioModule::FindRulePackageContentHash(const FString& AssetUri, FString& OutRpkUri, FString& OutContentHash) const
+{
+	// Uris of assets inside rule packages have the form rpk:<rpk file uri>!<path inside the rule package>
+	const int32 SeparatorIndex = AssetUri.Find(TEXT("!"), ESearchCase::CaseSensitive);
+	if (SeparatorIndex == INDEX_NONE)
+	{
+		return false;
+	}
+
+	FString RpkUri = AssetUri.Left(SeparatorIndex);
+	FString RpkFileUri = RpkUri;
+	if (!RpkFileUri.RemoveFromStart(TEXT("rpk:"), ESearchCase::CaseSensitive))
+	{
+		return false;
+	}
+
+	FScopeLock Lock(&LoadResolveMapLock);
+	const FString* ContentHash = RpkContentHashes.Find(RpkFileUri);
+	if (!ContentHash)
+	{
+		return false;
+	}
+
+	OutRpkUri = MoveTemp(RpkUri);
+	OutContentHash = *ContentHash;
+	return true;
 }
 
 void VitruvioModule::RegisterMesh(UStaticMesh* StaticMesh)
@@ -1017,6 +1217,33 @@ void VitruvioModule::UnregisterMesh(UStaticMesh* StaticMesh)
 	RegisteredMeshes.Remove(StaticMesh);
 }
 
+bool VitruvioModule::Tick(float DeltaTime)
+{
+	if (MaterialPipeline.HasPendingMaterials())
+	{
+		FScopeLock Lock(&RegisterMeshLock);
+		MaterialPipeline.GameThread_Tick(MaterialCache, TextureCache, RegisteredMeshes);
+	}
+
+	MeshCache.GameThread_Tick();
+
+	return true;
+}
+
+void VitruvioModule::OnPostGarbageCollect()
+{
+	for (auto It = MaterialCache.CreateIterator(); It; ++It)
+	{
+		if (!It->Value.IsValid())
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	// Textures of collected material instances are not referenced anymore and can be evicted now
+	TextureCache.TrimToBudget();
+}
+
 void VitruvioModule::InvalidateOcclusionHandle(int64 InitialShapeIndex)
 {
 	FScopeLock Lock(&OcclusionLock);
@@ -1144,7 +1371,7 @@ TFuture<ResolveMapSPtr> VitruvioModule::LoadResolveMapAsync(URulePackage* const
 			FScopeLock Lock(&LoadResolveMapLock);
 			// Task which does the actual resolve map loading which might take a long time
 			LoadTask = TGraphTask<FLoadResolveMapTask>::CreateTask().ConstructAndDispatchWhenReady(MoveTemp(Promise), RpkFolder, LazyRulePackagePtr,
-																								   ResolveMapCache, LoadResolveMapLock);
+																								   ResolveMapCache, RpkContentHashes, RpkFileUris, LoadResolveMapLock);
 			ResolveMapEventGraphRefCache.Add(LazyRulePackagePtr, LoadTask);
 		}
 
@@ -15,6 +15,8 @@
 
 #include "VitruvioTypes.h"
 
+#include "Hash/xxhash.h"
+#include "Misc/ScopeLock.h"
 #include "Runtime/Core/Public/Containers/UnrealString.h"
 #include "Runtime/Core/Public/Templates/TypeHash.h"
 
@@ -91,12 +93,151 @@ FLinearColor GetLinearColor(const prt::AttributeMap* MaterialAttributes, wchar_t
 	return FLinearColor(Color);
 }
 
+void SortByKey(Vitruvio::FMaterialAttributes& Attributes)
+{
+	Attributes.TextureProperties.KeySort(TLess<FString>());
+	Attributes.ColorProperties.KeySort(TLess<FString>());
+	Attributes.ScalarProperties.KeySort(TLess<FString>());
+	Attributes.StringProperties.KeySort(TLess<FString>());
+}
+
+// Strings are compared case insensitive by the property maps, so they are hashed in lower case
+void UpdateHash(FXxHash64Builder& Builder, const FString& Value)
+{
+	const FString LowerValue = Value.ToLower();
+	const int32 Length = LowerValue.Len();
+	Builder.Update(&Length, sizeof(Length));
+	Builder.Update(*LowerValue, Length * sizeof(TCHAR));
+}
+
+void UpdateHash(FXxHash64Builder& Builder, const FLinearColor& Value)
+{
+	Builder.Update(&Value, sizeof(Value));
+}
+
+void UpdateHash(FXxHash64Builder& Builder, double Value)
+{
+	Builder.Update(&Value, sizeof(Value));
+}
+
+template <typename V>
+void UpdateHash(FXxHash64Builder& Builder, const TMap<FString, V>& Properties)
+{
+	const int32 Num = Properties.Num();
+	Builder.Update(&Num, sizeof(Num));
+	for (const auto& [Key, Value] : Properties)
+	{
+		UpdateHash(Builder, Key);
+		UpdateHash(Builder, Value);
+	}
+}
+
+// Requires the properties to be sorted by key
+uint64 ComputeHash(const Vitruvio::FMaterialAttributes& Attributes)
+{
+	FXxHash64Builder Builder;
+	UpdateHash(Builder, Attributes.TextureProperties);
+	UpdateHash(Builder, Attributes.ColorProperties);
+	UpdateHash(Builder, Attributes.ScalarProperties);
+	UpdateHash(Builder, Attributes.StringProperties);
+	UpdateHash(Builder, Attributes.BlendMode);
+	return Builder.Finalize().Hash;
+}
+
+bool HasEqualAttributes(const Vitruvio::FMaterialAttributes& Lhs, const Vitruvio::FMaterialAttributes& RHS)
+{
+	// clang-format off
+	return Lhs.Hash == RHS.Hash &&
+		   Lhs.TextureProperties.OrderIndependentCompareEqual(RHS.TextureProperties) &&
+		   Lhs.ColorProperties.OrderIndependentCompareEqual(RHS.ColorProperties) &&
+		   Lhs.ScalarProperties.OrderIndependentCompareEqual(RHS.ScalarProperties) &&
+		   Lhs.StringProperties.OrderIndependentCompareEqual(RHS.StringProperties) &&
+		   Lhs.BlendMode == RHS.BlendMode;
+	// clang-format on
+}
+
+// Material attributes are created on the PRT callback threads, so interning is thread safe. Entries are weak, attributes are released
+// together with their last container.
+class FMaterialAttributesInterner
+{
+public:
+	TSharedPtr<const Vitruvio::FMaterialAttributes> Intern(Vitruvio::FMaterialAttributes&& Attributes)
+	{
+		SortByKey(Attributes);
+		Attributes.Hash = ComputeHash(Attributes);
+
+		FScopeLock Lock(&CriticalSection);
+
+		if (++InternCount % PruneInterval == 0)
+		{
+			Prune();
+		}
+
+		TArray<TWeakPtr<const Vitruvio::FMaterialAttributes>>& Candidates = Entries.FindOrAdd(Attributes.Hash);
+		for (int32 CandidateIndex = Candidates.Num() - 1; CandidateIndex >= 0; --CandidateIndex)
+		{
+			TSharedPtr<const Vitruvio::FMaterialAttributes> Candidate = Candidates[CandidateIndex].Pin();
+			if (!Candidate)
+			{
+				Candidates.RemoveAtSwap(CandidateIndex);
+			}
+			else if (HasEqualAttributes(*Candidate, Attributes))
+			{
+				return Candidate;
+			}
+		}
+
+		TSharedPtr<const Vitruvio::FMaterialAttributes> Result = MakeShared<Vitruvio::FMaterialAttributes>(MoveTemp(Attributes));
+		Candidates.Add(Result);
+		return Result;
+	}
+
+private:
+	static constexpr uint32 PruneInterval = 4096;
+
+	void Prune()
+	{
+		for (auto It = Entries.CreateIterator(); It; ++It)
+		{
+			It.Value().RemoveAllSwap([](const TWeakPtr<const Vitruvio::FMaterialAttributes>& Entry) { return !Entry.IsValid(); });
+			if (It.Value().IsEmpty())
+			{
+				It.RemoveCurrent();
+			}
+		}
+	}
+
+	FCriticalSection CriticalSection;
+	TMap<uint64, TArray<TWeakPtr<const Vitruvio::FMaterialAttributes>>> Entries;
+	uint32 InternCount = 0;
+};
+
+TSharedPtr<const Vitruvio::FMaterialAttributes> InternMaterialAttributes(Vitruvio::FMaterialAttributes&& Attributes)
+{
+	static FMaterialAttributesInterner Interner;
+	return Interner.Intern(MoveTemp(Attributes));
+}
+
 } // namespace
 
 namespace Vitruvio
 {
+FMaterialAttributeContainer::FMaterialAttributeContainer() : Name(CityEngineDefaultMaterialName)
+{
+	// Default containers are created frequently, so their attributes are only interned once
+	static const TSharedPtr<const FMaterialAttributes> DefaultAttributes = InternMaterialAttributes(FMaterialAttributes());
+	Attributes = DefaultAttributes;
+}
+
+FMaterialAttributeContainer::FMaterialAttributeContainer(FMaterialAttributes InAttributes, const FString& InName)
+	: Name(InName), Attributes(InternMaterialAttributes(MoveTemp(InAttributes)))
+{
+}
+
 FMaterialAttributeContainer::FMaterialAttributeContainer(const prt::AttributeMap* AttributeMap)
 {
+	FMaterialAttributes NewAttributes;
+
 	size_t KeyCount = 0;
 	wchar_t const* const* Keys = AttributeMap->getKeys(&KeyCount);
 	for (size_t KeyIndex = 0; KeyIndex < KeyCount; KeyIndex++)
@@ -119,11 +260,11 @@ FMaterialAttributeContainer::FMaterialAttributeContainer(const prt::AttributeMap
 
 				if (ColorMapUri.Len() > 0)
 				{
-					TextureProperties.Add(TEXT("colorMap"), ColorMapUri);
+					NewAttributes.TextureProperties.Add(TEXT("colorMap"), ColorMapUri);
 				}
 				if (DirtMapUri.Len() > 0)
 				{
-					TextureProperties.Add(TEXT("dirtMap"), DirtMapUri);
+					NewAttributes.TextureProperties.Add(TEXT("dirtMap"), DirtMapUri);
 				}
 			}
 			else
@@ -132,18 +273,18 @@ FMaterialAttributeContainer::FMaterialAttributeContainer(const prt::AttributeMap
 
 				if (MapUri.Len() > 0)
 				{
-					TextureProperties.Add(KeyString, MapUri);
+					NewAttributes.TextureProperties.Add(KeyString, MapUri);
 				}
 			}
 			break;
 		case EMaterialPropertyType::LinearColor:
-			ColorProperties.Add(KeyString, GetLinearColor(AttributeMap, Key));
+			NewAttributes.ColorProperties.Add(KeyString, GetLinearColor(AttributeMap, Key));
 			break;
 		case EMaterialPropertyType::Scalar:
-			ScalarProperties.Add(KeyString, AttributeMap->getFloat(Key));
+			NewAttributes.ScalarProperties.Add(KeyString, AttributeMap->getFloat(Key));
 			break;
 		case EMaterialPropertyType::String:
-			StringProperties.Add(KeyString, AttributeMap->getString(Key));
+			NewAttributes.StringProperties.Add(KeyString, AttributeMap->getString(Key));
 			break;
 		default:;
 		}
@@ -151,24 +292,42 @@ FMaterialAttributeContainer::FMaterialAttributeContainer(const prt::AttributeMap
 
 	if (AttributeMap->hasKey(L"opacityMap.mode"))
 	{
-		BlendMode = AttributeMap->getString(L"opacityMap.mode");
+		NewAttributes.BlendMode = AttributeMap->getString(L"opacityMap.mode");
 	}
 
 	if (AttributeMap->hasKey(L"name"))
 	{
 		Name = AttributeMap->getString(L"name");
 	}
+
+	Attributes = InternMaterialAttributes(MoveTemp(NewAttributes));
 }
 
-uint32 GetTypeHash(const FMaterialAttributeContainer& Object)
+FArchive& operator<<(FArchive& Ar, FMaterialAttributeContainer& Object)
 {
-	uint32 Hash = 0x274110C5;
-	Hash = HashCombine(Hash, GetMapHash<FString, FString>(Object.TextureProperties));
-	Hash = HashCombine(Hash, GetMapHash<FString, FLinearColor>(Object.ColorProperties));
-	Hash = HashCombine(Hash, GetMapHash<FString, double>(Object.ScalarProperties));
-	Hash = HashCombine(Hash, GetMapHash<FString, FString>(Object.StringProperties));
-	Hash = HashCombine(Hash, GetTypeHash(Object.BlendMode));
-	return Hash;
+	FMaterialAttributes Attributes = Ar.IsLoading() ? FMaterialAttributes() : Object.CopyAttributes();
+	Ar << Attributes.TextureProperties << Attributes.ColorProperties << Attributes.ScalarProperties << Attributes.StringProperties;
+	Ar << Attributes.BlendMode << Object.Name;
+
+	if (Ar.IsLoading())
+	{
+		Object.Attributes = InternMaterialAttributes(MoveTemp(Attributes));
+	}
+	return Ar;
+}
+
+FMaterialAttributeContainer SplitColorVariant(const FMaterialAttributeContainer& Material, FLinearColor& OutColor)
+{
+	const FLinearColor* DiffuseColor = Material.GetColorProperties().Find(TEXT("diffuseColor"));
+	OutColor = DiffuseColor ? *DiffuseColor : FLinearColor::White;
+	if (!DiffuseColor || *DiffuseColor == FLinearColor::White)
+	{
+		return Material;
+	}
+
+	FMaterialAttributes Attributes = Material.CopyAttributes();
+	Attributes.ColorProperties[TEXT("diffuseColor")] = FLinearColor::White;
+	return FMaterialAttributeContainer(MoveTemp(Attributes), Material.Name);
 }
 
 uint32 GetTypeHash(const FInstanceCacheKey& Object)
@@ -10,34 +10,45 @@ class VITRUVIO_API UCustomCollisionDataProvider : public UObject, public IInterf
 	GENERATED_BODY()
 
 protected:
-	Vitruvio::FCollisionData CollisionData;
+	Vitruvio::FCollisionDataPtr CollisionData;
+
+	/** Whether the collision data is kept after it has been cooked, eg. to allow re-cooking in the editor. */
+	bool bKeepCollisionDataAfterCooking = WITH_EDITOR;
 	
-	bool UpdateTrieMeshCollisionData(FTriMeshCollisionData* TriCollisionData) const
+	bool UpdateTrieMeshCollisionData(FTriMeshCollisionData* TriCollisionData)
 	{
-		if (!CollisionData.IsValid())
+		if (!CollisionData.IsValid() || !CollisionData->IsValid())
 		{
 			return false;
 		}
 
-		TriCollisionData->Indices = CollisionData.Indices;
-		TArray<uint16> MaterialIndices;
-		MaterialIndices.SetNumZeroed(CollisionData.Indices.Num());
-		TriCollisionData->MaterialIndices = MaterialIndices;
-		TriCollisionData->Vertices = CollisionData.Vertices;
+		// The data is copied since it has to survive a failed cook, it is released in OnCookFinished once cooking has succeeded
+		TriCollisionData->Indices = CollisionData->Indices;
+		TriCollisionData->Vertices = CollisionData->Vertices;
+
+		TriCollisionData->MaterialIndices.SetNumZeroed(TriCollisionData->Indices.Num());
 		TriCollisionData->bFlipNormals = true;
 		return true;
 	}
 	
 public:
-
-	void SetCollisionData(const Vitruvio::FCollisionData& InCollisionData)
+	void SetCollisionData(const Vitruvio::FCollisionDataPtr& InCollisionData)
 	{
 		CollisionData = InCollisionData;
 	}
 
 	void ClearCollisionData()
 	{
-		CollisionData = {};
+		CollisionData.Reset();
+	}
+
+	/** Releases the collision data once it has been cooked successfully, unless it has to be kept for re-cooking. */
+	void OnCookFinished(bool bSuccess)
+	{
+		if (bSuccess && !bKeepCollisionDataAfterCooking)
+		{
+			CollisionData.Reset();
+		}
 	}
 
 	virtual bool GetPhysicsTriMeshData(FTriMeshCollisionData* TriCollisionData, bool InUseAllTriData) override
@@ -47,6 +58,6 @@ public:
 
 	virtual bool ContainsPhysicsTriMeshData(bool InUseAllTriData) const override
 	{
-		return CollisionData.IsValid();
+		return CollisionData.IsValid() && CollisionData->IsValid();
 	}
 };
\ No newline at end of file
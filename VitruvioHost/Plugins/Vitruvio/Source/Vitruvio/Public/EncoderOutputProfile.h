@@ -0,0 +1,81 @@
+/* Copyright 2024 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "EncoderOutputProfile.generated.h"
+
+/**
+ * Defines which outputs the encoder emits during generation. Skipped outputs are not computed by PRT and not converted by Vitruvio.
+ */
+UENUM(BlueprintType, DisplayName = "Vitruvio Encoder Output Profile")
+enum class EEncoderOutputProfile : uint8
+{
+	/** Geometry, normals, all uv sets, materials and reports. */
+	Full,
+	/** Geometry and normals only. Models use the default material. */
+	GeometryOnly,
+	/** Positions and indices only. Intended for collision proxies and occluders. */
+	CollisionOnly,
+	/** Everything except reports. */
+	NoReports,
+	/** Everything but only the first uv set. */
+	FirstUVSetOnly
+};
+
+namespace Vitruvio
+{
+
+struct FEncoderOutputOptions
+{
+	bool bEmitReports = true;
+	bool bEmitMaterials = true;
+	bool bEmitNormals = true;
+
+	/** The maximum number of uv sets or -1 for all uv sets. */
+	int32 MaxUVSets = -1;
+
+	/** Returns a suffix for mesh cache keys, so that meshes with restricted outputs are not shared with fully generated meshes. */
+	FString GetMeshCacheSuffix() const
+	{
+		if (bEmitMaterials && bEmitNormals && MaxUVSets < 0)
+		{
+			return FString();
+		}
+		return FString::Printf(TEXT("#%d%d%d"), bEmitMaterials, bEmitNormals, MaxUVSets);
+	}
+};
+
+inline FEncoderOutputOptions GetEncoderOutputOptions(EEncoderOutputProfile Profile)
+{
+	switch (Profile)
+	{
+	case EEncoderOutputProfile::GeometryOnly:
+		return {false, false, true, 0};
+	case EEncoderOutputProfile::CollisionOnly:
+		return {false, false, false, 0};
+	case EEncoderOutputProfile::NoReports:
+		return {false, true, true, -1};
+	case EEncoderOutputProfile::FirstUVSetOnly:
+		return {true, true, true, 1};
+	case EEncoderOutputProfile::Full:
+	default:
+		return {};
+	}
+}
+
+} // namespace Vitruvio
@@ -0,0 +1,111 @@
+/* Copyright 2024 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "VitruvioTypes.h"
+
+#include "Async/Future.h"
+#include "UObject/ObjectKey.h"
+
+class FTextureCache;
+class UMeshComponent;
+class UStaticMesh;
+
+/**
+ * Creates the material instances of generated meshes without blocking the game thread. Textures are loaded on worker threads and meshes
+ * are built with a placeholder material instance in the meantime. Once all textures of a material have been loaded, its material instance
+ * is created within a per frame budget (see Esri.Vitruvio.MaterialFrameBudget) and replaces the placeholder. Game thread only.
+ */
+class FMaterialPipeline
+{
+public:
+	DECLARE_MULTICAST_DELEGATE_OneParam(FOnPlaceholdersReplaced, const TMap<UMaterialInterface*, UMaterialInterface*>&);
+
+	/** Broadcast with the replaced placeholders and their material instances, eg. to update material identifiers recorded for placeholders. */
+	FOnPlaceholdersReplaced OnPlaceholdersReplaced;
+
+	/**
+	 * \brief Returns the material instance for the given material attributes. If its textures still need to be loaded or the frame budget
+	 * has been used up, a placeholder material instance with the non texture parameters of the material is returned instead.
+	 *
+	 * \param Outer the outer of the loaded textures.
+	 * \param Name the name of the material instance.
+	 * \param TextureCache the cache of the loaded textures, which is used to look up and store textures.
+	 * \param bOutCacheable false if a texture of the returned material instance could not be read, eg. a generated texture which has already
+	 * been released. Such a material instance must not be cached, so that the texture is read again by the next request.
+	 * \return the material instance or its placeholder.
+	 */
+	VITRUVIO_API UMaterialInstanceDynamic* GameThread_RequestMaterial(UObject* Outer, const FString& Name, UMaterialInterface* OpaqueParent,
+																	  UMaterialInterface* MaskedParent, UMaterialInterface* TranslucentParent,
+																	  const Vitruvio::FMaterialAttributeContainer& MaterialAttributes,
+																	  FTextureCache& TextureCache, bool& bOutCacheable);
+
+	/**
+	 * \brief Creates the pending material instances whose textures have been loaded within the frame budget. Their placeholders are
+	 * replaced in the material cache, in the material slots of the given meshes and in the tracked material slots of mesh components.
+	 * Placeholders of material instances with textures which could not be read are removed from the material cache instead.
+	 */
+	void GameThread_Tick(TMap<Vitruvio::FMaterialAttributeContainer, TWeakObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
+						 FTextureCache& TextureCache, const TSet<TObjectPtr<UStaticMesh>>& Meshes);
+
+	/**
+	 * \brief Records the material slots of the given component which use placeholders, so that the component is updated once they are
+	 * replaced. Has to be called after the meshes and override materials of the component have been assigned.
+	 */
+	VITRUVIO_API void GameThread_TrackComponent(UMeshComponent* Component);
+
+	bool HasPendingMaterials() const
+	{
+		return !PendingMaterials.IsEmpty();
+	}
+
+	void AddReferencedObjects(FReferenceCollector& Collector);
+
+private:
+	struct FPendingMaterial
+	{
+		Vitruvio::FMaterialAttributeContainer MaterialAttributes;
+		FString Name;
+		TWeakObjectPtr<UObject> Outer;
+		TObjectPtr<UMaterialInterface> OpaqueParent;
+		TObjectPtr<UMaterialInterface> MaskedParent;
+		TObjectPtr<UMaterialInterface> TranslucentParent;
+		TObjectPtr<UMaterialInstanceDynamic> Placeholder;
+		TMap<FString, TSharedFuture<Vitruvio::FTextureData>> Textures;
+	};
+
+	struct FMaterialSlot
+	{
+		TWeakObjectPtr<UMeshComponent> Component;
+		int32 MaterialIndex;
+	};
+
+	bool ConsumeFrameBudget();
+
+	void ReplacePlaceholders(const TMap<UMaterialInterface*, UMaterialInterface*>& Replacements, const TSet<TObjectPtr<UStaticMesh>>& Meshes);
+
+	UMaterialInstanceDynamic* CreateMaterial(UObject* Outer, const FString& Name, UMaterialInterface* OpaqueParent, UMaterialInterface* MaskedParent,
+											 UMaterialInterface* TranslucentParent, const Vitruvio::FMaterialAttributeContainer& MaterialAttributes,
+											 const TMap<FString, TSharedFuture<Vitruvio::FTextureData>>& Textures, FTextureCache& TextureCache,
+											 bool& bOutTexturesRead);
+
+	TArray<FPendingMaterial> PendingMaterials;
+	TMap<FString, TSharedFuture<Vitruvio::FTextureData>> PendingTextures;
+	TMap<FObjectKey, TArray<FMaterialSlot>> PlaceholderSlots;
+
+	uint64 BudgetFrameCounter = TNumericLimits<uint64>::Max();
+	double BudgetEndTime = 0.0;
+};
@@ -16,6 +16,23 @@
 #pragma once
 #include "VitruvioMesh.h"
 
+#include <atomic>
+
+struct FMeshCacheStats
+{
+	int32 NumEntries = 0;
+	int64 SizeBytes = 0;
+	int64 Hits = 0;
+	int64 Misses = 0;
+	int64 Evictions = 0;
+};
+
+/**
+ * Thread safe cache of the meshes generated by PRT. The entries are distributed over several independently locked shards so that
+ * concurrent lookups from PRT callback threads do not contend on a single lock. If the estimated size of all entries exceeds the
+ * budget (see Esri.Vitruvio.MeshCacheBudget), the least recently used entries which are only referenced by the cache and not assigned
+ * to any component are evicted on the game thread.
+ */
 class FMeshCache
 {
 public:
@@ -23,8 +40,50 @@ public:
 	VITRUVIO_API TSharedPtr<FVitruvioMesh> InsertOrGet(const FString& Uri, const TSharedPtr<FVitruvioMesh>& Mesh);
 	VITRUVIO_API void Empty();
 
+	/**
+	 * \brief Evicts the least recently used entries which are only referenced by the cache and not assigned to any component until the
+	 * cache fits into the given budget. Meshes of generate results which have not been built yet are kept. Has to be called on the game
+	 * thread.
+	 *
+	 * \param BudgetBytes the maximum size of all cache entries in bytes.
+	 */
+	VITRUVIO_API void Trim(int64 BudgetBytes);
+
+	/**
+	 * Updates the sizes of the entries which have been built since the last call and trims the cache if it exceeds its budget. Has to
+	 * be called on the game thread.
+	 */
+	VITRUVIO_API void GameThread_Tick();
+
+	VITRUVIO_API FMeshCacheStats GetStats() const;
+
 private:
-	FCriticalSection MeshCacheCriticalSection;
+	struct FEntry
+	{
+		TSharedPtr<FVitruvioMesh> Mesh;
+		int64 SizeBytes = 0;
+		int64 LastAccess = 0;
+	};
+
+	struct FShard
+	{
+		mutable FRWLock Lock;
+		TMap<FString, FEntry> Entries;
+	};
+
+	static constexpr int32 NumShards = 16;
+
+	FShard& GetShard(const FString& Uri);
+
+	FShard Shards[NumShards];
+
+	// Entries whose size has been estimated before their mesh was built
+	FCriticalSection UnbuiltLock;
+	TArray<FString> UnbuiltIds;
 
-	TMap<FString, TSharedPtr<FVitruvioMesh>> Cache;
+	std::atomic<int64> AccessCounter = 0;
+	std::atomic<int64> SizeBytes = 0;
+	std::atomic<int64> Hits = 0;
+	std::atomic<int64> Misses = 0;
+	std::atomic<int64> Evictions = 0;
 };
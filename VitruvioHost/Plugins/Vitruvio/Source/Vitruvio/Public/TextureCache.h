@@ -0,0 +1,102 @@
+/* Copyright 2024 Esri
+ *
+ * Licensed under the Apache License Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "VitruvioTypes.h"
+
+struct FTextureCacheStats
+{
+	int32 NumUris = 0;
+	int32 NumTextures = 0;
+	int64 SizeBytes = 0;
+	int64 Hits = 0;
+	int64 Misses = 0;
+	int64 Evictions = 0;
+	int64 Deduplications = 0;
+};
+
+/**
+ * Cache of the textures decoded by PRT, by texture uri. Textures are stored by the hash of their decoded content, so identical images from
+ * different uris (eg. different rule packages) share one texture. If the size of all textures exceeds the budget (see
+ * Esri.Vitruvio.TextureCacheBudget), the least recently used textures which are not referenced by any live material instance are evicted.
+ * Game thread only, except for FindByContentHash.
+ */
+class FTextureCache
+{
+public:
+	/** Returns the cached texture of the given uri or nullptr. */
+	VITRUVIO_API const Vitruvio::FTextureData* Find(const FString& Uri);
+
+	/**
+	 * \brief Adds a decoded texture. If a texture with the same content is already cached, the uri refers to the cached texture instead.
+	 * Does not trim the cache, so that the caller can register the material which uses the texture before calling TrimToBudget.
+	 *
+	 * \return the cached texture of the uri.
+	 */
+	VITRUVIO_API Vitruvio::FTextureData Add(const FString& Uri, const Vitruvio::FTextureData& TextureData);
+
+	VITRUVIO_API void Remove(const FString& Uri);
+
+	/**
+	 * \brief Finds a cached texture by the hash of its content. Thread safe.
+	 *
+	 * \return whether a texture with the given content is cached.
+	 */
+	VITRUVIO_API bool FindByContentHash(uint64 ContentHash, Vitruvio::FTextureData& OutTextureData) const;
+
+	/** Records that the given material instance uses a cached texture, which keeps the texture from being evicted while the material is alive. */
+	VITRUVIO_API void AddMaterialReference(uint64 ContentHash, UMaterialInstanceDynamic* Material);
+
+	/**
+	 * \brief Evicts the least recently used textures which are not referenced by any live material instance until the cache fits into the
+	 * given budget.
+	 *
+	 * \param BudgetBytes the maximum size of all cached textures in bytes.
+	 */
+	VITRUVIO_API void Trim(int64 BudgetBytes);
+
+	/** Trims the cache if it exceeds its budget (see Esri.Vitruvio.TextureCacheBudget). */
+	VITRUVIO_API void TrimToBudget();
+
+	VITRUVIO_API FTextureCacheStats GetStats() const;
+
+	void AddReferencedObjects(FReferenceCollector& Collector);
+
+private:
+	struct FEntry
+	{
+		Vitruvio::FTextureData TextureData;
+		TArray<FString> Uris;
+		TArray<TWeakObjectPtr<UMaterialInstanceDynamic>> Materials;
+		int64 SizeBytes = 0;
+		int64 LastAccess = 0;
+	};
+
+	void RemoveEntry(uint64 ContentHash);
+
+	TMap<FString, uint64> UriContentHashes;
+
+	// Written on the game thread only, so the game thread can read it without taking the lock
+	mutable FRWLock EntriesLock;
+	TMap<uint64, FEntry> Entries;
+
+	int64 AccessCounter = 0;
+	int64 SizeBytes = 0;
+	int64 Hits = 0;
+	int64 Misses = 0;
+	int64 Evictions = 0;
+	int64 Deduplications = 0;
+};
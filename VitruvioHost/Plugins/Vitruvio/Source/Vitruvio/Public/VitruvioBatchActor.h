@@ -54,6 +54,13 @@ public:
 	UPROPERTY()
 	UGeneratedModelStaticMeshComponent* GeneratedModelComponent;
 
+	TArray<TSharedPtr<FVitruvioMesh>> LazyCollisionMeshes;
+
+	/** The texture atlases of the merged materials of the generated model, which are released once the tile is regenerated or destroyed. */
+	TArray<FString> GeneratedTextures;
+
+	virtual void BeginDestroy() override;
+
 	void MarkForAttributeEvaluation(UVitruvioComponent* VitruvioComponent, UGenerateCompletedCallbackProxy* CallbackProxy = nullptr);
 	void UnmarkForAttributeEvaluation();
 	
@@ -104,6 +111,7 @@ struct FBatchGenerateQueueItem
 	FGenerateResultDescription GenerateResultDescription;
 	UTile* Tile;
 	TArray<UVitruvioComponent*> VitruvioComponents;
+	TArray<FString> GeneratedTextures;
 };
 
 struct FEvaluateAttributesQueueItem
@@ -125,6 +133,26 @@ public:
 	UPROPERTY(EditAnywhere, Category = "Vitruvio")
 	bool bEnableOcclusionQueries = false;
 
+	/** LOD settings for all batch generated models and their instance meshes. */
+	UPROPERTY(EditAnywhere, DisplayName = "LOD Settings", Category = "Vitruvio")
+	FVitruvioLodSettings LodSettings;
+
+	/** Collision settings for all batch generated models and their instance meshes. The cook distance of lazy collision is measured per tile. */
+	UPROPERTY(EditAnywhere, DisplayName = "Collision Settings", Category = "Vitruvio")
+	FVitruvioCollisionSettings CollisionSettings;
+
+	/** Defines which outputs are generated for the tiles. Reports are not available for batch generated models and are skipped by default. */
+	UPROPERTY(EditAnywhere, Category = "Vitruvio")
+	EEncoderOutputProfile OutputProfile = EEncoderOutputProfile::NoReports;
+
+	/**
+	 * Merges the materials of the generated models which only differ by their textures into materials which use texture atlases, to reduce
+	 * the number of draw calls. Only materials with non repeating 8 bit textures are merged. Material replacements apply to the merged
+	 * materials, which are named "Atlas".
+	 */
+	UPROPERTY(EditAnywhere, Category = "Vitruvio")
+	bool bMergeMaterials = false;
+
 #if WITH_EDITORONLY_DATA
 	UPROPERTY(EditAnywhere, Category = "Vitruvio")
 	bool bDebugVisualizeGrid = false;
@@ -136,12 +164,21 @@ private:
 
 	TQueue<FBatchGenerateQueueItem> GenerateQueue;
 	TQueue<FEvaluateAttributesQueueItem> AttributeEvaluationQueue;
+	bool bBuildingGenerateResult = false;
 
 	UPROPERTY(Transient)
 	TMap<UMaterialInterface*, FString> MaterialIdentifiers;
 	TMap<FString, int32> UniqueMaterialIdentifiers;
 
+	// Material identifiers of the tile which is currently built time sliced, they replace the identifiers above together with the tile model
+	UPROPERTY(Transient)
+	TMap<UMaterialInterface*, FString> PendingMaterialIdentifiers;
+	TMap<FString, int32> PendingUniqueMaterialIdentifiers;
+
 	int NumModelComponents = 0;
+
+	FDelegateHandle PlaceholdersReplacedDelegate;
+	void OnPlaceholdersReplaced(const TMap<UMaterialInterface*, UMaterialInterface*>& Replacements);
 	
 	UPROPERTY(Transient)
 	TSet<UVitruvioComponent*> VitruvioComponents;
@@ -168,6 +205,7 @@ private:
 public:
 	AVitruvioBatchActor();
 
+	virtual void BeginDestroy() override;
 	virtual void Tick(float DeltaSeconds) override;
 
 	void RegisterVitruvioComponent(UVitruvioComponent* VitruvioComponent, bool bGenerateModel = true);
@@ -207,6 +245,7 @@ private:
 	void ProcessTiles();
 	void ProcessGenerateQueue();
 	void ProcessAttributeEvaluationQueue();
+	void ProcessLazyCollision();
 
 	FCriticalSection ProcessGenerateQueueCriticalSection;
 	FCriticalSection ProcessAttributeEvaluationQueueCriticalSection;
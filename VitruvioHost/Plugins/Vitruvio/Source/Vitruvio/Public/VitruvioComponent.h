@@ -20,6 +20,7 @@
 #include "VitruvioModule.h"
 
 #include "CoreMinimal.h"
+#include "EncoderOutputProfile.h"
 #include "GeneratedModelHISMComponent.h"
 #include "GeneratedModelStaticMeshComponent.h"
 #include "InitialShape.h"
@@ -34,6 +35,7 @@ DECLARE_LOG_CATEGORY_EXTERN(LogVitruvioComponent, Log, All);
 class UGenerateCompletedCallbackProxy;
 
 extern TAutoConsoleVariable<float> CVarInterOcclusionNeighborQueryDistance;
+extern TAutoConsoleVariable<float> CVarMeshBuildFrameBudget;
 
 USTRUCT(BlueprintType)
 struct FGenerateOptions
@@ -44,6 +46,65 @@ struct FGenerateOptions
 	bool bIgnoreMaterialReplacements = false;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vitruvio")
 	bool bIgnoreInstanceReplacements = false;
+	/** Defines which outputs are generated. Restricting the outputs skips the corresponding work in PRT and during conversion. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vitruvio")
+	EEncoderOutputProfile OutputProfile = EEncoderOutputProfile::Full;
+};
+
+USTRUCT(BlueprintType)
+struct FVitruvioLodSettings
+{
+	GENERATED_BODY()
+
+	/**
+	 * Generate simplified LODs for the generated model and instance meshes. Only available in editor builds (including play in editor),
+	 * since the mesh reduction module is not part of packaged builds. Packaged builds ignore this setting and log a warning.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, DisplayName = "Generate LODs", Category = "Vitruvio")
+	bool bGenerateLods = false;
+
+	/** The number of simplified LODs which are generated in addition to LOD0. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, DisplayName = "Number of LODs", Category = "Vitruvio",
+		meta = (EditCondition = "bGenerateLods", ClampMin = 1, ClampMax = 3))
+	int32 NumLods = 3;
+
+	/** The screen size at which LOD1, LOD2 and LOD3 are displayed. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vitruvio", meta = (EditCondition = "bGenerateLods"))
+	FVector3f ScreenSizes = {0.5f, 0.25f, 0.1f};
+
+	/** The percentage of triangles kept for LOD1, LOD2 and LOD3. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vitruvio", meta = (EditCondition = "bGenerateLods", ClampMin = 0, ClampMax = 1))
+	FVector3f ReductionPercentages = {0.5f, 0.25f, 0.1f};
+};
+
+UENUM(BlueprintType)
+enum class EVitruvioCollisionPolicy : uint8
+{
+	/** No collision is created and the generated components do not collide. */
+	None,
+	/** Complex collision is cooked synchronously right after generation. */
+	Sync,
+	/** Complex collision is cooked asynchronously once a view is within the cook distance. */
+	Lazy,
+	/** Complex collision is cooked asynchronously right after generation. */
+	Async,
+	/** A single box around each generated mesh. Does not need any cooking. */
+	Simplified
+};
+
+USTRUCT(BlueprintType)
+struct FVitruvioCollisionSettings
+{
+	GENERATED_BODY()
+
+	/** Defines if and when collision is created for the generated model and instance meshes. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vitruvio")
+	EVitruvioCollisionPolicy Policy = EVitruvioCollisionPolicy::Sync;
+
+	/** The distance in cm between a view and the generated model at which lazy collision is cooked. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vitruvio",
+		meta = (EditCondition = "Policy == EVitruvioCollisionPolicy::Lazy", EditConditionHides, ClampMin = 0))
+	float CookDistance = 10000.0f;
 };
 
 struct FAttributesEvaluationQueueItem
@@ -67,6 +128,10 @@ struct FInstance
 	TArray<UMaterialInstanceDynamic*> OverrideMaterials;
 	TArray<FTransform> Transforms;
 
+	/** The per instance custom data of all instances, NumCustomDataFloats per instance in the order of the transforms. */
+	int32 NumCustomDataFloats = 0;
+	TArray<float> CustomData;
+
 	friend FORCEINLINE uint32 GetTypeHash(const FInstance& Request)
 	{
 		return GetTypeHash(Request.InstanceMesh->GetIdentifier());
@@ -90,9 +155,28 @@ struct FConvertedGenerateResult
 	TMap<FString, FReport> Reports;
 };
 
+/**
+ * Builds the static meshes of a generate result until EndTime has been reached. At least one mesh is built per call.
+ *
+ * \return true if all meshes of the generate result have been built.
+ */
+bool BuildGenerateResultMeshes(const FGenerateResultDescription& GenerateResult,
+							   TMap<Vitruvio::FMaterialAttributeContainer, TWeakObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
+							   FTextureCache& TextureCache,
+							   TMap<UMaterialInterface*, FString>& MaterialIdentifiers,
+							   TMap<FString, int32>& UniqueMaterialIdentifiers,
+							   UMaterial* OpaqueParent, UMaterial* MaskedParent, UMaterial* TranslucentParent,
+							   UWorld* World, double EndTime = TNumericLimits<double>::Max());
+
+/**
+ * Returns the time at which the mesh build budget of the current frame (see Esri.Vitruvio.MeshBuildFrameBudget) is exhausted. The budget
+ * is shared by all Vitruvio components and batch actors.
+ */
+double GetMeshBuildFrameEndTime();
+
 FConvertedGenerateResult BuildGenerateResult(const FGenerateResultDescription& GenerateResult,
-									 TMap<Vitruvio::FMaterialAttributeContainer, TObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
-									 TMap<FString, Vitruvio::FTextureData>& TextureCache,
+									 TMap<Vitruvio::FMaterialAttributeContainer, TWeakObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
+									 FTextureCache& TextureCache,
 									 TMap<UMaterialInterface*, FString>& MaterialIdentifiers,
 									 TMap<FString, int32>& UniqueMaterialIdentifiers,
 									 UMaterial* OpaqueParent, UMaterial* MaskedParent, UMaterial* TranslucentParent,
@@ -100,14 +184,41 @@ FConvertedGenerateResult BuildGenerateResult(const FGenerateResultDescription& G
 
 FString UniqueComponentName(const FString& Name, TMap<FString, int32>& UsedNames);
 
+/** Adds the transforms and the per instance custom data of the given instance to an instanced static mesh component. */
+void AddInstances(UInstancedStaticMeshComponent* InstancedComponent, const FInstance& Instance);
+
 void ApplyMaterialReplacements(UStaticMeshComponent* StaticMeshComponent, const TMap<UMaterialInterface*, FString>& MaterialIdentifiers,
 							   UMaterialReplacementAsset* Replacement);
 
+/** Moves the identifiers which have been recorded for placeholder materials to the material instances which replaced them. */
+void ReplaceMaterialIdentifiers(TMap<UMaterialInterface*, FString>& MaterialIdentifiers,
+								const TMap<UMaterialInterface*, UMaterialInterface*>& Replacements);
+
 TSet<FInstance> ApplyInstanceReplacements(UGeneratedModelStaticMeshComponent* GeneratedModelComponent, 
 											  const TArray<FInstance>& Instances, UInstanceReplacementAsset* Replacement, TMap<FString, int32>& NameMap);
 
 void InitializeBodySetup(UBodySetup* BodySetup);
 
+/**
+ * Generates the LODs for the generated model and all instance meshes of the given result. Intended to be called on a worker thread
+ * before the result is built on the game thread.
+ */
+void GenerateLods(const FGenerateResultDescription& GenerateResult, const FVitruvioLodSettings& LodSettings);
+
+/**
+ * Creates the collision for the generated model and instance meshes of the given result according to the collision policy.
+ *
+ * \return the meshes whose collision is deferred by the lazy policy, see CreateLazyCollision.
+ */
+TArray<TSharedPtr<FVitruvioMesh>> CreateCollision(const FConvertedGenerateResult& Result, EVitruvioCollisionPolicy Policy);
+
+/**
+ * Creates the collision of the given meshes once a view of the World is within CookDistance of Bounds.
+ *
+ * \return true if the collision has been created and the meshes can be released.
+ */
+bool CreateLazyCollision(const TArray<TSharedPtr<FVitruvioMesh>>& Meshes, const UWorld* World, const FBox& Bounds, float CookDistance);
+
 UCLASS(ClassGroup = (Custom), meta = (BlueprintSpawnableComponent))
 class VITRUVIO_API UVitruvioComponent : public UActorComponent
 {
@@ -142,6 +253,16 @@ public:
 		meta = (EditCondition = "!bBatchGenerate", EditConditionHides))
 	bool HideAfterGeneration = false;
 
+	/** LOD settings for the generated model and instance meshes. Note that instance meshes are shared between models, the first generated model defines their LODs. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, DisplayName = "LOD Settings", Category = "Vitruvio",
+		meta = (EditCondition = "!bBatchGenerate", EditConditionHides))
+	FVitruvioLodSettings LodSettings;
+
+	/** Collision settings for the generated model and instance meshes. Note that instance meshes are shared between models, the first generated model defines their collision. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, DisplayName = "Collision Settings", Category = "Vitruvio",
+		meta = (EditCondition = "!bBatchGenerate", EditConditionHides))
+	FVitruvioCollisionSettings CollisionSettings;
+
 	/** Default parent material for opaque geometry. */
 	UPROPERTY(EditAnywhere, DisplayName = "Opaque Parent", Category = "Vitruvio Default Materials",
 		meta = (EditCondition = "!bBatchGenerate", EditConditionHides))
@@ -529,6 +650,8 @@ private:
 
 	TQueue<FGenerateQueueItem> GenerateQueue;
 	TQueue<FAttributesEvaluationQueueItem> AttributesEvaluationQueue;
+	bool bBuildingGenerateResult = false;
+	TArray<TSharedPtr<FVitruvioMesh>> LazyCollisionMeshes;
 
 	FGenerateResult::FTokenPtr GenerateToken;
 	FAttributeMapResult::FTokenPtr EvalAttributesInvalidationToken;
@@ -540,6 +663,11 @@ private:
 	TMap<UMaterialInterface*, FString> MaterialIdentifiers;
 	TMap<FString, int32> UniqueMaterialIdentifiers;
 
+	// Material identifiers of the result which is currently built time sliced, they replace the identifiers above together with the model
+	UPROPERTY()
+	TMap<UMaterialInterface*, FString> PendingMaterialIdentifiers;
+	TMap<FString, int32> PendingUniqueMaterialIdentifiers;
+
 	TArray<FInitialShape> GetNeighboringShapes() const;
 	
 	void CalculateRandomSeed();
@@ -549,6 +677,9 @@ private:
 	void ProcessGenerateQueue();
 	void ProcessAttributesEvaluationQueue();
 
+	void OnPlaceholdersReplaced(const TMap<UMaterialInterface*, UMaterialInterface*>& Replacements);
+	FDelegateHandle PlaceholdersReplacedDelegate;
+
 #if WITH_EDITOR
 	FDelegateHandle PropertyChangeDelegate;
 
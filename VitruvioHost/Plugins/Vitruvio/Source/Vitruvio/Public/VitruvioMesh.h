@@ -20,23 +20,50 @@
 #include "VitruvioTypes.h"
 #include "Runtime/PhysicsCore/Public/Interface_CollisionDataProviderCore.h"
 
+class FStaticMeshRenderData;
+class FTextureCache;
+class UStaticMeshComponent;
 
 UMaterialInstanceDynamic* CacheMaterial(UMaterial* OpaqueParent, UMaterial* MaskedParent, UMaterial* TranslucentParent,
-										TMap<FString, Vitruvio::FTextureData>& TextureCache,
-										TMap<Vitruvio::FMaterialAttributeContainer, TObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
+										FTextureCache& TextureCache,
+										TMap<Vitruvio::FMaterialAttributeContainer, TWeakObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
 										const Vitruvio::FMaterialAttributeContainer& MaterialAttributes, TMap<FString, int32>& UniqueMaterialNames,
 										TMap<UMaterialInterface*, FString>& MaterialIdentifiers, UObject* Outer);
 
-class FVitruvioMesh
+/** Defines what happens to the mesh description of a FVitruvioMesh once its static mesh has been built. */
+enum class EMeshDescriptionRetention : uint8
+{
+	/** Keep the mesh description as is. */
+	Keep,
+	/** Keep the mesh description compressed in memory. It is decompressed on request. */
+	Compress,
+	/** Release the mesh description. The materials are kept since they are small and needed to assign the materials of the static mesh. */
+	Drop
+};
+
+class FVitruvioMesh : public TSharedFromThis<FVitruvioMesh>
 {
 	FString Identifier;
 
 	FMeshDescription MeshDescription;
 	TArray<Vitruvio::FMaterialAttributeContainer> Materials;
 
+	TArray<uint8> CompressedMeshDescription;
+	int32 UncompressedMeshDescriptionSize = 0;
+
+	TArray<FMeshDescription> LodMeshDescriptions;
+	TArray<float> LodScreenSizes;
+	mutable FCriticalSection BuildCriticalSection;
+
+	TUniquePtr<FStaticMeshRenderData> PreparedRenderData;
+	Vitruvio::FCollisionDataPtr PreparedCollisionData;
+
 	UStaticMesh* StaticMesh;
 	UCustomCollisionDataProvider* CollisionDataProvider;
 
+	// The components which have been assigned the static mesh, only accessed on the game thread
+	TArray<TWeakObjectPtr<UStaticMeshComponent>> Users;
+
 public:
 	FVitruvioMesh(const FString& Identifier, const FMeshDescription& MeshDescription,
 				  const TArray<Vitruvio::FMaterialAttributeContainer>& Materials)
@@ -51,18 +78,69 @@ public:
 		return Identifier;
 	}
 
-	const TArray<Vitruvio::FMaterialAttributeContainer>& GetMaterials() const
-	{
-		return Materials;
-	}
+	/** Returns a copy of the materials of the mesh. */
+	TArray<Vitruvio::FMaterialAttributeContainer> GetMaterials() const;
+
+	/**
+	 * \brief Copies the mesh description into OutMeshDescription, decompressing it if it has been compressed after the build.
+	 *
+	 * \return false if the mesh description has been dropped after the build.
+	 */
+	bool GetMeshDescription(FMeshDescription& OutMeshDescription) const;
+
+	/** Returns an estimate of the memory used by the mesh data and the render data of the mesh. */
+	SIZE_T GetAllocatedSize() const;
 
 	UStaticMesh* GetStaticMesh() const
 	{
 		return StaticMesh;
 	}
 
-	void Build(const FString& Name, TMap<Vitruvio::FMaterialAttributeContainer, TObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
-			   TMap<FString, Vitruvio::FTextureData>& TextureCache, TMap<UMaterialInterface*, FString>& MaterialIdentifiers,
+	/**
+	 * \brief Generates simplified LODs from the base mesh description. Thread safe and intended to be called from a worker thread
+	 * before Build. Meshes which already have LODs or which have already been built are left untouched. Does nothing in packaged builds,
+	 * which do not contain the mesh reduction module.
+	 *
+	 * \param ReductionPercentages the percentage of triangles to keep for each LOD (starting at LOD1).
+	 * \param ScreenSizes the screen size at which each LOD is displayed (starting at LOD1).
+	 */
+	void GenerateLods(const TArray<float>& ReductionPercentages, const TArray<float>& ScreenSizes);
+
+	/**
+	 * \brief Prepares everything which does not need the game thread for Build: the collision data and, at runtime, the render data of the
+	 * base mesh, so that Build only needs to initialize the render resources. The editor builds the render data in Build since it needs
+	 * the mesh description committed to the static mesh (eg. for cooking). Thread safe and intended to be called from a worker thread.
+	 */
+	void PrepareBuild();
+
+	bool IsBuilt() const
+	{
+		return StaticMesh != nullptr;
+	}
+
+	/**
+	 * \brief Creates the body setup of the built static mesh. Simplified collision uses a single box around the mesh bounds. Meshes which
+	 * already have collision are left untouched, so the first caller defines the collision of shared instance meshes.
+	 *
+	 * \param bSimplified whether to create simplified instead of complex collision.
+	 * \param bAsync whether complex collision is cooked asynchronously instead of blocking the game thread.
+	 */
+	void CreateCollision(bool bSimplified, bool bAsync);
+
+	bool HasCollision() const;
+
+	/** Registers a component which has been assigned the static mesh. Its physics state is recreated once the collision has been cooked. */
+	void AddUser(UStaticMeshComponent* Component);
+
+	/** Returns whether the static mesh is still assigned to any registered user. Has to be called on the game thread. */
+	bool IsInUse() const;
+
+	void Build(const FString& Name, TMap<Vitruvio::FMaterialAttributeContainer, TWeakObjectPtr<UMaterialInstanceDynamic>>& MaterialCache,
+			   FTextureCache& TextureCache, TMap<UMaterialInterface*, FString>& MaterialIdentifiers,
 			   TMap<FString, int32>& UniqueMaterialNames, UMaterial* OpaqueParent, UMaterial* MaskedParent, UMaterial* TranslucentParent,
 			   UWorld* World);
+
+private:
+	void ApplyMeshDescriptionRetention(EMeshDescriptionRetention Retention);
+	void RecreatePhysicsState();
 };
@@ -16,14 +16,18 @@
 #pragma once
 
 #include "AttributeMap.h"
+#include "EncoderOutputProfile.h"
 #include "InitialShape.h"
+#include "MaterialPipeline.h"
 #include "MeshCache.h"
 #include "PRTTypes.h"
 #include "Report.h"
 #include "RulePackage.h"
+#include "TextureCache.h"
 
 #include "prt/Object.h"
 
+#include "Containers/Ticker.h"
 #include "Engine/StaticMesh.h"
 #include "HAL/ThreadSafeCounter.h"
 #include "HAL/ThreadSafeBool.h"
@@ -37,6 +41,11 @@
 
 DECLARE_LOG_CATEGORY_EXTERN(LogUnrealPrt, Log, All);
 
+namespace Vitruvio
+{
+struct FTextureMetadata;
+}
+
 struct FGenerateResultDescription
 {
 	TSharedPtr<FVitruvioMesh> GeneratedModel;
@@ -121,19 +130,50 @@ public:
 	void ShutdownModule() override;
 
 	/**
-	 * \brief Decodes the given texture.
+	 * \brief Decodes the given texture. The returned texture is rooted until the caller removes it from the root set.
 	 */
 	VITRUVIO_API Vitruvio::FTextureData DecodeTexture(UObject* Outer, const FString& Path, const FString& Key) const;
 
+	/**
+	 * \brief Reads the metadata and the pixel data of a texture from PRT or from the registered generated textures. Thread safe.
+	 *
+	 * \return the pixel data in the layout of PRT (rows from bottom to top) or nullptr if the texture can not be read.
+	 */
+	VITRUVIO_API std::unique_ptr<uint8_t[]> ReadTexture(const FString& Path, Vitruvio::FTextureMetadata& OutMetadata, size_t& OutBufferSize) const;
+
+	/**
+	 * \brief Registers pixel data which has been generated on the CPU (eg. texture atlases), so that it can be used as texture by
+	 * materials. Registering identical pixel data again returns the same uri and increments its reference count. Thread safe.
+	 *
+	 * \param Name the base name of the uri, which is used to name the texture.
+	 * \param Pixels the pixel data in the layout of PRT (rows from bottom to top).
+	 * \return the uri of the generated texture.
+	 */
+	VITRUVIO_API FString RegisterGeneratedTexture(const FString& Name, const Vitruvio::FTextureMetadata& Metadata, TArray64<uint8> Pixels);
+
+	/** Releases a reference to a generated texture. Its pixel data is freed once it is not referenced anymore. Thread safe. */
+	VITRUVIO_API void ReleaseGeneratedTexture(const FString& Uri);
+
+	/**
+	 * \return the generation of decoded textures. It is incremented whenever rule packages are reloaded and the PRT cache is flushed,
+	 * which invalidates all textures decoded before. Validating cached textures therefore does not need to access the file system.
+	 */
+	VITRUVIO_API uint32 GetTextureCacheGeneration() const
+	{
+		return TextureCacheGeneration;
+	}
+
 	/**
 	 * \brief Asynchronously evaluates the attributes and generates the models for all given InitialShapes.
 	 *
 	 * \param InitialShapes
 	 * \param bEnableOcclusionQueries
 	 * \param OccluderOnlyShapes
+	 * \param OutputProfile defines which outputs are generated by the encoder
 	 * \return the generated UStaticMesh.
 	 */
-	VITRUVIO_API FBatchGenerateResult BatchGenerateAsync(TArray<FInitialShape> InitialShapes, bool bEnableOcclusionQueries, TArray<FInitialShape> OccluderOnlyShapes) const;
+	VITRUVIO_API FBatchGenerateResult BatchGenerateAsync(TArray<FInitialShape> InitialShapes, bool bEnableOcclusionQueries, TArray<FInitialShape> OccluderOnlyShapes,
+														 EEncoderOutputProfile OutputProfile = EEncoderOutputProfile::Full) const;
 
 	/**
 	 * \brief Generate the models with the given InitialShapes.
@@ -141,9 +181,12 @@ public:
 	 * \param InitialShapes
 	 * \param bEnableOcclusionQueries
 	 * \param OccluderOnlyShapes
-	 * \return the generated UStaticMesh.
+	 * \param OutputProfile defines which outputs are generated by the encoder
+	 * \return the generated UStaticMesh. Unlike the instance meshes, the generated model has not been prepared for its build yet, so that its
+	 * materials can still be consolidated (see FVitruvioMesh::PrepareBuild).
 	 */
-	VITRUVIO_API FGenerateResultDescription BatchGenerate(TArray<FInitialShape> InitialShapes, bool bEnableOcclusionQueries, TArray<FInitialShape> OccluderOnlyShapes) const;
+	VITRUVIO_API FGenerateResultDescription BatchGenerate(TArray<FInitialShape> InitialShapes, bool bEnableOcclusionQueries, TArray<FInitialShape> OccluderOnlyShapes,
+														  EEncoderOutputProfile OutputProfile = EEncoderOutputProfile::Full) const;
 
 	/**
 	 * \brief Asynchronously Evaluates attributes for the given initial shapes and rule packages.
@@ -165,9 +208,10 @@ public:
 	 * \param InitialShapes The initial shapes to generate the models for.
 	 *						Initial shapes after the first one are considered occlusion shapes and will not be generated as models,
 	 *						but only used for occlusion queries.
+	 * \param OutputProfile defines which outputs are generated by the encoder
 	 * \return the generated UStaticMesh.
 	 */
-	VITRUVIO_API FGenerateResult GenerateAsync(TArray<FInitialShape> InitialShapes) const;
+	VITRUVIO_API FGenerateResult GenerateAsync(TArray<FInitialShape> InitialShapes, EEncoderOutputProfile OutputProfile = EEncoderOutputProfile::Full) const;
 
 	/**
 	 * \brief Generate the models with the given InitialShape, RulePackage and Attributes.
@@ -175,9 +219,10 @@ public:
 	 * \param InitialShapes The initial shapes to generate the models for.
 	 *						Initial shapes after the first one are considered occlusion shapes and will not be generated as models,
 	 *						but only used for occlusion queries.
+	 * \param OutputProfile defines which outputs are generated by the encoder
 	 * \return the generated UStaticMesh.
 	 */
-	VITRUVIO_API FGenerateResultDescription Generate(TArray<FInitialShape> InitialShapes) const;
+	VITRUVIO_API FGenerateResultDescription Generate(TArray<FInitialShape> InitialShapes, EEncoderOutputProfile OutputProfile = EEncoderOutputProfile::Full) const;
 
 	/**
 	 * \brief Asynchronously evaluates attributes for the given initial shape and rule package.
@@ -221,9 +266,10 @@ public:
 	}
 
 	/**
-	 * \returns the cache used for materials generated by PRT.
+	 * \returns the cache used for materials generated by PRT. The material instances are kept alive by the meshes and components using
+	 * them, entries of collected material instances are removed after garbage collection.
 	 */
-	VITRUVIO_API TMap<Vitruvio::FMaterialAttributeContainer, TObjectPtr<UMaterialInstanceDynamic>>& GetMaterialCache()
+	VITRUVIO_API TMap<Vitruvio::FMaterialAttributeContainer, TWeakObjectPtr<UMaterialInstanceDynamic>>& GetMaterialCache()
 	{
 		return MaterialCache;
 	}
@@ -237,9 +283,27 @@ public:
 	}
 
 	/**
-	 * \returns the cache used for materials generated by PRT.
+	 * \returns the pipeline which creates the materials generated by PRT.
+	 */
+	VITRUVIO_API FMaterialPipeline& GetMaterialPipeline()
+	{
+		return MaterialPipeline;
+	}
+
+	/**
+	 * Finds the rule package an asset uri points into.
+	 *
+	 * @param AssetUri the uri of an asset inside a loaded rule package.
+	 * @param OutRpkUri the part of the asset uri which identifies the rule package in this session.
+	 * @param OutContentHash the hash of the content of the rule package which stays the same across sessions.
+	 * @return whether the asset uri points into a loaded rule package.
 	 */
-	VITRUVIO_API TMap<FString, Vitruvio::FTextureData>& GetTextureCache()
+	VITRUVIO_API bool FindRulePackageContentHash(const FString& AssetUri, FString& OutRpkUri, FString& OutContentHash) const;
+
+	/**
+	 * \returns the cache used for textures generated by PRT.
+	 */
+	VITRUVIO_API FTextureCache& GetTextureCache()
 	{
 		return TextureCache;
 	}
@@ -289,8 +353,9 @@ public:
 
 	void AddReferencedObjects(FReferenceCollector& Collector) override
 	{
-		Collector.AddReferencedObjects(MaterialCache);
 		Collector.AddReferencedObjects(RegisteredMeshes);
+		MaterialPipeline.AddReferencedObjects(Collector);
+		TextureCache.AddReferencedObjects(Collector);
 	}
 
 	FString GetReferencerName() const override
@@ -316,11 +381,15 @@ private:
 	TUniquePtr<UnrealLogHandler> LogHandler;
 
 	TAtomic<bool> Initialized = false;
+	TAtomic<uint32> TextureCacheGeneration = 0;
 
 	mutable TMap<TLazyObjectPtr<URulePackage>, ResolveMapSPtr> ResolveMapCache;
 	mutable TMap<TLazyObjectPtr<URulePackage>, FGraphEventRef> ResolveMapEventGraphRefCache;
 
 	mutable FCriticalSection LoadResolveMapLock;
+	// Content hashes of the loaded rule packages by their file uri, only computed if the persistent mesh cache is enabled
+	mutable TMap<FString, FString> RpkContentHashes;
+	mutable TMap<TLazyObjectPtr<URulePackage>, FString> RpkFileUris;
 
 	mutable FThreadSafeCounter GenerateCallsCounter;
 	mutable FThreadSafeCounter RpkLoadingTasksCounter;
@@ -328,9 +397,12 @@ private:
 
 	FString RpkFolder;
 
-	TMap<Vitruvio::FMaterialAttributeContainer, TObjectPtr<UMaterialInstanceDynamic>> MaterialCache;
-	TMap<FString, Vitruvio::FTextureData> TextureCache;
+	TMap<Vitruvio::FMaterialAttributeContainer, TWeakObjectPtr<UMaterialInstanceDynamic>> MaterialCache;
+	FTextureCache TextureCache;
 	FMeshCache MeshCache;
+	FMaterialPipeline MaterialPipeline;
+	FTSTicker::FDelegateHandle TickHandle;
+	FDelegateHandle PostGarbageCollectHandle;
 
 	mutable FCriticalSection OcclusionLock;
 	mutable TMap<int64, prt::OcclusionSet::Handle> OcclusionHandleCache;
@@ -340,7 +412,14 @@ private:
 	FCriticalSection RegisterMeshLock;
 	TSet<TObjectPtr<UStaticMesh>> RegisteredMeshes;
 
+	struct FGeneratedTexture;
+	mutable FRWLock GeneratedTexturesLock;
+	TMap<FString, TSharedPtr<FGeneratedTexture>> GeneratedTextures;
+
 	void NotifyGenerateCompleted() const;
+	void OnPostGarbageCollect();
+
+	bool Tick(float DeltaTime);
 
 	TFuture<ResolveMapSPtr> LoadResolveMapAsync(URulePackage* RulePackage) const;
 	void InitializePrt();
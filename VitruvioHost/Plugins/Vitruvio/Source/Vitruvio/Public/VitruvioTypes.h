@@ -82,7 +82,11 @@ enum class EPrtUvSetType : int32
 
 const FString CityEngineDefaultMaterialName("CityEngineMaterial");
 
-struct FMaterialAttributeContainer
+/**
+ * Material attributes in canonical form, the properties are sorted by key. Instances are interned by FMaterialAttributeContainer and
+ * immutable from then on, so equal attributes share one instance and their hash is only computed once.
+ */
+struct FMaterialAttributes
 {
 	TMap<FString, FString> TextureProperties;
 	TMap<FString, FLinearColor> ColorProperties;
@@ -90,19 +94,60 @@ struct FMaterialAttributeContainer
 	TMap<FString, FString> StringProperties;
 
 	FString BlendMode;
+
+	/** Hash of all attributes, computed when interned. */
+	uint64 Hash = 0;
+};
+
+struct FMaterialAttributeContainer
+{
 	FString Name; // ignored on purpose for hash and equality
 
-	explicit FMaterialAttributeContainer(const prt::AttributeMap* AttributeMap);
+	/** Creates the default material, used if the encoder does not emit materials. */
+	VITRUVIO_API FMaterialAttributeContainer();
+	VITRUVIO_API explicit FMaterialAttributeContainer(const prt::AttributeMap* AttributeMap);
+	VITRUVIO_API FMaterialAttributeContainer(FMaterialAttributes Attributes, const FString& Name);
+
+	const TMap<FString, FString>& GetTextureProperties() const
+	{
+		return Attributes->TextureProperties;
+	}
+
+	const TMap<FString, FLinearColor>& GetColorProperties() const
+	{
+		return Attributes->ColorProperties;
+	}
+
+	const TMap<FString, double>& GetScalarProperties() const
+	{
+		return Attributes->ScalarProperties;
+	}
+
+	const TMap<FString, FString>& GetStringProperties() const
+	{
+		return Attributes->StringProperties;
+	}
+
+	const FString& GetBlendMode() const
+	{
+		return Attributes->BlendMode;
+	}
+
+	/** Returns a copy of the attributes, which can be modified and used to create a new container. */
+	FMaterialAttributes CopyAttributes() const
+	{
+		return *Attributes;
+	}
+
+	uint64 GetHash() const
+	{
+		return Attributes->Hash;
+	}
 
 	friend bool operator==(const FMaterialAttributeContainer& Lhs, const FMaterialAttributeContainer& RHS)
 	{
-		// clang-format off
-		return Lhs.TextureProperties.OrderIndependentCompareEqual(RHS.TextureProperties) &&
-			   Lhs.ColorProperties.OrderIndependentCompareEqual(RHS.ColorProperties) &&
-			   Lhs.ScalarProperties.OrderIndependentCompareEqual(RHS.ScalarProperties) &&
-			   Lhs.StringProperties.OrderIndependentCompareEqual(RHS.StringProperties) && 
-			   Lhs.BlendMode == RHS.BlendMode;
-		// clang-format on
+		// Equal attributes are interned into the same instance
+		return Lhs.Attributes == RHS.Attributes;
 	}
 
 	friend bool operator!=(const FMaterialAttributeContainer& Lhs, const FMaterialAttributeContainer& RHS)
@@ -110,13 +155,18 @@ struct FMaterialAttributeContainer
 		return !(Lhs == RHS);
 	}
 
-	friend uint32 GetTypeHash(const FMaterialAttributeContainer& Object);
+	friend uint32 GetTypeHash(const FMaterialAttributeContainer& Object)
+	{
+		return static_cast<uint32>(Object.GetHash());
+	}
+
+	friend VITRUVIO_API FArchive& operator<<(FArchive& Ar, FMaterialAttributeContainer& Object);
 
 	FString GetMaterialName() const
 	{
 		if (Name.StartsWith(CityEngineDefaultMaterialName))
 		{
-			if (const FString* ColorMapKey = TextureProperties.Find("colorMap"))
+			if (const FString* ColorMapKey = GetTextureProperties().Find("colorMap"))
 			{
 				return FPaths::GetBaseFilename(*ColorMapKey);
 			}
@@ -124,6 +174,9 @@ struct FMaterialAttributeContainer
 
 		return Name;
 	}
+
+private:
+	TSharedPtr<const FMaterialAttributes> Attributes;
 };
 
 struct FInstanceCacheKey
@@ -145,11 +198,35 @@ struct FInstanceCacheKey
 };
 using FInstanceMap = TMap<FInstanceCacheKey, TArray<FTransform>>;
 
+/**
+ * \brief Splits a material into the material shared by all of its color variants, whose diffuse color is white, and the diffuse color of
+ * the variant. Parent materials which multiply the diffuse color with the vertex color reproduce the variant from the shared material.
+ *
+ * \param OutColor the diffuse color of the variant or white if the material has no diffuse color.
+ * \return the material shared by all color variants.
+ */
+VITRUVIO_API FMaterialAttributeContainer SplitColorVariant(const FMaterialAttributeContainer& Material, FLinearColor& OutColor);
+
+/** Classification of the content of a texture when it is used as opacity map. */
+enum class EOpacityClassification : uint8
+{
+	/** Nearly all pixels are opaque. */
+	Opaque,
+	/** Nearly all pixels are either opaque or transparent. */
+	Masked,
+	Translucent
+};
+
 struct FTextureData
 {
 	UTexture2D* Texture = nullptr;
 	uint32 NumChannels = 0;
-	FDateTime LoadTime;
+	/** The texture cache generation of the module when the texture has been decoded (see VitruvioModule::GetTextureCacheGeneration). */
+	uint32 Generation = 0;
+	/** The hash of the decoded content of the texture (see ComputeTextureContentHash). */
+	uint64 ContentHash = 0;
+	/** The opacity of the texture content, which is computed while decoding opacity maps and decides the blend mode of their materials. */
+	EOpacityClassification OpacityClassification = EOpacityClassification::Translucent;
 
 	friend bool operator==(const FTextureData& Lhs, const FTextureData& Rhs)
 	{
@@ -173,4 +250,7 @@ struct FCollisionData
 	}
 };
 
+/** Collision data is shared between the mesh and its collision data provider and is not modified after it has been created. */
+using FCollisionDataPtr = TSharedPtr<FCollisionData, ESPMode::ThreadSafe>;
+
 } // namespace Vitruvio
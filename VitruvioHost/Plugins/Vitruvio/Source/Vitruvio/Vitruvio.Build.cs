@@ -68,5 +68,10 @@ public class Vitruvio : ModuleRules
 				"AppFramework",
 			}
 		);
+
+		if (Target.bBuildEditor)
+		{
+			PrivateDependencyModuleNames.Add("MeshReductionInterface");
+		}
 	}
 }
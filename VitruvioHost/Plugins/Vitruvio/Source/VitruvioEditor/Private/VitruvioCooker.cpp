@@ -35,7 +35,7 @@ namespace
 {
 
 using FMaterialCache = TMap<UMaterialInstance*, UMaterialInstanceConstant*>;
-using FTextureCache = TMap<UTexture*, UTexture2D*>;
+using FCookedTextureCache = TMap<UTexture*, UTexture2D*>;
 using FStaticMeshCache = TMap<UStaticMesh*, UStaticMesh*>;
 
 std::atomic<bool> IsCooking;
@@ -101,7 +101,7 @@ ETextureSourceFormat GetTextureFormatFromPixelFormat(const EPixelFormat PixelFor
 	}
 }
 
-UTexture2D* SaveTexture(UTexture2D* Original, const FString& Path, FTextureCache& TextureCache)
+UTexture2D* SaveTexture(UTexture2D* Original, const FString& Path, FCookedTextureCache& TextureCache)
 {
 	if (TextureCache.Contains(Original))
 	{
@@ -151,7 +151,7 @@ UTexture2D* SaveTexture(UTexture2D* Original, const FString& Path, FTextureCache
 }
 
 UMaterialInstanceConstant* SaveMaterial(UMaterialInstance* Material, const FString& Path, FMaterialCache& MaterialCache,
-										FTextureCache& TextureCache)
+										FCookedTextureCache& TextureCache)
 {
 	if (MaterialCache.Contains(Material))
 	{
@@ -215,7 +215,7 @@ UMaterialInstanceConstant* SaveMaterial(UMaterialInstance* Material, const FStri
 }
 
 UStaticMesh* SaveStaticMesh(UStaticMesh* Mesh, const FString& Path, FStaticMeshCache& MeshCache, FMaterialCache& MaterialCache,
-							FTextureCache& TextureCache)
+							FCookedTextureCache& TextureCache)
 {
 	if (MeshCache.Contains(Mesh))
 	{
@@ -291,7 +291,7 @@ void CookActors(const TArray<AActor*>& Actors, const FString& CookPath)
 	CookTask.MakeDialog();
 
 	FMaterialCache MaterialCache;
-	FTextureCache TextureCache;
+	FCookedTextureCache TextureCache;
 	FStaticMeshCache MeshCache;
 
 	for (AActor* Actor : Actors)